@@ -0,0 +1,217 @@
+/*
+    Queue World is copyright (c) 2014-2018 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+/*
+    QwMpmcBoundedQueue benchmark
+
+    Transfers 32-byte events from producers to a single consumer, and
+    compares:
+      - QwMpmcBoundedQueue try_push()/try_pop()
+      - QwMpmcBoundedQueue try_push_n()/try_pop_n(), batches of 16
+      - the intrusive alternative: allocate a node from a QwNodePool, copy
+        the event into it, and pass it through a QwMpscFifoQueue. The
+        consumer copies the event out and frees the node.
+    Reports events per second.
+
+        g++ -std=c++11 -O2 -pthread -Iinclude benchmarks/QwMpmcBoundedQueue_benchmark.cpp src/QwNodePool.cpp src/QwVirtualMemory.cpp src/QwFutex.cpp -o mpmcboundedqueue
+*/
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "QwMpmcBoundedQueue.h"
+#include "QwMpscFifoQueue.h"
+#include "QwNodePool.h"
+
+namespace {
+
+struct Event {
+    int producer;
+    int sequence;
+    double time;
+    char data[16];
+};
+static_assert(sizeof(Event) == 32, "expected a 32-byte event");
+
+struct EventNode {
+    EventNode *links_[1];
+    enum { NEXT_LINK, LINK_COUNT };
+
+    Event event;
+};
+
+const std::size_t QUEUE_CAPACITY = 1024;
+const int BATCH_SIZE = 16;
+const int DEFAULT_EVENTS = 4000000;
+
+struct RingScheme {
+    QwMpmcBoundedQueue<Event> queue;
+    RingScheme() : queue(QUEUE_CAPACITY) {}
+    static const char *name() { return "ring"; }
+
+    void produce(const Event *events, int count)
+    {
+        for (int i = 0; i < count; ++i) {
+            while (!queue.try_push(events[i]))
+                std::this_thread::yield();
+        }
+    }
+
+    int consume(Event *events)
+    {
+        return queue.try_pop(events[0]) ? 1 : 0;
+    }
+};
+
+struct RingBatchScheme {
+    QwMpmcBoundedQueue<Event> queue;
+    RingBatchScheme() : queue(QUEUE_CAPACITY) {}
+    static const char *name() { return "ring batch"; }
+
+    void produce(const Event *events, int count)
+    {
+        while (count > 0) {
+            std::size_t n = queue.try_push_n(events, count);
+            if (n == 0)
+                std::this_thread::yield();
+            events += n;
+            count -= static_cast<int>(n);
+        }
+    }
+
+    int consume(Event *events)
+    {
+        return static_cast<int>(queue.try_pop_n(events, BATCH_SIZE));
+    }
+};
+
+struct NodeScheme {
+    QwNodePool<EventNode> pool;
+    QwMpscFifoQueue<EventNode*, EventNode::NEXT_LINK> queue;
+    NodeScheme() : pool(QUEUE_CAPACITY) {}
+    static const char *name() { return "pool+mpsc"; }
+
+    void produce(const Event *events, int count)
+    {
+        for (int i = 0; i < count; ++i) {
+            EventNode *n = pool.allocate();
+            while (!n) {
+                std::this_thread::yield();
+                n = pool.allocate();
+            }
+            n->event = events[i];
+            queue.push(n);
+        }
+    }
+
+    int consume(Event *events)
+    {
+        EventNode *n = queue.pop();
+        if (!n)
+            return 0;
+        events[0] = n->event;
+        pool.deallocate(n);
+        return 1;
+    }
+};
+
+// returns events per second
+template<typename Scheme>
+double run(int producerCount, int events)
+{
+    Scheme scheme;
+    std::atomic<int> readyCount(0);
+    std::atomic<bool> go(false);
+    const int eventsPerProducer = events / producerCount;
+    const int total = eventsPerProducer * producerCount;
+    long long sum = 0;
+
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producerCount; ++p) {
+        threads.emplace_back([&, p]() {
+            readyCount.fetch_add(1);
+            while (!go.load())
+                std::this_thread::yield();
+
+            Event batch[BATCH_SIZE] = {};
+            for (int i = 0; i < eventsPerProducer; i += BATCH_SIZE) {
+                int n = (eventsPerProducer - i < BATCH_SIZE) ? eventsPerProducer - i : BATCH_SIZE;
+                for (int j = 0; j < n; ++j) {
+                    batch[j].producer = p;
+                    batch[j].sequence = i + j;
+                }
+                scheme.produce(batch, n);
+            }
+        });
+    }
+
+    while (readyCount.load() < producerCount)
+        std::this_thread::yield();
+
+    auto start = std::chrono::steady_clock::now();
+    go.store(true);
+
+    Event received[BATCH_SIZE];
+    for (int consumed = 0; consumed < total; ) {
+        int n = scheme.consume(received);
+        if (n == 0) {
+            std::this_thread::yield();
+            continue;
+        }
+        for (int i = 0; i < n; ++i)
+            sum += received[i].sequence;
+        consumed += n;
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    for (auto& t : threads)
+        t.join();
+
+    if (sum == 42) // (prevent the consumer being optimised away)
+        std::printf(" ");
+
+    return total / std::chrono::duration<double>(end - start).count();
+}
+
+} // end anonymous namespace
+
+int main(int argc, char *argv[])
+{
+    int events = (argc > 1) ? std::atoi(argv[1]) : DEFAULT_EVENTS;
+
+    std::printf("events: %d, 1 consumer\n", events);
+    std::printf("%9s %14s %14s %14s\n", "producers", RingScheme::name(), RingBatchScheme::name(), NodeScheme::name());
+
+    const int producerCounts[] = { 1, 2, 4 };
+    for (int producers : producerCounts) {
+        double ring = run<RingScheme>(producers, events);
+        double ringBatch = run<RingBatchScheme>(producers, events);
+        double node = run<NodeScheme>(producers, events);
+        std::printf("%9d %14.0f %14.0f %14.0f\n", producers, ring, ringBatch, node);
+    }
+
+    return 0;
+}
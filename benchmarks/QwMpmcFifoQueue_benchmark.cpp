@@ -0,0 +1,235 @@
+/*
+    Queue World is copyright (c) 2014-2018 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+/*
+    QwMpmcFifoQueue benchmark
+
+    Producers push nodes and consumers pop them, for a range of
+    producer/consumer thread counts. Compares QwMpmcFifoQueue with the
+    baseline it replaces: a QwMpscFifoQueue whose pop() is serialized by a
+    std::mutex. Reports items per second.
+
+    Nodes are recycled through a QwNodePool. With QwMpmcFifoQueue, popped
+    nodes are returned to the pool by the epoch reclaimer; with the
+    baseline, consumers return them directly.
+
+        g++ -std=c++11 -O2 -pthread -Iinclude benchmarks/QwMpmcFifoQueue_benchmark.cpp src/QwNodePool.cpp src/QwVirtualMemory.cpp src/QwFutex.cpp -o mpmcfifoqueue
+*/
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "QwEpochReclaimer.h"
+#include "QwMpmcFifoQueue.h"
+#include "QwMpscFifoQueue.h"
+#include "QwNodePool.h"
+
+namespace {
+
+struct BenchmarkNode {
+    std::atomic<BenchmarkNode*> links_[2];
+    enum { NEXT_LINK, RECLAIM_LINK, LINK_COUNT };
+
+    int value;
+
+    BenchmarkNode() : value(0)
+    {
+        for (int i=0; i < LINK_COUNT; ++i)
+            links_[i].store(nullptr, std::memory_order_relaxed);
+    }
+};
+
+typedef QwEpochReclaimer<BenchmarkNode*, BenchmarkNode::RECLAIM_LINK> Reclaimer;
+typedef QwMpmcFifoQueue<BenchmarkNode*, BenchmarkNode::NEXT_LINK, BenchmarkNode::RECLAIM_LINK> MpmcQueue;
+typedef QwMpscFifoQueue<BenchmarkNode*, BenchmarkNode::NEXT_LINK> MpscQueue;
+
+const int MAX_THREADS = 16;
+const std::size_t POOL_NODES = 4096;
+const int DEFAULT_ITEMS = 2000000;
+
+QwNodePool<BenchmarkNode> *pool_;
+
+void reclaimNodes(Reclaimer::list_type& nodes, void *)
+{
+    pool_->deallocate_list(nodes);
+}
+
+BenchmarkNode *allocateNode()
+{
+    BenchmarkNode *n = pool_->allocate();
+    while (!n) { // all nodes queued or awaiting reclamation
+        std::this_thread::yield();
+        n = pool_->allocate();
+    }
+    return n;
+}
+
+struct MpmcScheme {
+    Reclaimer reclaimer;
+    MpmcQueue queue;
+
+    MpmcScheme()
+        : reclaimer(MAX_THREADS, reclaimNodes, nullptr)
+        , queue(reclaimer, pool_->allocate()) {}
+
+    ~MpmcScheme() { pool_->deallocate(queue.dummy_node()); }
+
+    static const char *name() { return "ms-queue"; }
+
+    std::size_t register_thread() { return reclaimer.register_thread(); }
+    void unregister_thread(std::size_t t) { reclaimer.unregister_thread(t); }
+
+    void push(std::size_t t, BenchmarkNode *n)
+    {
+        Reclaimer::Guard guard(reclaimer, t);
+        queue.push(n);
+    }
+
+    bool pop(std::size_t t, long long& sum)
+    {
+        Reclaimer::Guard guard(reclaimer, t);
+        BenchmarkNode *n = queue.pop(t);
+        if (!n)
+            return false;
+        sum += n->value; // (the node is reclaimed later)
+        return true;
+    }
+};
+
+struct MutexScheme {
+    MpscQueue queue;
+    std::mutex popMutex;
+
+    static const char *name() { return "mutex"; }
+
+    std::size_t register_thread() { return 0; }
+    void unregister_thread(std::size_t) {}
+
+    void push(std::size_t, BenchmarkNode *n)
+    {
+        queue.push(n);
+    }
+
+    bool pop(std::size_t, long long& sum)
+    {
+        BenchmarkNode *n;
+        {
+            std::lock_guard<std::mutex> lock(popMutex);
+            n = queue.pop();
+        }
+        if (!n)
+            return false;
+        sum += n->value;
+        pool_->deallocate(n);
+        return true;
+    }
+};
+
+// returns items per second
+template<typename Scheme>
+double run(int producerCount, int consumerCount, int items)
+{
+    pool_ = new QwNodePool<BenchmarkNode>(POOL_NODES);
+    double result;
+    {
+        Scheme scheme;
+        std::atomic<int> readyCount(0);
+        std::atomic<bool> go(false);
+        std::atomic<int> popped(0);
+        std::atomic<long long> sink(0);
+        const int itemsPerProducer = items / producerCount;
+        const int total = itemsPerProducer * producerCount;
+
+        std::vector<std::thread> threads;
+        for (int p = 0; p < producerCount; ++p) {
+            threads.emplace_back([&]() {
+                std::size_t t = scheme.register_thread();
+                readyCount.fetch_add(1);
+                while (!go.load())
+                    std::this_thread::yield();
+
+                for (int i = 0; i < itemsPerProducer; ++i) {
+                    BenchmarkNode *n = allocateNode();
+                    n->value = i;
+                    scheme.push(t, n);
+                }
+                scheme.unregister_thread(t);
+            });
+        }
+        for (int c = 0; c < consumerCount; ++c) {
+            threads.emplace_back([&]() {
+                std::size_t t = scheme.register_thread();
+                long long sum = 0;
+                readyCount.fetch_add(1);
+                while (!go.load())
+                    std::this_thread::yield();
+
+                while (popped.load(std::memory_order_relaxed) < total) {
+                    if (scheme.pop(t, sum))
+                        popped.fetch_add(1, std::memory_order_relaxed);
+                    else
+                        std::this_thread::yield();
+                }
+                sink.fetch_add(sum);
+                scheme.unregister_thread(t);
+            });
+        }
+
+        while (readyCount.load() < producerCount + consumerCount)
+            std::this_thread::yield();
+
+        auto start = std::chrono::steady_clock::now();
+        go.store(true);
+        for (auto& t : threads)
+            t.join();
+        auto end = std::chrono::steady_clock::now();
+
+        result = total / std::chrono::duration<double>(end - start).count();
+    } // (scheme destructor returns the remaining nodes to the pool)
+
+    delete pool_;
+    return result;
+}
+
+} // end anonymous namespace
+
+int main(int argc, char *argv[])
+{
+    int items = (argc > 1) ? std::atoi(argv[1]) : DEFAULT_ITEMS;
+
+    std::printf("items: %d\n", items);
+    std::printf("%9s %9s %14s %14s %8s\n", "producers", "consumers", "mutex items/s", "ms-queue items/s", "speedup");
+
+    const int counts[][2] = { {1, 1}, {1, 4}, {2, 2}, {4, 1}, {4, 4}, {8, 8} };
+    for (const auto& c : counts) {
+        double mutex = run<MutexScheme>(c[0], c[1], items);
+        double ms = run<MpmcScheme>(c[0], c[1], items);
+        std::printf("%9d %9d %14.0f %16.0f %8.2f\n", c[0], c[1], mutex, ms, ms / mutex);
+    }
+
+    return 0;
+}
@@ -0,0 +1,127 @@
+/*
+    Queue World is copyright (c) 2014-2018 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+/*
+    MPSC FIFO consumer latency benchmark: QwMpscFifoQueue vs QwVyukovMpscFifoQueue
+
+    Pushes a burst of nodes, then pops them all, timing each pop(). Reports
+    the mean pop() time, and the slowest pop() in each burst (the median over
+    rounds, to discount occasional interrupts). QwMpscFifoQueue's first
+    pop() after a burst reverses the whole captured chain, so its maximum
+    grows with the burst size. QwVyukovMpscFifoQueue's pop() is O(1).
+
+    Runs on a single thread, so the measurement is not disturbed by
+    scheduling; contention between producers and the consumer is not
+    measured.
+
+        g++ -std=c++11 -O2 -Iinclude benchmarks/QwMpscFifoQueue_latency_benchmark.cpp -o mpscfifoqueue_latency
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "QwMpscFifoQueue.h"
+#include "QwVyukovMpscFifoQueue.h"
+
+namespace {
+
+struct BenchmarkNode {
+    std::atomic<BenchmarkNode*> links_[1];
+    enum { NEXT_LINK, LINK_COUNT };
+
+    int value;
+
+    BenchmarkNode() : value(0) { links_[0].store(nullptr, std::memory_order_relaxed); }
+};
+
+typedef QwMpscFifoQueue<BenchmarkNode*, BenchmarkNode::NEXT_LINK> ReversingQueue;
+typedef QwVyukovMpscFifoQueue<BenchmarkNode*, BenchmarkNode::NEXT_LINK> VyukovQueue;
+
+const int DEFAULT_ROUNDS = 50;
+
+struct Result {
+    double meanNs;
+    double maxNs; // slowest pop() in a burst, median over rounds
+};
+
+template<typename Queue>
+Result run(std::vector<BenchmarkNode>& nodes, int rounds)
+{
+    typedef std::chrono::steady_clock clock;
+
+    Queue q;
+    double totalNs = 0;
+    std::vector<double> maxNs(rounds); // slowest pop() in each round
+    long long sum = 0;
+
+    for (int r = 0; r < rounds; ++r) {
+        maxNs[r] = 0;
+        for (std::size_t i = 0; i < nodes.size(); ++i)
+            q.push(&nodes[i]);
+
+        for (std::size_t i = 0; i < nodes.size(); ++i) {
+            clock::time_point start = clock::now();
+            BenchmarkNode *n = q.pop();
+            clock::time_point end = clock::now();
+            sum += n->value;
+
+            double ns = std::chrono::duration<double, std::nano>(end - start).count();
+            totalNs += ns;
+            maxNs[r] = std::max(maxNs[r], ns);
+        }
+    }
+
+    if (sum == 42) // (prevent the pops being optimised away)
+        std::printf(" ");
+
+    std::nth_element(maxNs.begin(), maxNs.begin() + rounds / 2, maxNs.end());
+    Result result = { totalNs / (static_cast<double>(rounds) * nodes.size()), maxNs[rounds / 2] };
+    return result;
+}
+
+} // end anonymous namespace
+
+int main(int argc, char *argv[])
+{
+    int rounds = (argc > 1) ? std::atoi(argv[1]) : DEFAULT_ROUNDS;
+
+    std::printf("rounds: %d (pop times include clock overhead)\n", rounds);
+    std::printf("%8s %16s %16s %16s %16s\n", "burst", "reversing mean", "reversing max", "vyukov mean", "vyukov max");
+
+    const std::size_t bursts[] = { 16, 256, 4096, 65536 };
+    for (std::size_t burst : bursts) {
+        std::vector<BenchmarkNode> nodes(burst);
+        for (std::size_t i = 0; i < burst; ++i)
+            nodes[i].value = static_cast<int>(i);
+
+        Result reversing = run<ReversingQueue>(nodes, rounds);
+        Result vyukov = run<VyukovQueue>(nodes, rounds);
+        std::printf("%8zu %13.1f ns %13.0f ns %13.1f ns %13.0f ns\n", burst,
+                reversing.meanNs, reversing.maxNs, vyukov.meanNs, vyukov.maxNs);
+    }
+
+    return 0;
+}
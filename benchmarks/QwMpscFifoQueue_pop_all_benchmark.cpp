@@ -0,0 +1,133 @@
+/*
+    Queue World is copyright (c) 2014-2018 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+/*
+    QwMpscFifoQueue batch consumer benchmark
+
+    Pushes a burst of nodes, then drains the queue into a QwSTailList in
+    one of three ways:
+      - pop() each node, then push_back() it on to the list
+      - pop_up_to(64) repeatedly
+      - pop_all()
+    Reports the time per node. Runs on a single thread.
+
+        g++ -std=c++11 -O2 -DNDEBUG -Iinclude benchmarks/QwMpscFifoQueue_pop_all_benchmark.cpp -o mpscfifoqueue_pop_all
+
+    (Define NDEBUG, otherwise QW_VALIDATE_NODE_LINKS adds link writes.)
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "QwMpscFifoQueue.h"
+#include "QwSTailList.h"
+
+namespace {
+
+struct BenchmarkNode {
+    BenchmarkNode *links_[1];
+    enum { NEXT_LINK, LINK_COUNT };
+
+    int value;
+
+    BenchmarkNode() : value(0) { links_[0] = nullptr; }
+};
+
+typedef QwMpscFifoQueue<BenchmarkNode*, BenchmarkNode::NEXT_LINK> Queue;
+typedef QwSTailList<BenchmarkNode*, BenchmarkNode::NEXT_LINK> List;
+
+const int DEFAULT_ROUNDS = 200;
+
+enum DrainMethod { POP, POP_UP_TO, POP_ALL };
+
+void drain(Queue& q, List& result, DrainMethod method)
+{
+    switch (method) {
+    case POP:
+        while (BenchmarkNode *n = q.pop())
+            result.push_back(n);
+        break;
+    case POP_UP_TO:
+        while (q.pop_up_to(64, result) != 0)
+            ;
+        break;
+    case POP_ALL:
+        q.pop_all(result);
+        break;
+    }
+}
+
+// returns ns per node
+double run(std::vector<BenchmarkNode>& nodes, int rounds, DrainMethod method)
+{
+    typedef std::chrono::steady_clock clock;
+
+    Queue q;
+    List result;
+    double totalNs = 0;
+    long long sum = 0;
+
+    for (int r = 0; r < rounds; ++r) {
+        for (std::size_t i = 0; i < nodes.size(); ++i)
+            q.push(&nodes[i]);
+
+        clock::time_point start = clock::now();
+        drain(q, result, method);
+        // consume the list, as the client would
+        while (!result.empty())
+            sum += result.pop_front()->value;
+        clock::time_point end = clock::now();
+
+        totalNs += std::chrono::duration<double, std::nano>(end - start).count();
+    }
+
+    if (sum != rounds * static_cast<long long>(nodes.size() * (nodes.size() - 1) / 2))
+        std::printf("ERROR: nodes lost or duplicated\n");
+
+    return totalNs / (static_cast<double>(rounds) * nodes.size());
+}
+
+} // end anonymous namespace
+
+int main(int argc, char *argv[])
+{
+    int rounds = (argc > 1) ? std::atoi(argv[1]) : DEFAULT_ROUNDS;
+
+    std::printf("rounds: %d\n", rounds);
+    std::printf("%8s %14s %14s %14s\n", "burst", "pop ns/node", "pop_up_to(64)", "pop_all");
+
+    const std::size_t bursts[] = { 16, 256, 4096, 65536 };
+    for (std::size_t burst : bursts) {
+        std::vector<BenchmarkNode> nodes(burst);
+        for (std::size_t i = 0; i < burst; ++i)
+            nodes[i].value = static_cast<int>(i);
+
+        double pop = run(nodes, rounds, POP);
+        double popUpTo = run(nodes, rounds, POP_UP_TO);
+        double popAll = run(nodes, rounds, POP_ALL);
+        std::printf("%8zu %14.2f %14.2f %14.2f\n", burst, pop, popUpTo, popAll);
+    }
+
+    return 0;
+}
@@ -0,0 +1,126 @@
+/*
+    Queue World is copyright (c) 2014-2018 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+/*
+    QwNodePool contention benchmark
+
+    Each thread repeatedly allocates a small batch of nodes from a shared
+    pool, then frees them. Reports total allocate+deallocate pairs per second
+    for a range of thread counts.
+
+    Two pools of 160 byte nodes are compared: one with the default
+    power-of-two stride (256 bytes, shift conversion), the other with
+    CACHE_LINE_STRIDE (192 bytes, multiply conversion).
+
+    Build once per tagged pointer backend (see QwConfig.h) and compare:
+
+        g++ -std=c++11 -O2 -pthread -Iinclude benchmarks/QwNodePool_benchmark.cpp src/QwNodePool.cpp src/QwVirtualMemory.cpp src/QwFutex.cpp -o nodepool_packed
+        g++ -std=c++11 -O2 -pthread -mcx16 -DQW_NODEPOOL_USE_DWCAS=1 -Iinclude benchmarks/QwNodePool_benchmark.cpp src/QwNodePool.cpp src/QwVirtualMemory.cpp src/QwFutex.cpp -o nodepool_dwcas
+
+    To measure the elimination-backoff array, add -DQW_NODEPOOL_ELIMINATION=1
+    to either command line and compare with the plain build.
+*/
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "QwNodePool.h"
+
+namespace {
+
+struct BenchmarkNode {
+    char payload[160];
+};
+
+const int MAX_THREADS = 32;
+const int NODES_PER_THREAD = 8;
+const int DEFAULT_ITERATIONS = 1000000;
+
+// returns allocate+deallocate pairs per second
+double run(int threadCount, int iterations, QwRawNodePool::NodeStride stride)
+{
+    QwNodePool<BenchmarkNode> pool(MAX_THREADS * NODES_PER_THREAD, stride);
+    std::atomic<int> readyCount(0);
+    std::atomic<bool> go(false);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threadCount; ++t) {
+        threads.emplace_back([&]() {
+            BenchmarkNode *nodes[NODES_PER_THREAD];
+            readyCount.fetch_add(1);
+            while (!go.load())
+                std::this_thread::yield();
+
+            for (int i = 0; i < iterations; i += NODES_PER_THREAD) {
+                for (int j = 0; j < NODES_PER_THREAD; ++j)
+                    nodes[j] = pool.allocate();
+                for (int j = 0; j < NODES_PER_THREAD; ++j)
+                    pool.deallocate(nodes[j]); // pool is sized so that allocate() never fails
+            }
+        });
+    }
+
+    while (readyCount.load() < threadCount)
+        std::this_thread::yield();
+
+    auto start = std::chrono::steady_clock::now();
+    go.store(true);
+    for (auto& t : threads)
+        t.join();
+    auto end = std::chrono::steady_clock::now();
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    return (static_cast<double>(threadCount) * iterations) / seconds;
+}
+
+} // end anonymous namespace
+
+int main(int argc, char *argv[])
+{
+    int iterations = (argc > 1) ? std::atoi(argv[1]) : DEFAULT_ITERATIONS;
+
+#if (QW_NODEPOOL_USE_DWCAS == 1)
+    std::printf("QwNodePool backend: double-width CAS (pointer, count)\n");
+#else
+    std::printf("QwNodePool backend: packed 64-bit (count, index)\n");
+#endif
+#if (QW_NODEPOOL_ELIMINATION == 1)
+    std::printf("elimination backoff: enabled\n");
+#else
+    std::printf("elimination backoff: disabled\n");
+#endif
+    std::printf("iterations per thread: %d\n", iterations);
+    std::printf("ops/sec (allocate+deallocate pairs)\n");
+    std::printf("threads  power-of-two stride  cache-line stride\n");
+
+    for (int threadCount = 1; threadCount <= MAX_THREADS; threadCount *= 2) {
+        double powerOfTwo = run(threadCount, iterations, QwRawNodePool::POWER_OF_TWO_STRIDE);
+        double cacheLine = run(threadCount, iterations, QwRawNodePool::CACHE_LINE_STRIDE);
+        std::printf("%7d  %19.0f  %17.0f\n", threadCount, powerOfTwo, cacheLine);
+    }
+
+    return 0;
+}
@@ -0,0 +1,185 @@
+/*
+    Queue World is copyright (c) 2014-2018 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+/*
+    QwNodePool cache colouring benchmark
+
+    Repeatedly allocates a batch of nodes, touches the first cache line
+    (the "header") of each node, then frees the batch. Reports the time
+    per node and, where perf counters are available (Linux), L1 data
+    cache read misses per node.
+
+    With a power-of-two stride, node headers only map to
+    (set count * line size / stride) distinct L1 sets, so a batch
+    whose headers would easily fit in L1 suffers conflict misses.
+    COLOURED_STRIDE spreads the headers over every set.
+
+        g++ -std=c++11 -O2 -Iinclude benchmarks/QwNodePool_colouring_benchmark.cpp src/QwNodePool.cpp src/QwVirtualMemory.cpp src/QwFutex.cpp -o nodepool_colouring
+
+    perf counters may require: sysctl kernel.perf_event_paranoid=1
+*/
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "QwNodePool.h"
+
+namespace {
+
+const std::size_t BATCH_NODES = 256; // 256 headers = 16KB, half of a typical L1D
+const int DEFAULT_ROUNDS = 20000;
+
+// L1 data cache read miss counter for the calling thread. Inactive if perf is unavailable.
+class L1MissCounter {
+    int fd_;
+public:
+    L1MissCounter() : fd_(-1)
+    {
+#if defined(__linux__)
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd_ = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+    }
+
+    ~L1MissCounter()
+    {
+#if defined(__linux__)
+        if (fd_ != -1)
+            close(fd_);
+#endif
+    }
+
+    bool available() const { return fd_ != -1; }
+
+    void start()
+    {
+#if defined(__linux__)
+        if (fd_ != -1) {
+            ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    std::uint64_t stop()
+    {
+        std::uint64_t result = 0;
+#if defined(__linux__)
+        if (fd_ != -1) {
+            ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(fd_, &result, sizeof(result)) != sizeof(result))
+                result = 0;
+        }
+#endif
+        return result;
+    }
+};
+
+struct Result {
+    double nsPerNode;
+    double missesPerNode;
+};
+
+Result run(std::size_t nodeSize, QwRawNodePool::NodeStride stride, int rounds, L1MissCounter& counter)
+{
+    QwRawNodePool pool(nodeSize, BATCH_NODES, stride, QwRawNodePool::PREFAULT_STORAGE);
+    std::vector<void*> nodes(BATCH_NODES);
+    volatile std::uint64_t sink = 0;
+
+    auto body = [&](int roundCount) {
+        for (int r = 0; r < roundCount; ++r) {
+            std::size_t count = 0;
+            pool.allocate_n(BATCH_NODES, [&](void *node) { nodes[count++] = node; });
+            std::uint64_t sum = 0;
+            for (std::size_t i = 0; i < count; ++i) {
+                std::uint64_t *header = static_cast<std::uint64_t*>(nodes[i]);
+                header[1] += 1; // (header[0] holds the freelist link while the node is free)
+                sum += header[1];
+            }
+            sink = sink + sum;
+            pool.deallocate_n(nodes.data(), count);
+        }
+    };
+
+    body(rounds / 10 + 1); // warm up
+
+    counter.start();
+    auto start = std::chrono::steady_clock::now();
+    body(rounds);
+    auto end = std::chrono::steady_clock::now();
+    std::uint64_t misses = counter.stop();
+
+    double nodeCount = static_cast<double>(rounds) * BATCH_NODES;
+    Result result;
+    result.nsPerNode = std::chrono::duration<double, std::nano>(end - start).count() / nodeCount;
+    result.missesPerNode = static_cast<double>(misses) / nodeCount;
+    return result;
+}
+
+} // end anonymous namespace
+
+int main(int argc, char *argv[])
+{
+    int rounds = (argc > 1) ? std::atoi(argv[1]) : DEFAULT_ROUNDS;
+
+    L1MissCounter counter;
+    if (!counter.available())
+        std::printf("(L1D miss counter unavailable, reporting time only)\n");
+
+    std::printf("%d rounds of %d nodes\n", rounds, static_cast<int>(BATCH_NODES));
+    std::printf("%-10s %-14s %8s %12s %14s\n", "node size", "stride", "bytes", "ns/node", "L1D miss/node");
+
+    const std::size_t nodeSizes[] = { 256, 1024, 4096 };
+    for (std::size_t i = 0; i < sizeof(nodeSizes) / sizeof(nodeSizes[0]); ++i) {
+        const QwRawNodePool::NodeStride strides[] = { QwRawNodePool::POWER_OF_TWO_STRIDE, QwRawNodePool::COLOURED_STRIDE };
+        const char *strideNames[] = { "power-of-two", "coloured" };
+        for (int s = 0; s < 2; ++s) {
+            Result r = run(nodeSizes[i], strides[s], rounds, counter);
+            std::printf("%-10d %-14s %8d %12.2f ", static_cast<int>(nodeSizes[i]), strideNames[s],
+                    static_cast<int>(QwRawNodePool::node_stride_for(nodeSizes[i], strides[s])), r.nsPerNode);
+            if (counter.available())
+                std::printf("%14.3f\n", r.missesPerNode);
+            else
+                std::printf("%14s\n", "n/a");
+        }
+    }
+
+    return 0;
+}
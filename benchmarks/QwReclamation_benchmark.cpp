@@ -0,0 +1,267 @@
+/*
+    Queue World is copyright (c) 2014-2018 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+/*
+    Memory reclamation benchmark: QwEpochReclaimer vs QwHazardPointerDomain
+
+    Threads repeatedly pick one of a small set of shared slots. Most
+    operations read the node in the slot (inside an epoch critical section,
+    or under a hazard pointer). The remainder replace the node with a newly
+    allocated one and retire the old node. Two workloads are run:
+    read-heavy (10% replacements) and write-heavy (50% replacements).
+
+    Reports completed operations per second, the peak number of retired but
+    not yet reclaimed nodes (sampled by the replacing threads), and how many
+    replacements were skipped because the pool was exhausted. Skipped
+    replacements are not counted as operations. A row with skipped
+    replacements is marked invalid, since the remaining operations are
+    mostly reads and no longer match the workload. Epoch-based
+    reclamation's garbage is unbounded while any thread is stalled inside a
+    critical section, so with more threads than cores the epoch rows may
+    exhaust the pool; hazard pointer garbage stays bounded.
+
+        g++ -std=c++11 -O2 -pthread -Iinclude benchmarks/QwReclamation_benchmark.cpp src/QwNodePool.cpp src/QwVirtualMemory.cpp src/QwFutex.cpp -o reclamation
+*/
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "QwEpochReclaimer.h"
+#include "QwHazardPointers.h"
+#include "QwNodePool.h"
+
+namespace {
+
+struct BenchmarkNode {
+    BenchmarkNode *links_[1];
+    enum { RECLAIM_LINK, LINK_COUNT };
+
+    std::uint64_t value;
+
+    BenchmarkNode() : value(0) { links_[0] = nullptr; }
+};
+
+typedef QwEpochReclaimer<BenchmarkNode*, BenchmarkNode::RECLAIM_LINK> EpochReclaimer;
+typedef QwHazardPointerDomain<BenchmarkNode*, BenchmarkNode::RECLAIM_LINK, 1> HazardDomain;
+typedef QwSList<BenchmarkNode*, BenchmarkNode::RECLAIM_LINK> NodeList;
+
+const int MAX_THREADS = 8;
+const int SLOT_COUNT = 16;
+const std::size_t POOL_NODES = 1 << 18;
+const int DEFAULT_ITERATIONS = 1000000;
+
+QwNodePool<BenchmarkNode> *pool_;
+std::atomic<BenchmarkNode*> slots_[SLOT_COUNT];
+std::atomic<std::int64_t> unreclaimed_;
+std::atomic<std::int64_t> peakUnreclaimed_;
+std::atomic<std::int64_t> allocationFailures_;
+
+void reclaimNodes(NodeList& nodes, void *)
+{
+    std::int64_t count = 0;
+    for (NodeList::iterator i = nodes.begin(); i != nodes.end(); ++i)
+        ++count;
+    unreclaimed_.fetch_sub(count, std::memory_order_relaxed);
+    pool_->deallocate_list(nodes);
+}
+
+std::uint32_t xorshift(std::uint32_t& state)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+// Allocate a replacement for slot, returning the old node (or nullptr if the pool is exhausted)
+BenchmarkNode *replace(std::atomic<BenchmarkNode*>& slot)
+{
+    BenchmarkNode *n = pool_->allocate();
+    if (!n) {
+        allocationFailures_.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    n->value = 1;
+    BenchmarkNode *old = slot.exchange(n, std::memory_order_acq_rel);
+
+    std::int64_t u = unreclaimed_.fetch_add(1, std::memory_order_relaxed) + 1;
+    std::int64_t peak = peakUnreclaimed_.load(std::memory_order_relaxed);
+    while (u > peak && !peakUnreclaimed_.compare_exchange_weak(peak, u, std::memory_order_relaxed))
+        ;
+    return old;
+}
+
+struct EpochScheme {
+    EpochReclaimer reclaimer;
+    EpochScheme() : reclaimer(MAX_THREADS, reclaimNodes, nullptr) {}
+    static const char *name() { return "epoch"; }
+
+    std::size_t register_thread() { return reclaimer.register_thread(); }
+    void unregister_thread(std::size_t t) { reclaimer.unregister_thread(t); }
+
+    std::uint64_t read(std::size_t t, std::atomic<BenchmarkNode*>& slot)
+    {
+        EpochReclaimer::Guard guard(reclaimer, t);
+        return slot.load(std::memory_order_acquire)->value;
+    }
+
+    // returns false if the pool was exhausted
+    bool write(std::size_t t, std::atomic<BenchmarkNode*>& slot)
+    {
+        EpochReclaimer::Guard guard(reclaimer, t);
+        BenchmarkNode *old = replace(slot);
+        if (!old)
+            return false;
+        reclaimer.retire(t, old);
+        return true;
+    }
+};
+
+struct HazardScheme {
+    HazardDomain domain;
+    HazardScheme() : domain(MAX_THREADS, reclaimNodes, nullptr) {}
+    static const char *name() { return "hazard"; }
+
+    std::size_t register_thread() { return domain.register_thread(); }
+    void unregister_thread(std::size_t t) { domain.unregister_thread(t); }
+
+    std::uint64_t read(std::size_t t, std::atomic<BenchmarkNode*>& slot)
+    {
+        std::uint64_t result = domain.protect(t, 0, slot)->value;
+        domain.clear(t, 0);
+        return result;
+    }
+
+    bool write(std::size_t t, std::atomic<BenchmarkNode*>& slot)
+    {
+        BenchmarkNode *old = replace(slot);
+        if (!old)
+            return false;
+        domain.retire(t, old);
+        return true;
+    }
+};
+
+// returns completed operations per second
+template<typename Scheme>
+double run(int threadCount, int iterations, unsigned writePercent)
+{
+    pool_ = new QwNodePool<BenchmarkNode>(POOL_NODES);
+    for (int i = 0; i < SLOT_COUNT; ++i) {
+        BenchmarkNode *n = pool_->allocate();
+        n->value = 1;
+        slots_[i].store(n);
+    }
+    unreclaimed_.store(0);
+    peakUnreclaimed_.store(0);
+    allocationFailures_.store(0);
+
+    double result;
+    {
+        Scheme scheme;
+        std::atomic<int> readyCount(0);
+        std::atomic<bool> go(false);
+        std::atomic<std::uint64_t> sink(0);
+        std::atomic<std::uint64_t> completedCount(0);
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t < threadCount; ++t) {
+            threads.emplace_back([&, t]() {
+                std::size_t index = scheme.register_thread();
+                std::uint32_t random = 2463534242u + static_cast<std::uint32_t>(t) * 7919u;
+                std::uint64_t sum = 0;
+                std::uint64_t completed = 0;
+                readyCount.fetch_add(1);
+                while (!go.load())
+                    std::this_thread::yield();
+
+                for (int i = 0; i < iterations; ++i) {
+                    std::uint32_t r = xorshift(random);
+                    std::atomic<BenchmarkNode*>& slot = slots_[r % SLOT_COUNT];
+                    if ((r >> 8) % 100 < writePercent) {
+                        if (scheme.write(index, slot))
+                            ++completed;
+                    } else {
+                        sum += scheme.read(index, slot);
+                        ++completed;
+                    }
+                }
+                sink.fetch_add(sum);
+                completedCount.fetch_add(completed);
+                scheme.unregister_thread(index);
+            });
+        }
+
+        while (readyCount.load() < threadCount)
+            std::this_thread::yield();
+
+        auto start = std::chrono::steady_clock::now();
+        go.store(true);
+        for (auto& t : threads)
+            t.join();
+        auto end = std::chrono::steady_clock::now();
+
+        double seconds = std::chrono::duration<double>(end - start).count();
+        result = static_cast<double>(completedCount.load()) / seconds;
+    } // (scheme destructor reclaims the remaining nodes)
+
+    for (int i = 0; i < SLOT_COUNT; ++i)
+        pool_->deallocate(slots_[i].load());
+    delete pool_;
+    return result;
+}
+
+void report(const char *workload, const char *scheme, int threadCount, double ops)
+{
+    std::int64_t failures = allocationFailures_.load();
+    std::printf("%-12s %-7s %7d %14.0f %16lld %14lld%s\n", workload, scheme, threadCount, ops,
+            static_cast<long long>(peakUnreclaimed_.load()), static_cast<long long>(failures),
+            (failures != 0) ? "  INVALID: pool exhausted" : "");
+}
+
+} // end anonymous namespace
+
+int main(int argc, char *argv[])
+{
+    int iterations = (argc > 1) ? std::atoi(argv[1]) : DEFAULT_ITERATIONS;
+
+    std::printf("iterations per thread: %d\n", iterations);
+    std::printf("%-12s %-7s %7s %14s %16s %14s\n", "workload", "scheme", "threads", "ops/sec", "peak unreclaimed", "pool exhausted");
+
+    const unsigned writePercents[] = { 10, 50 };
+    const char *workloadNames[] = { "read-heavy", "write-heavy" };
+    for (int w = 0; w < 2; ++w) {
+        for (int threadCount = 1; threadCount <= MAX_THREADS; threadCount *= 2) {
+            double ops = run<EpochScheme>(threadCount, iterations, writePercents[w]);
+            report(workloadNames[w], EpochScheme::name(), threadCount, ops);
+            ops = run<HazardScheme>(threadCount, iterations, writePercents[w]);
+            report(workloadNames[w], HazardScheme::name(), threadCount, ops);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,242 @@
+/*
+    Queue World is copyright (c) 2014-2018 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+/*
+    QwSpscBoundedQueue benchmark
+
+    Transfers 32-byte events from one producer to one consumer, and compares:
+      - the CAS path: allocate a node from a QwNodePool, copy the event into
+        it, and pass it through a QwMpscFifoQueue. The consumer copies the
+        event out and frees the node.
+      - QwSpscBoundedQueue try_push()/try_pop()
+      - QwSpscBoundedQueue push_n()/pop_n(), batches of 16
+      - QwSpscBoundedQueue reserve_push()/commit_push() and
+        reserve_pop()/commit_pop(), spans of up to 16, filled and read in place
+    Reports events per second.
+
+        g++ -std=c++11 -O2 -pthread -Iinclude benchmarks/QwSpscBoundedQueue_benchmark.cpp src/QwNodePool.cpp src/QwVirtualMemory.cpp src/QwFutex.cpp -o spscboundedqueue
+*/
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+#include "QwMpscFifoQueue.h"
+#include "QwNodePool.h"
+#include "QwSpscBoundedQueue.h"
+
+namespace {
+
+struct Event {
+    int sequence;
+    int channel;
+    double time;
+    float data[4];
+};
+static_assert(sizeof(Event) == 32, "expected a 32-byte event");
+
+struct EventNode {
+    EventNode *links_[1];
+    enum { NEXT_LINK, LINK_COUNT };
+
+    Event event;
+};
+
+const std::size_t QUEUE_CAPACITY = 1024;
+const std::size_t BATCH_SIZE = 16;
+const int DEFAULT_EVENTS = 10000000;
+
+void makeEvent(Event& e, int sequence)
+{
+    e.sequence = sequence;
+    e.channel = 0;
+    e.time = sequence;
+}
+
+struct NodeScheme {
+    QwNodePool<EventNode> pool;
+    QwMpscFifoQueue<EventNode*, EventNode::NEXT_LINK> queue;
+    NodeScheme() : pool(QUEUE_CAPACITY) {}
+    static const char *name() { return "pool+mpsc"; }
+
+    // returns the number of events produced, starting at sequence
+    int produce(int sequence, int)
+    {
+        EventNode *n = pool.allocate();
+        if (!n)
+            return 0;
+        makeEvent(n->event, sequence);
+        queue.push(n);
+        return 1;
+    }
+
+    // returns the number of events consumed, and adds their sequence numbers to sum
+    int consume(long long& sum)
+    {
+        EventNode *n = queue.pop();
+        if (!n)
+            return 0;
+        Event e = n->event;
+        pool.deallocate(n);
+        sum += e.sequence;
+        return 1;
+    }
+};
+
+struct SpscScheme {
+    QwSpscBoundedQueue<Event> queue;
+    SpscScheme() : queue(QUEUE_CAPACITY) {}
+    static const char *name() { return "spsc"; }
+
+    int produce(int sequence, int)
+    {
+        Event e;
+        makeEvent(e, sequence);
+        return queue.try_push(e) ? 1 : 0;
+    }
+
+    int consume(long long& sum)
+    {
+        Event e;
+        if (!queue.try_pop(e))
+            return 0;
+        sum += e.sequence;
+        return 1;
+    }
+};
+
+struct SpscBatchScheme {
+    QwSpscBoundedQueue<Event> queue;
+    SpscBatchScheme() : queue(QUEUE_CAPACITY) {}
+    static const char *name() { return "spsc batch"; }
+
+    int produce(int sequence, int remaining)
+    {
+        Event events[BATCH_SIZE];
+        int n = (remaining < static_cast<int>(BATCH_SIZE)) ? remaining : static_cast<int>(BATCH_SIZE);
+        for (int i = 0; i < n; ++i)
+            makeEvent(events[i], sequence + i);
+        return static_cast<int>(queue.push_n(events, n));
+    }
+
+    int consume(long long& sum)
+    {
+        Event events[BATCH_SIZE];
+        std::size_t n = queue.pop_n(events, BATCH_SIZE);
+        for (std::size_t i = 0; i < n; ++i)
+            sum += events[i].sequence;
+        return static_cast<int>(n);
+    }
+};
+
+struct SpscSpanScheme {
+    QwSpscBoundedQueue<Event> queue;
+    SpscSpanScheme() : queue(QUEUE_CAPACITY) {}
+    static const char *name() { return "spsc span"; }
+
+    int produce(int sequence, int remaining)
+    {
+        std::size_t count = (remaining < static_cast<int>(BATCH_SIZE)) ? remaining : BATCH_SIZE;
+        Event *span = queue.reserve_push(count);
+        for (std::size_t i = 0; i < count; ++i)
+            makeEvent(span[i], sequence + static_cast<int>(i));
+        queue.commit_push(count);
+        return static_cast<int>(count);
+    }
+
+    int consume(long long& sum)
+    {
+        std::size_t count = BATCH_SIZE;
+        const Event *span = queue.reserve_pop(count);
+        for (std::size_t i = 0; i < count; ++i)
+            sum += span[i].sequence;
+        queue.commit_pop(count);
+        return static_cast<int>(count);
+    }
+};
+
+// returns events per second
+template<typename Scheme>
+double run(int events)
+{
+    Scheme scheme;
+    std::atomic<bool> go(false);
+    long long sum = 0;
+
+    std::thread producer([&]() {
+        while (!go.load())
+            std::this_thread::yield();
+
+        for (int sequence = 0; sequence < events; ) {
+            int n = scheme.produce(sequence, events - sequence);
+            if (n == 0)
+                std::this_thread::yield();
+            sequence += n;
+        }
+    });
+
+    auto start = std::chrono::steady_clock::now();
+    go.store(true);
+
+    for (int consumed = 0; consumed < events; ) {
+        int n = scheme.consume(sum);
+        if (n == 0)
+            std::this_thread::yield();
+        consumed += n;
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    producer.join();
+
+    long long expected = static_cast<long long>(events) * (events - 1) / 2;
+    if (sum != expected)
+        std::printf("%s: ERROR: events lost or duplicated\n", Scheme::name());
+
+    return events / std::chrono::duration<double>(end - start).count();
+}
+
+template<typename Scheme>
+void report(int events, double baseline)
+{
+    double rate = run<Scheme>(events);
+    std::printf("%-12s %14.0f %8.2fx\n", Scheme::name(), rate, (baseline > 0) ? rate / baseline : 1.0);
+}
+
+} // end anonymous namespace
+
+int main(int argc, char *argv[])
+{
+    int events = (argc > 1) ? std::atoi(argv[1]) : DEFAULT_EVENTS;
+
+    std::printf("events: %d, 1 producer, 1 consumer\n", events);
+    std::printf("%-12s %14s %9s\n", "scheme", "events/s", "vs mpsc");
+
+    double baseline = run<NodeScheme>(events);
+    std::printf("%-12s %14.0f %8.2fx\n", NodeScheme::name(), baseline, 1.0);
+    report<SpscScheme>(events, baseline);
+    report<SpscBatchScheme>(events, baseline);
+    report<SpscSpanScheme>(events, baseline);
+
+    return 0;
+}
@@ -100,6 +100,91 @@
 
 #endif
 
+// QW_NODEPOOL_USE_DWCAS selects the tagged pointer representation used by
+// QwNodePool's freelist:
+//  - 0: (count, index) packed into 64 bits. Portable to any platform with a
+//       64-bit CAS. The ABA count loses bits as the pool grows.
+//  - 1: (pointer, count) in 128 bits, updated with a double-width CAS.
+//       Requires x86-64 (GCC/clang need -mcx16) or MSVC x64.
+//
+// To explicitly enable/disable define QW_NODEPOOL_USE_DWCAS to 0 or 1
+// with a compiler -D flag, otherwise the portable default (0) is used.
+
+#ifndef QW_NODEPOOL_USE_DWCAS
+
+    #define QW_NODEPOOL_USE_DWCAS 0
+
+#elif (QW_NODEPOOL_USE_DWCAS != 0) && (QW_NODEPOOL_USE_DWCAS != 1)
+
+    #if defined(__GNUC__) || defined(__clang__)
+        #warning "QW_NODEPOOL_USE_DWCAS was defined but not 0 or 1. defaulting to 0."
+    #else
+        #pragma message "warning: QW_NODEPOOL_USE_DWCAS was defined but not 0 or 1. defaulting to 0."
+    #endif
+
+    #undef QW_NODEPOOL_USE_DWCAS
+    #define QW_NODEPOOL_USE_DWCAS 0
+
+#endif
+
+#if (QW_NODEPOOL_USE_DWCAS == 1) && !defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_16) && !defined(_M_X64)
+    #error "QW_NODEPOOL_USE_DWCAS requires a 128-bit CAS. With GCC or clang on x86-64 compile with -mcx16."
+#endif
+
+
+// QW_NODEPOOL_STATS enables collection of QwRawNodePool statistics
+// (live count, high-water mark, CAS failures, exhaustion events). See
+// QwRawNodePool::stats(). When disabled, the counters are compiled out.
+//
+// To explicitly enable/disable define QW_NODEPOOL_STATS to 0 or 1
+// with a compiler -D flag, otherwise statistics are disabled (0).
+
+#ifndef QW_NODEPOOL_STATS
+
+    #define QW_NODEPOOL_STATS 0
+
+#elif (QW_NODEPOOL_STATS != 0) && (QW_NODEPOOL_STATS != 1)
+
+    #if defined(__GNUC__) || defined(__clang__)
+        #warning "QW_NODEPOOL_STATS was defined but not 0 or 1. defaulting to 1."
+    #else
+        #pragma message "warning: QW_NODEPOOL_STATS was defined but not 0 or 1. defaulting to 1."
+    #endif
+
+    // If QW_NODEPOOL_STATS is defined, but is neither 0 nor 1, set it to 1
+    #undef QW_NODEPOOL_STATS
+    #define QW_NODEPOOL_STATS 1
+
+#endif
+
+
+// QW_NODEPOOL_ELIMINATION enables an elimination-backoff array in
+// QwRawNodePool. When allocate() or deallocate() loses a CAS race on the
+// freelist top, it tries to exchange a node directly with a concurrent
+// deallocate() or allocate() before retrying the freelist. Uncontended
+// operations are unaffected. See QwRawNodePool.
+//
+// To explicitly enable/disable define QW_NODEPOOL_ELIMINATION to 0 or 1
+// with a compiler -D flag, otherwise elimination is disabled (0).
+
+#ifndef QW_NODEPOOL_ELIMINATION
+
+    #define QW_NODEPOOL_ELIMINATION 0
+
+#elif (QW_NODEPOOL_ELIMINATION != 0) && (QW_NODEPOOL_ELIMINATION != 1)
+
+    #if defined(__GNUC__) || defined(__clang__)
+        #warning "QW_NODEPOOL_ELIMINATION was defined but not 0 or 1. defaulting to 1."
+    #else
+        #pragma message "warning: QW_NODEPOOL_ELIMINATION was defined but not 0 or 1. defaulting to 1."
+    #endif
+
+    // If QW_NODEPOOL_ELIMINATION is defined, but is neither 0 nor 1, set it to 1
+    #undef QW_NODEPOOL_ELIMINATION
+    #define QW_NODEPOOL_ELIMINATION 1
+
+#endif
+
 #endif /* INCLUDED_QWCONFIG_H */
 
 /* -----------------------------------------------------------------------
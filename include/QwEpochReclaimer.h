@@ -0,0 +1,303 @@
+/*
+    Queue World is copyright (c) 2014-2018 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#ifndef INCLUDED_QWEPOCHRECLAIMER_H
+#define INCLUDED_QWEPOCHRECLAIMER_H
+
+#include <atomic>
+#include <cassert>
+#include <cstddef> // size_t
+#include <cstdint>
+
+#include "QwConfig.h"
+#include "QwSList.h"
+
+// Test hook, called by enter() between reading and publishing the global
+// epoch, so that tests can simulate a thread being descheduled there.
+#ifndef QW_EPOCHRECLAIMER_ENTER_PREEMPTION_POINT
+#define QW_EPOCHRECLAIMER_ENTER_PREEMPTION_POINT()
+#endif
+
+/*
+    QwEpochReclaimer provides epoch-based memory reclamation (EBR) for nodes
+    that are unlinked from lock-free data structures while other threads may
+    still be reading them. With EBR, nodes need not be type-stable in a
+    QwNodePool: they can be returned to any allocator once no thread can
+    hold a reference. See ALGORITHMS.txt
+
+    Usage: each thread that accesses the protected structure registers once
+    to obtain a thread index. Every operation that reads shared nodes is
+    bracketed by a critical section (enter()/exit(), or a Guard). A node
+    that has been unlinked from the structure is passed to retire() (inside
+    the critical section) instead of being freed. Some time later, when
+    every thread that was in a critical section at the time of retirement
+    has left it, the node is passed to the reclaim function.
+
+        QwEpochReclaimer<Node*, Node::LINK_INDEX> reclaimer(maxThreads, reclaimFn, context);
+        size_t t = reclaimer.register_thread();
+        {
+            QwEpochReclaimer<Node*, Node::LINK_INDEX>::Guard guard(reclaimer, t);
+            Node *n = ... unlink n from the structure ...
+            reclaimer.retire(t, n);
+        }
+        reclaimer.unregister_thread(t);
+
+    Algorithm: there is a global epoch counter. On entering a critical
+    section, a thread publishes the global epoch it observed, then re-reads
+    the global epoch, and publishes again until the two agree. (A thread
+    that was descheduled between reading the global epoch and publishing
+    it may otherwise publish an epoch that is arbitrarily far behind, and
+    tag its retirements with it.) The global epoch can only advance from e
+    to e+1 when every thread that is in a critical section has published
+    e. Once a thread has published e and seen that it is still current, the
+    global epoch can't pass e+1 until the thread exits. So nodes retired in
+    epoch e can't be referenced once the global epoch reaches e+2. Here
+    nodes are reclaimed at e+3, which leaves a margin of one epoch.
+
+    Limbo lists: each thread keeps three private QwSLists of retired
+    nodes, one per epoch modulo 3, linked through NEXT_LINK_INDEX. (Retired
+    nodes are no longer in the structure, so the link is free.) Retiring a
+    node is a push_front() on a private list. Every RETIRE_BATCH_SIZE
+    retirements, the thread tries to advance the global epoch (a scan of
+    the thread records and a CAS). Limbo lists are reclaimed a whole list
+    at a time, when the owning thread enters a critical section and
+    observes that the list's epoch is old enough. So the cost is amortized
+    over many operations.
+
+    Real-time safety: enter(), exit() and retire() never block or allocate.
+    A thread that stalls inside a critical section prevents the epoch from
+    advancing, which delays reclamation (memory grows) but never blocks
+    other threads. The reclaim function is called on the thread that
+    entered the critical section, so it must be real-time safe if that
+    thread is, e.g. QwNodePool::deallocate_list(). register_thread(),
+    unregister_thread() and the destructor are not real-time safe.
+
+    When a thread unregisters, its limbo lists stay with its thread record,
+    and are reclaimed by the next thread to reuse the record, or by the
+    destructor.
+*/
+
+template<typename NodePtrT, int NEXT_LINK_INDEX>
+class QwEpochReclaimer {
+public:
+    typedef QwSList<NodePtrT, NEXT_LINK_INDEX> list_type;
+
+    // Called with a list of nodes that are safe to free. Must leave nodes empty.
+    typedef void (*reclaim_fn)(list_type& nodes, void *context);
+
+    enum { RETIRE_BATCH_SIZE = 64 }; // retirements between attempts to advance the global epoch
+
+private:
+    typedef std::uint64_t epoch_type;
+    static const epoch_type ACTIVE_BIT = static_cast<epoch_type>(1) << 63; // set in a published epoch while in a critical section
+
+    // Published state, read by other threads when advancing the epoch. One per cache line.
+    struct SharedRecord {
+        std::atomic<epoch_type> epoch;  // observed global epoch | ACTIVE_BIT, or 0 when not in a critical section
+        std::atomic<bool> inUse;        // thread record is registered
+        std::int8_t padding[CACHE_LINE_SIZE - sizeof(std::atomic<epoch_type>) - sizeof(std::atomic<bool>)];
+    };
+
+    // Thread-private state
+    struct LocalRecord {
+        list_type limbo[3];             // retired nodes, indexed by epoch % 3
+        epoch_type limboEpoch[3];       // epoch in which the nodes in limbo[i] were retired
+        epoch_type epoch;               // epoch observed by the current critical section
+        std::size_t retireCount;        // retirements since the last attempt to advance the epoch
+    };
+
+    struct PaddedLocalRecord : LocalRecord {
+        std::int8_t padding[CACHE_LINE_SIZE - sizeof(LocalRecord) % CACHE_LINE_SIZE];
+    };
+
+    std::int8_t padding1_[CACHE_LINE_SIZE]; // avoid false sharing
+    std::atomic<epoch_type> globalEpoch_;
+    std::int8_t padding2_[CACHE_LINE_SIZE]; // avoid false sharing
+
+    std::size_t maxThreads_;
+    SharedRecord *sharedRecords_;
+    PaddedLocalRecord *localRecords_;
+    reclaim_fn reclaim_;
+    void *reclaimContext_;
+
+    QwEpochReclaimer(const QwEpochReclaimer&) = delete;
+    QwEpochReclaimer& operator=(const QwEpochReclaimer&) = delete;
+
+    void reclaim_limbo(LocalRecord& local, int i)
+    {
+        if (!local.limbo[i].empty()) {
+            reclaim_(local.limbo[i], reclaimContext_);
+            assert(local.limbo[i].empty());
+        }
+    }
+
+    // Reclaim the limbo lists that were retired at least 3 epochs before epoch
+    void reclaim_expired(LocalRecord& local, epoch_type epoch)
+    {
+        for (int i=0; i < 3; ++i) {
+            if (local.limboEpoch[i] + 3 <= epoch)
+                reclaim_limbo(local, i);
+        }
+    }
+
+public:
+    // Supports up to maxThreads concurrently registered threads.
+    QwEpochReclaimer(std::size_t maxThreads, reclaim_fn reclaim, void *context)
+        : globalEpoch_(3) // (so that the initial limbo epochs of 0 are expired)
+        , maxThreads_(maxThreads)
+        , reclaim_(reclaim)
+        , reclaimContext_(context)
+    {
+        assert(maxThreads > 0);
+        sharedRecords_ = new SharedRecord[maxThreads];
+        localRecords_ = new PaddedLocalRecord[maxThreads];
+        for (std::size_t i=0; i < maxThreads; ++i) {
+            sharedRecords_[i].epoch.store(0, std::memory_order_relaxed);
+            sharedRecords_[i].inUse.store(false, std::memory_order_relaxed);
+            LocalRecord& local = localRecords_[i];
+            for (int j=0; j < 3; ++j)
+                local.limboEpoch[j] = 0;
+            local.epoch = 0;
+            local.retireCount = 0;
+        }
+    }
+
+    // Reclaims all retired nodes. No thread may be in a critical section.
+    ~QwEpochReclaimer()
+    {
+        for (std::size_t i=0; i < maxThreads_; ++i) {
+            assert(sharedRecords_[i].epoch.load(std::memory_order_relaxed) == 0);
+            for (int j=0; j < 3; ++j)
+                reclaim_limbo(localRecords_[i], j);
+        }
+        delete [] localRecords_;
+        delete [] sharedRecords_;
+    }
+
+    std::size_t max_threads() const { return maxThreads_; }
+
+    // Returns a thread index in [0, max_threads()), or max_threads() if all are in use.
+    std::size_t register_thread()
+    {
+        for (std::size_t i=0; i < maxThreads_; ++i) {
+            bool expected = false;
+            if (!sharedRecords_[i].inUse.load(std::memory_order_relaxed)
+                    && sharedRecords_[i].inUse.compare_exchange_strong(expected, true, std::memory_order_acquire))
+                return i;
+        }
+        return maxThreads_;
+    }
+
+    void unregister_thread(std::size_t t)
+    {
+        assert(sharedRecords_[t].epoch.load(std::memory_order_relaxed) == 0); // not in a critical section
+        sharedRecords_[t].inUse.store(false, std::memory_order_release); // (release: limbo lists pass to the next user)
+    }
+
+    // Enter a critical section. Shared nodes may only be read, and nodes
+    // retired, inside a critical section. Critical sections don't nest.
+    void enter(std::size_t t)
+    {
+        SharedRecord& shared = sharedRecords_[t];
+        LocalRecord& local = localRecords_[t];
+        assert(shared.epoch.load(std::memory_order_relaxed) == 0); // critical sections don't nest
+
+        epoch_type epoch = globalEpoch_.load(std::memory_order_acquire); // (acquire: unlinks before the advance to epoch are visible)
+        QW_EPOCHRECLAIMER_ENTER_PREEMPTION_POINT();
+        for (;;) {
+            shared.epoch.store(epoch | ACTIVE_BIT, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst); // publish before reading any shared nodes. pairs with try_advance()
+
+            // Re-check. If the epoch advanced before our publication was
+            // visible, we may have published a stale epoch. Retry. Once our
+            // publication is visible the epoch can advance at most once
+            // more, so this loop is bounded.
+            epoch_type current = globalEpoch_.load(std::memory_order_acquire);
+            if (current == epoch)
+                break;
+            epoch = current;
+        }
+
+        if (epoch != local.epoch) {
+            local.epoch = epoch;
+            reclaim_expired(local, epoch);
+        }
+    }
+
+    void exit(std::size_t t)
+    {
+        sharedRecords_[t].epoch.store(0, std::memory_order_release); // (release: reads of shared nodes happen before reclamation)
+    }
+
+    // RAII critical section
+    class Guard {
+        QwEpochReclaimer& reclaimer_;
+        std::size_t t_;
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+    public:
+        Guard(QwEpochReclaimer& reclaimer, std::size_t t)
+            : reclaimer_(reclaimer), t_(t) { reclaimer_.enter(t_); }
+        ~Guard() { reclaimer_.exit(t_); }
+    };
+
+    // Defer reclamation of node, which has been unlinked from the shared structure
+    // so that no new references to it can be obtained. Must be called inside a critical section.
+    void retire(std::size_t t, NodePtrT node)
+    {
+        LocalRecord& local = localRecords_[t];
+        assert(sharedRecords_[t].epoch.load(std::memory_order_relaxed) == (local.epoch | ACTIVE_BIT));
+
+        int i = static_cast<int>(local.epoch % 3);
+        if (local.limboEpoch[i] != local.epoch) {
+            reclaim_limbo(local, i); // retired at least 3 epochs ago
+            local.limboEpoch[i] = local.epoch;
+        }
+        local.limbo[i].push_front(node);
+
+        if (++local.retireCount >= RETIRE_BATCH_SIZE) {
+            local.retireCount = 0;
+            try_advance();
+        }
+    }
+
+    // Advance the global epoch if every thread in a critical section has observed it.
+    // Returns true if the epoch was advanced (by this or another thread).
+    // Called automatically by retire(). Can also be called periodically by a
+    // thread that retires few nodes, so that its limbo lists don't linger.
+    bool try_advance()
+    {
+        epoch_type epoch = globalEpoch_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst); // pairs with enter()
+        for (std::size_t i=0; i < maxThreads_; ++i) {
+            epoch_type e = sharedRecords_[i].epoch.load(std::memory_order_relaxed);
+            if ((e & ACTIVE_BIT) && (e & ~ACTIVE_BIT) != epoch)
+                return false; // thread i is in a critical section that began in an earlier epoch
+        }
+        std::atomic_thread_fence(std::memory_order_acquire); // exits happen before advancing
+        globalEpoch_.compare_exchange_strong(epoch, epoch + 1, std::memory_order_acq_rel, std::memory_order_relaxed);
+        return true; // (if the CAS failed, another thread advanced the epoch)
+    }
+
+    std::uint64_t epoch() const { return globalEpoch_.load(std::memory_order_relaxed); }
+};
+
+#endif /* INCLUDED_QWEPOCHRECLAIMER_H */
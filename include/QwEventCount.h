@@ -0,0 +1,260 @@
+/*
+    Queue World is copyright (c) 2014-2018 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#ifndef INCLUDED_QWEVENTCOUNT_H
+#define INCLUDED_QWEVENTCOUNT_H
+
+#include <algorithm> // min
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+
+#include "QwFutex.h"
+
+/*
+    QwEventCount lets threads block until a condition on a lock-free data
+    structure (e.g. "the queue is non-empty") may have become true,
+    without adding any synchronization to the data structure itself.
+
+    Waiter:
+
+        for (;;) {
+            if (condition()) break;
+            QwEventCount::key_type key = ec.prepare_wait();
+            if (condition()) { ec.cancel_wait(); break; }
+            ec.commit_wait(key);
+        }
+
+    Notifier: make the condition true (e.g. push a node), then call
+    notify_one() or notify_all().
+
+    wait() and wait_for() implement the waiter loop for a "try" operation
+    that returns a value convertible to bool, such as a queue's pop(). A
+    queue can attach an event count without changing its lock-free
+    operations: producers call notify_one() after push(), and the consumer
+    calls wait():
+
+        queue.push(n);
+        ec.notify_one();
+
+        node_ptr_type n = ec.wait([&]{ return queue.pop(); });
+
+    Before blocking, wait() and wait_for() retry the operation in a spin
+    loop. The number of spins adapts (after glibc's adaptive mutexes): the
+    estimate moves towards the number of retries that succeeded, and
+    halves when spinning fails, so a mostly-idle waiter stops burning CPU.
+    The spin count never exceeds maxSpinCount. Pass 0 to disable spinning.
+
+    prepare_wait() announces the waiter (increments waiterCount_) and reads
+    the sequence number. A notifier that sees waiters increments the
+    sequence number and wakes them with a futex. commit_wait() blocks
+    only while the sequence number still equals the key, so a notify
+    between prepare_wait() and commit_wait() is not lost.
+
+    The waiter's announcement and the notifier's check of waiterCount_ are
+    paired by seq_cst fences (like QwRawNodePool::allocate_wait()): a
+    notifier that sees no waiters made its change visible to any waiter
+    that checks the condition after prepare_wait(). So notifying costs a
+    fence and a load when nobody is waiting, and only makes a system call
+    when a thread has announced that it is about to block.
+
+    prepare_wait() must be followed by exactly one of commit_wait(),
+    commit_wait_for() or cancel_wait().
+
+    notify_one() and notify_all() never block, but make a system call if
+    there are waiters. Waiting is not real-time safe.
+
+    notify_one() wakes at most one blocked thread, but threads that are
+    between prepare_wait() and commit_wait() also return (they re-check
+    their condition). Wakeups may be spurious.
+*/
+
+class QwEventCount {
+    std::atomic<std::uint32_t> waiterCount_; // threads between prepare_wait() and the end of commit/cancel_wait()
+    std::atomic<std::uint32_t> sequence_; // futex word. incremented by notifications when there are waiters
+    std::atomic<int> spinEstimate_; // adaptive spin count. updated by waiters, races are benign
+    int maxSpinCount_;
+
+    QwEventCount(const QwEventCount&) = delete;
+    QwEventCount& operator=(const QwEventCount&) = delete;
+
+    bool has_waiters() const
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst); // order the caller's change before the waiterCount_ check. pairs with prepare_wait()
+        return (waiterCount_.load(std::memory_order_relaxed) != 0);
+    }
+
+    // Retry tryOp up to the adaptive spin limit. Returns true if it succeeded.
+    template<typename TryFn, typename ResultT>
+    bool spin(TryFn& tryOp, ResultT& result)
+    {
+        int estimate = spinEstimate_.load(std::memory_order_relaxed);
+        int limit = std::min(maxSpinCount_, estimate * 2 + 10);
+        for (int i=1; i <= limit; ++i) {
+            result = tryOp();
+            if (result) {
+                spinEstimate_.store(estimate + (i - estimate) / 8, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        if (limit > 0)
+            spinEstimate_.store(estimate / 2, std::memory_order_relaxed);
+        return false;
+    }
+
+public:
+    typedef std::uint32_t key_type;
+
+    enum { DEFAULT_MAX_SPIN_COUNT = 100 };
+
+    explicit QwEventCount(int maxSpinCount = DEFAULT_MAX_SPIN_COUNT)
+        : waiterCount_(0)
+        , sequence_(0)
+        , spinEstimate_(maxSpinCount / 2)
+        , maxSpinCount_(maxSpinCount)
+    {
+        assert(maxSpinCount >= 0);
+    }
+
+    ~QwEventCount()
+    {
+        assert(waiterCount_.load(std::memory_order_relaxed) == 0);
+    }
+
+    // waiter operations -----------------------------------------------------
+
+    // Announce that the calling thread is about to wait. Re-check the
+    // condition after calling this, then call commit_wait() or cancel_wait().
+    key_type prepare_wait()
+    {
+        waiterCount_.fetch_add(1, std::memory_order_seq_cst);
+        key_type key = sequence_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst); // order the announcement before the caller's re-check. pairs with notify_all()
+        return key;
+    }
+
+    // The condition became true after prepare_wait(). Don't wait.
+    void cancel_wait()
+    {
+        waiterCount_.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    // Block until notified after prepare_wait() returned key. May return spuriously.
+    void commit_wait(key_type key)
+    {
+        if (sequence_.load(std::memory_order_acquire) == key)
+            qw_futex_wait(&sequence_, key);
+        waiterCount_.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    // As commit_wait(), but gives up after timeout. Returns false if the timeout elapsed.
+    bool commit_wait_for(key_type key, std::chrono::nanoseconds timeout)
+    {
+        bool result = true;
+        if (sequence_.load(std::memory_order_acquire) == key)
+            result = qw_futex_wait_for(&sequence_, key, timeout);
+        waiterCount_.fetch_sub(1, std::memory_order_relaxed);
+        return result;
+    }
+
+    // Spin, then block, until tryOp() returns a value that converts to true.
+    // Returns that value.
+    template<typename TryFn>
+    auto wait(TryFn tryOp) -> decltype(tryOp())
+    {
+        decltype(tryOp()) result = tryOp();
+        if (result || spin(tryOp, result))
+            return result;
+
+        for (;;) {
+            key_type key = prepare_wait();
+            result = tryOp(); // re-check after announcing that we are about to block
+            if (result) {
+                cancel_wait();
+                return result;
+            }
+            commit_wait(key);
+        }
+    }
+
+    // As wait(), but gives up after timeout. Returns the result of the
+    // last call to tryOp(), which converts to false if the timeout elapsed.
+    template<typename TryFn>
+    auto wait_for(TryFn tryOp, std::chrono::nanoseconds timeout) -> decltype(tryOp())
+    {
+        decltype(tryOp()) result = tryOp();
+        if (result)
+            return result;
+
+        const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + timeout;
+        if (spin(tryOp, result))
+            return result;
+
+        for (;;) {
+            key_type key = prepare_wait();
+            result = tryOp();
+            if (result) {
+                cancel_wait();
+                return result;
+            }
+
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            if (now >= deadline) {
+                cancel_wait();
+                return result;
+            }
+            commit_wait_for(key, deadline - now);
+        }
+    }
+
+    // Not thread-safe. Call before threads wait.
+    void set_max_spin_count(int maxSpinCount)
+    {
+        assert(maxSpinCount >= 0);
+        maxSpinCount_ = maxSpinCount;
+        spinEstimate_.store(maxSpinCount / 2, std::memory_order_relaxed);
+    }
+
+    int max_spin_count() const { return maxSpinCount_; }
+
+    // notifier operations ---------------------------------------------------
+
+    // Wake one waiter. Call after making the condition true.
+    void notify_one()
+    {
+        if (has_waiters()) {
+            sequence_.fetch_add(1, std::memory_order_release); // (release: the change is visible to woken waiters)
+            qw_futex_wake_one(&sequence_);
+        }
+    }
+
+    // Wake all waiters. Call after making the condition true.
+    void notify_all()
+    {
+        if (has_waiters()) {
+            sequence_.fetch_add(1, std::memory_order_release);
+            qw_futex_wake_all(&sequence_);
+        }
+    }
+};
+
+#endif /* INCLUDED_QWEVENTCOUNT_H */
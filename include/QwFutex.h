@@ -0,0 +1,55 @@
+/*
+    Queue World is copyright (c) 2014-2018 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#ifndef INCLUDED_QWFUTEX_H
+#define INCLUDED_QWFUTEX_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+/*
+    Minimal futex-style wait/wake on a 32-bit atomic word, used to park
+    threads that block on Queue World data structures (e.g.
+    QwRawNodePool::allocate_wait()).
+
+    Linux uses the futex syscall (process-private), Windows uses
+    WaitOnAddress (Windows 8 or later). Elsewhere, waiting falls back to
+    sleeping in short intervals until the word changes or time runs out.
+
+    Waits may return spuriously. Callers re-check their condition.
+
+    Waking makes a system call, so callers should only wake when they know
+    that a thread may be waiting. Waiting is not real-time safe.
+*/
+
+// Block while *word == expected, until woken or until timeout has elapsed.
+// Returns false if the timeout elapsed.
+bool qw_futex_wait_for(std::atomic<std::uint32_t> *word, std::uint32_t expected, std::chrono::nanoseconds timeout);
+
+// Block while *word == expected, until woken.
+void qw_futex_wait(std::atomic<std::uint32_t> *word, std::uint32_t expected);
+
+// Wake one/all threads blocked on word.
+void qw_futex_wake_one(std::atomic<std::uint32_t> *word);
+void qw_futex_wake_all(std::atomic<std::uint32_t> *word);
+
+#endif /* INCLUDED_QWFUTEX_H */
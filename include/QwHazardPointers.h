@@ -0,0 +1,266 @@
+/*
+    Queue World is copyright (c) 2014-2018 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#ifndef INCLUDED_QWHAZARDPOINTERS_H
+#define INCLUDED_QWHAZARDPOINTERS_H
+
+#include <algorithm> // sort, binary_search
+#include <atomic>
+#include <cassert>
+#include <cstddef> // size_t
+#include <cstdint>
+#include <functional> // less
+
+#include "QwConfig.h"
+#include "QwSList.h"
+
+/*
+    QwHazardPointerDomain provides hazard pointer memory reclamation for
+    nodes that are unlinked from lock-free data structures while other
+    threads may still be reading them. It is an alternative to
+    QwEpochReclaimer with bounded garbage: a thread that is descheduled
+    while reading can only hold back the nodes that its hazard pointers
+    reference, not everything retired since. See ALGORITHMS.txt
+
+    Each registered thread owns HAZARDS_PER_THREAD hazard pointer slots.
+    Before dereferencing a node loaded from a shared link, a thread
+    publishes the node in a slot using protect(), which re-reads the link
+    to confirm that the node was still reachable after publication. The
+    slot is cleared when the reference is no longer needed.
+
+        QwHazardPointerDomain<Node*, Node::LINK_INDEX> domain(maxThreads, reclaimFn, context);
+        size_t t = domain.register_thread();
+        Node *n = domain.protect(t, 0, sharedLink); // n is safe to read until slot 0 is changed
+        ... unlink n from the structure ...
+        domain.clear(t, 0);
+        domain.retire(t, n);
+        domain.unregister_thread(t);
+
+    Retired nodes are kept on a private QwSList, linked through
+    NEXT_LINK_INDEX. When the list reaches scan_threshold() nodes, the
+    retiring thread scans: it snapshots every hazard pointer into a
+    preallocated array, sorts it, and passes all retired nodes that are
+    not hazardous to the reclaim function in a single list. The
+    threshold is proportional to the total number of hazard pointers, so
+    each scan frees at least half of the thread's retired nodes, and the
+    scan cost is amortized over retire() calls. At most scan_threshold()
+    nodes per thread are unreclaimed at any time.
+
+    Real-time safety: protect(), clear() and retire() (including scans)
+    never block or allocate. A scan takes O(H log H) time in the total
+    number of hazard pointers H. The reclaim function is called by the
+    retiring thread, so it must be real-time safe if that thread is.
+    register_thread(), unregister_thread() and the destructor are not
+    real-time safe.
+
+    As with QwEpochReclaimer, retired nodes of an unregistered thread stay
+    with its thread record until the record is reused or the domain is
+    destroyed.
+*/
+
+template<typename NodePtrT, int NEXT_LINK_INDEX, int HAZARDS_PER_THREAD=2>
+class QwHazardPointerDomain {
+public:
+    typedef QwSList<NodePtrT, NEXT_LINK_INDEX> list_type;
+
+    // Called with a list of nodes that are safe to free. Must leave nodes empty.
+    typedef void (*reclaim_fn)(list_type& nodes, void *context);
+
+private:
+    typedef const void *hazard_type;
+
+    // Published hazard pointers, read by scanning threads. Padded to a cache line.
+    struct SharedRecord {
+        std::atomic<hazard_type> hazards[HAZARDS_PER_THREAD];
+        std::atomic<bool> inUse;        // thread record is registered
+    };
+
+    struct PaddedSharedRecord : SharedRecord {
+        std::int8_t padding[CACHE_LINE_SIZE - sizeof(SharedRecord) % CACHE_LINE_SIZE];
+    };
+
+    // Thread-private state
+    struct LocalRecord {
+        list_type retired;
+        std::size_t retiredCount;
+        hazard_type *scanHazards;       // scratch space for scan(). total_hazards() entries
+    };
+
+    struct PaddedLocalRecord : LocalRecord {
+        std::int8_t padding[CACHE_LINE_SIZE - sizeof(LocalRecord) % CACHE_LINE_SIZE];
+    };
+
+    std::size_t maxThreads_;
+    std::size_t scanThreshold_;
+    PaddedSharedRecord *sharedRecords_;
+    PaddedLocalRecord *localRecords_;
+    reclaim_fn reclaim_;
+    void *reclaimContext_;
+
+    QwHazardPointerDomain(const QwHazardPointerDomain&) = delete;
+    QwHazardPointerDomain& operator=(const QwHazardPointerDomain&) = delete;
+
+    std::size_t total_hazards() const { return maxThreads_ * HAZARDS_PER_THREAD; }
+
+public:
+    // Supports up to maxThreads concurrently registered threads.
+    QwHazardPointerDomain(std::size_t maxThreads, reclaim_fn reclaim, void *context)
+        : maxThreads_(maxThreads)
+        , scanThreshold_(std::max<std::size_t>(2 * maxThreads * HAZARDS_PER_THREAD, 16))
+        , reclaim_(reclaim)
+        , reclaimContext_(context)
+    {
+        assert(maxThreads > 0);
+        sharedRecords_ = new PaddedSharedRecord[maxThreads];
+        localRecords_ = new PaddedLocalRecord[maxThreads];
+        for (std::size_t i=0; i < maxThreads; ++i) {
+            for (int j=0; j < HAZARDS_PER_THREAD; ++j)
+                sharedRecords_[i].hazards[j].store(nullptr, std::memory_order_relaxed);
+            sharedRecords_[i].inUse.store(false, std::memory_order_relaxed);
+            localRecords_[i].retiredCount = 0;
+            localRecords_[i].scanHazards = new hazard_type[total_hazards()];
+        }
+    }
+
+    // Reclaims all retired nodes. No thread may hold hazard pointers.
+    ~QwHazardPointerDomain()
+    {
+        for (std::size_t i=0; i < maxThreads_; ++i) {
+            LocalRecord& local = localRecords_[i];
+            if (!local.retired.empty()) {
+                reclaim_(local.retired, reclaimContext_);
+                assert(local.retired.empty());
+            }
+            delete [] local.scanHazards;
+        }
+        delete [] localRecords_;
+        delete [] sharedRecords_;
+    }
+
+    std::size_t max_threads() const { return maxThreads_; }
+
+    // Number of retired nodes at which retire() scans. Also the maximum
+    // number of unreclaimed nodes retired by one thread.
+    std::size_t scan_threshold() const { return scanThreshold_; }
+
+    // Returns a thread index in [0, max_threads()), or max_threads() if all are in use.
+    std::size_t register_thread()
+    {
+        for (std::size_t i=0; i < maxThreads_; ++i) {
+            bool expected = false;
+            if (!sharedRecords_[i].inUse.load(std::memory_order_relaxed)
+                    && sharedRecords_[i].inUse.compare_exchange_strong(expected, true, std::memory_order_acquire))
+                return i;
+        }
+        return maxThreads_;
+    }
+
+    void unregister_thread(std::size_t t)
+    {
+        clear_all(t);
+        sharedRecords_[t].inUse.store(false, std::memory_order_release); // (release: retired list passes to the next user)
+    }
+
+    // Load a node pointer from link and protect it with hazard pointer slot i.
+    // The result (if not nullptr) can be dereferenced until slot i is changed.
+    NodePtrT protect(std::size_t t, int i, const std::atomic<NodePtrT>& link)
+    {
+        std::atomic<hazard_type>& hazard = sharedRecords_[t].hazards[i];
+        NodePtrT p = link.load(std::memory_order_relaxed);
+        for (;;) {
+            hazard.store(p, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst); // publish before re-reading. pairs with scan()
+            NodePtrT q = link.load(std::memory_order_acquire);
+            if (q == p)
+                return p;
+            p = q; // link changed. p may already be retired, so try again
+        }
+    }
+
+    // Publish p in slot i. Only safe if p is known to be reachable (e.g. it is protected by another slot).
+    void set(std::size_t t, int i, NodePtrT p)
+    {
+        sharedRecords_[t].hazards[i].store(p, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    void clear(std::size_t t, int i)
+    {
+        sharedRecords_[t].hazards[i].store(nullptr, std::memory_order_release); // (release: reads happen before reclamation)
+    }
+
+    void clear_all(std::size_t t)
+    {
+        for (int i=0; i < HAZARDS_PER_THREAD; ++i)
+            clear(t, i);
+    }
+
+    // Defer reclamation of node, which has been unlinked from the shared structure
+    // so that no new references to it can be obtained.
+    void retire(std::size_t t, NodePtrT node)
+    {
+        LocalRecord& local = localRecords_[t];
+        local.retired.push_front(node);
+        if (++local.retiredCount >= scanThreshold_)
+            scan(t);
+    }
+
+    // Reclaim all of thread t's retired nodes that are not protected by a hazard pointer.
+    // Called automatically by retire().
+    void scan(std::size_t t)
+    {
+        LocalRecord& local = localRecords_[t];
+
+        std::atomic_thread_fence(std::memory_order_seq_cst); // unlinks happen before reading hazards. pairs with protect()
+        std::size_t hazardCount = 0;
+        for (std::size_t i=0; i < maxThreads_; ++i) {
+            for (int j=0; j < HAZARDS_PER_THREAD; ++j) {
+                hazard_type h = sharedRecords_[i].hazards[j].load(std::memory_order_relaxed);
+                if (h)
+                    local.scanHazards[hazardCount++] = h;
+            }
+        }
+        std::atomic_thread_fence(std::memory_order_acquire); // hazard clears happen before reclamation
+        hazard_type *hazardsEnd = local.scanHazards + hazardCount;
+        std::sort(local.scanHazards, hazardsEnd, std::less<hazard_type>());
+
+        list_type keep, reclaim;
+        std::size_t keepCount = 0;
+        while (!local.retired.empty()) {
+            NodePtrT n = local.retired.pop_front();
+            if (std::binary_search(local.scanHazards, hazardsEnd, static_cast<hazard_type>(n), std::less<hazard_type>())) {
+                keep.push_front(n);
+                ++keepCount;
+            } else {
+                reclaim.push_front(n);
+            }
+        }
+        local.retired.swap(keep);
+        local.retiredCount = keepCount;
+
+        if (!reclaim.empty()) {
+            reclaim_(reclaim, reclaimContext_);
+            assert(reclaim.empty());
+        }
+    }
+};
+
+#endif /* INCLUDED_QWHAZARDPOINTERS_H */
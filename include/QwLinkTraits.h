@@ -38,7 +38,8 @@
     of QwLinkTraits thus provides access to a single link field of a particular
     node type using QwLinkTraits::load() and QwLinkTraits::store() functions.
     If the link supports atomic operations, QwLinkTraits::is_atomic == true
-    and QwLinkTraits also provides atomic_load() and atomic_store() functions.
+    and QwLinkTraits also provides atomic_load(), atomic_store() and
+    atomic_compare_exchange_strong() functions.
 
     The default implementation of QwLinkTraits requires that the Node type has
     a publicly accessible array of link pointers named `links_`.
@@ -160,6 +161,16 @@ struct QwDefaultAtomicLinkTraitsImpl {
         n->links_[LINK_INDEX].store(x, order);
     }
 
+    // n->link: if (link == expected) link = desired; else expected = link
+    static bool atomic_compare_exchange_strong(node_ptr_type n, node_ptr_type& expected, node_ptr_type desired,
+            std::memory_order success, std::memory_order failure)
+    {
+        decltype(n->links_[LINK_INDEX].load()) e = expected;
+        bool result = n->links_[LINK_INDEX].compare_exchange_strong(e, desired, success, failure);
+        expected = static_cast<node_ptr_type>(e); // downcast, as in atomic_load()
+        return result;
+    }
+
     // non-atomic accessors
 
     // IMPORTANT: if is_atomic == true, then all link accesses must be atomic,
@@ -0,0 +1,214 @@
+/*
+    Queue World is copyright (c) 2014-2018 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#ifndef INCLUDED_QWMPMCBOUNDEDQUEUE_H
+#define INCLUDED_QWMPMCBOUNDEDQUEUE_H
+
+#include <atomic>
+#include <cassert>
+#include <cstddef> // size_t
+#include <cstdint>
+#include <utility> // move
+
+#include "QwConfig.h"
+
+/*
+    QwMpmcBoundedQueue<T> is a lock-free, bounded, multiple-producer
+    multiple-consumer FIFO queue of values of type T, stored in a
+    preallocated ring buffer.
+
+    Producer operations: try_push(), try_push_n()
+    Consumer operations: try_pop(), try_pop_n()
+
+    All operations may be invoked concurrently.
+
+    Unlike the other Queue World queues, QwMpmcBoundedQueue is not
+    intrusive: values are copied into and out of the ring. This suits small
+    value-type messages (e.g. 16-32 byte POD events), which are cheaper to
+    copy than to allocate from a pool and link through links_. T must be
+    default constructible and copy (or move) assignable.
+
+    Implemented using Dmitry Vyukov's bounded MPMC queue.
+    See ALGORITHMS.txt
+
+    Each slot carries a sequence number, which tells a thread at position
+    pos whether the slot is ready for it: seq == pos means free for the
+    producer at pos, seq == pos + 1 means filled for the consumer at pos.
+    A producer claims a position by CAS-ing the enqueue position, writes
+    the value, then publishes it by storing seq = pos + 1. A consumer
+    claims by CAS-ing the dequeue position, reads the value, then frees the
+    slot for the next lap by storing seq = pos + capacity. Producers and
+    consumers only contend among themselves, on separate cache lines.
+
+    try_push_n() and try_pop_n() claim a run of consecutive ready slots
+    with a single CAS, and transfer as many values as are available (up to
+    the requested count).
+
+    Real-time safety: the constructor allocates the ring. All other
+    operations never block or allocate. A producer or consumer that is
+    preempted between claiming a slot and publishing it delays (but does
+    not block) threads operating on that slot's next lap.
+
+    The capacity is rounded up to a power of two.
+*/
+
+template<typename T>
+class QwMpmcBoundedQueue {
+    struct Slot {
+        std::atomic<std::size_t> sequence;
+        T value;
+    };
+
+    std::int8_t padding1_[CACHE_LINE_SIZE]; // avoid false sharing
+    Slot *const slots_;
+    const std::size_t mask_;
+    std::int8_t padding2_[CACHE_LINE_SIZE]; // avoid false sharing
+    std::atomic<std::size_t> enqueuePos_;
+    std::int8_t padding3_[CACHE_LINE_SIZE]; // avoid false sharing
+    std::atomic<std::size_t> dequeuePos_;
+    std::int8_t padding4_[CACHE_LINE_SIZE]; // avoid false sharing
+
+    QwMpmcBoundedQueue(const QwMpmcBoundedQueue&) = delete;
+    QwMpmcBoundedQueue& operator=(const QwMpmcBoundedQueue&) = delete;
+
+    static std::size_t round_up_to_power_of_two(std::size_t x)
+    {
+        std::size_t result = 2;
+        while (result < x)
+            result <<= 1;
+        return result;
+    }
+
+    static std::ptrdiff_t difference(std::size_t a, std::size_t b)
+    {
+        return static_cast<std::ptrdiff_t>(a - b); // (positions wrap)
+    }
+
+    // Claim up to maxCount consecutive slots, starting at the position in
+    // pos_, whose sequence equals the position plus offset. Returns the
+    // number claimed; the first claimed position is returned in pos.
+    std::size_t claim(std::atomic<std::size_t>& pos_, std::size_t offset, std::size_t maxCount, std::size_t& pos)
+    {
+        pos = pos_.load(std::memory_order_relaxed);
+        for (;;) {
+            std::size_t seq = slots_[pos & mask_].sequence.load(std::memory_order_acquire);
+            std::ptrdiff_t diff = difference(seq, pos + offset);
+            if (diff == 0) {
+                // the first slot is ready. extend the run over subsequent ready slots
+                std::size_t count = 1;
+                while (count < maxCount && count <= mask_
+                        && slots_[(pos + count) & mask_].sequence.load(std::memory_order_acquire) == pos + count + offset)
+                    ++count;
+
+                if (pos_.compare_exchange_weak(pos, pos + count, std::memory_order_relaxed, std::memory_order_relaxed))
+                    return count;
+                // (pos was updated by the failed CAS)
+            } else if (diff < 0) {
+                return 0; // full (producer) or empty (consumer)
+            } else {
+                pos = pos_.load(std::memory_order_relaxed); // another thread claimed pos
+            }
+        }
+    }
+
+public:
+    explicit QwMpmcBoundedQueue(std::size_t capacity)
+        : slots_(new Slot[round_up_to_power_of_two(capacity)])
+        , mask_(round_up_to_power_of_two(capacity) - 1)
+        , enqueuePos_(0)
+        , dequeuePos_(0)
+    {
+        for (std::size_t i=0; i <= mask_; ++i)
+            slots_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    ~QwMpmcBoundedQueue()
+    {
+        delete [] slots_;
+    }
+
+    std::size_t capacity() const { return mask_ + 1; }
+
+    // Returns false if the queue is full
+    bool try_push(const T& value)
+    {
+        std::size_t pos;
+        if (claim(enqueuePos_, 0, 1, pos) == 0)
+            return false;
+        Slot& slot = slots_[pos & mask_];
+        slot.value = value;
+        slot.sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Returns false if the queue is empty
+    bool try_pop(T& result)
+    {
+        std::size_t pos;
+        if (claim(dequeuePos_, 1, 1, pos) == 0)
+            return false;
+        Slot& slot = slots_[pos & mask_];
+        result = std::move(slot.value);
+        slot.sequence.store(pos + mask_ + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Push values[0..count) in order, or as many as there is room for.
+    // Returns the number pushed.
+    std::size_t try_push_n(const T *values, std::size_t count)
+    {
+        std::size_t pushed = 0;
+        while (pushed < count) {
+            std::size_t pos;
+            std::size_t n = claim(enqueuePos_, 0, count - pushed, pos);
+            if (n == 0)
+                break;
+            for (std::size_t i=0; i < n; ++i) {
+                Slot& slot = slots_[(pos + i) & mask_];
+                slot.value = values[pushed + i];
+                slot.sequence.store(pos + i + 1, std::memory_order_release);
+            }
+            pushed += n;
+        }
+        return pushed;
+    }
+
+    // Pop up to count values into result[0..count). Returns the number popped.
+    std::size_t try_pop_n(T *result, std::size_t count)
+    {
+        std::size_t popped = 0;
+        while (popped < count) {
+            std::size_t pos;
+            std::size_t n = claim(dequeuePos_, 1, count - popped, pos);
+            if (n == 0)
+                break;
+            for (std::size_t i=0; i < n; ++i) {
+                Slot& slot = slots_[(pos + i) & mask_];
+                result[popped + i] = std::move(slot.value);
+                slot.sequence.store(pos + i + mask_ + 1, std::memory_order_release);
+            }
+            popped += n;
+        }
+        return popped;
+    }
+};
+
+#endif /* INCLUDED_QWMPMCBOUNDEDQUEUE_H */
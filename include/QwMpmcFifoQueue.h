@@ -0,0 +1,207 @@
+/*
+    Queue World is copyright (c) 2014-2018 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#ifndef INCLUDED_QWMPMCFIFOQUEUE_H
+#define INCLUDED_QWMPMCFIFOQUEUE_H
+
+#include <atomic>
+#include <cassert>
+#include <cstddef> // size_t
+#include <cstdint>
+
+#include "QwConfig.h"
+#include "QwEpochReclaimer.h"
+#include "QwLinkTraits.h"
+
+/*
+    QwMpmcFifoQueue is a lock-free concurrent, multiple-producer
+    multiple-consumer FIFO queue.
+
+    Producer operations: push()
+    Consumer operations: pop()
+
+    All operations may be invoked concurrently.
+
+    Implemented using the Michael-Scott queue algorithm.
+    See ALGORITHMS.txt
+
+    The queue always contains a dummy node at the head. pop() unlinks the
+    current dummy and returns the node after it, which becomes the new
+    dummy. Hence, with intrusive links:
+
+      - The node returned by pop() is still referenced by the queue. The
+        caller may read and write its payload, but must not push, free or
+        relink it. It is disposed of later, via the reclaimer.
+
+      - The previous dummy is passed to QwEpochReclaimer::retire() rather
+        than being returned, since other threads may still be reading its
+        next link. The reclaimer's reclaim function disposes of it (e.g.
+        QwNodePool::deallocate_list()). The reclaimer must therefore link
+        retired nodes through a different link (RECLAIM_LINK_INDEX) from
+        the queue's NEXT_LINK_INDEX.
+
+      - The constructor takes an initial dummy node. After the queue is
+        destroyed, the client disposes of the final dummy, which is
+        returned by dummy_node().
+
+    Epoch-based reclamation also prevents the ABA problem on head_ and
+    tail_, so no version counters are needed: a node cannot be reused
+    while any thread that might have read a pointer to it is still inside
+    a critical section. (This relies on QwEpochReclaimer::enter()
+    publishing a current epoch, so that a retired dummy is not reclaimed
+    while a consumer that read it can still follow its next link.)
+
+    Usage: push() and pop() must be called inside an epoch critical
+    section of the calling thread (QwEpochReclaimer::enter()/exit() or a
+    Guard). The node returned by pop() is only guaranteed to remain valid
+    until the end of that critical section, so read what you need from it
+    before leaving.
+
+        QwEpochReclaimer<Node*, Node::RECLAIM_LINK> reclaimer(maxThreads, reclaimFn, context);
+        QwMpmcFifoQueue<Node*, Node::NEXT_LINK, Node::RECLAIM_LINK> queue(reclaimer, pool.allocate());
+        size_t t = reclaimer.register_thread();
+        {
+            QwEpochReclaimer<Node*, Node::RECLAIM_LINK>::Guard guard(reclaimer, t);
+            if (Node *n = queue.pop(t))
+                process(n->payload);
+        }
+
+    Nodes' NEXT_LINK_INDEX links must be declared as std::atomic, since
+    they are read and written concurrently.
+*/
+
+template<typename NodePtrT, int NEXT_LINK_INDEX, int RECLAIM_LINK_INDEX>
+class QwMpmcFifoQueue {
+    typedef QwLinkTraits<NodePtrT, NEXT_LINK_INDEX> nextlink;
+    static_assert(nextlink::is_atomic, "QwMpmcFifoQueue requires atomic next links");
+    static_assert(NEXT_LINK_INDEX != RECLAIM_LINK_INDEX, "retired nodes' next links may still be read, so the reclaimer must use a different link");
+
+public:
+    typedef typename nextlink::node_type node_type;
+    typedef typename nextlink::node_ptr_type node_ptr_type;
+    typedef typename nextlink::const_node_ptr_type const_node_ptr_type;
+
+    typedef QwEpochReclaimer<NodePtrT, RECLAIM_LINK_INDEX> reclaimer_type;
+
+private:
+    reclaimer_type& reclaimer_;
+
+    std::int8_t padding1_[CACHE_LINE_SIZE]; // avoid false sharing
+    std::atomic<node_ptr_type> head_; // dummy node. consumers CAS
+    std::int8_t padding2_[CACHE_LINE_SIZE]; // avoid false sharing
+    std::atomic<node_ptr_type> tail_; // last node, or lagging by one. producers CAS
+    std::int8_t padding3_[CACHE_LINE_SIZE]; // avoid false sharing
+
+    QwMpmcFifoQueue(const QwMpmcFifoQueue&) = delete;
+    QwMpmcFifoQueue& operator=(const QwMpmcFifoQueue&) = delete;
+
+public:
+    QwMpmcFifoQueue(reclaimer_type& reclaimer, node_ptr_type dummy)
+        : reclaimer_(reclaimer)
+    {
+        nextlink::atomic_store(dummy, nullptr, std::memory_order_relaxed);
+        head_.store(dummy, std::memory_order_relaxed);
+        tail_.store(dummy, std::memory_order_release);
+    }
+
+    // Requires: called inside a critical section of reclaimer()
+    void push(node_ptr_type node)
+    {
+        nextlink::atomic_store(node, nullptr, std::memory_order_relaxed);
+
+        for (;;) {
+            node_ptr_type tail = tail_.load(std::memory_order_acquire);
+            node_ptr_type next = nextlink::atomic_load(tail, std::memory_order_acquire);
+            if (tail != tail_.load(std::memory_order_acquire))
+                continue; // tail and next are inconsistent
+
+            if (next == nullptr) {
+                // try to link node at the end of the list.
+                // (release: node's payload and null link are visible to the thread that reads the link)
+                if (nextlink::atomic_compare_exchange_strong(tail, next, node,
+                        /*success:*/ std::memory_order_release,
+                        /*failure:*/ std::memory_order_relaxed)) {
+                    // linked. try to swing tail to node. if this fails, another thread already helped.
+                    tail_.compare_exchange_strong(tail, node,
+                            /*success:*/ std::memory_order_release,
+                            /*failure:*/ std::memory_order_relaxed);
+                    return;
+                }
+            } else {
+                // tail is lagging. help the other push by swinging tail to next
+                tail_.compare_exchange_strong(tail, next,
+                        /*success:*/ std::memory_order_release,
+                        /*failure:*/ std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Returns nullptr if the queue is empty. The returned node becomes
+    // the queue's dummy node (see above).
+    // Requires: called inside a critical section of reclaimer() by thread t
+    node_ptr_type pop(std::size_t t)
+    {
+        for (;;) {
+            node_ptr_type head = head_.load(std::memory_order_acquire);
+            node_ptr_type tail = tail_.load(std::memory_order_acquire);
+            node_ptr_type next = nextlink::atomic_load(head, std::memory_order_acquire);
+            if (head != head_.load(std::memory_order_acquire))
+                continue; // head, tail and next are inconsistent
+
+            if (head == tail) {
+                if (next == nullptr)
+                    return nullptr; // empty
+
+                // tail is lagging. help the push by swinging tail to next
+                tail_.compare_exchange_strong(tail, next,
+                        /*success:*/ std::memory_order_release,
+                        /*failure:*/ std::memory_order_relaxed);
+            } else {
+                if (head_.compare_exchange_strong(head, next,
+                        /*success:*/ std::memory_order_acq_rel,
+                        /*failure:*/ std::memory_order_relaxed)) {
+                    reclaimer_.retire(t, head); // the previous dummy
+                    return next;
+                }
+            }
+        }
+    }
+
+    // Approximate: may be stale by the time it returns
+    // Requires: called inside a critical section of reclaimer()
+    bool empty() const
+    {
+        node_ptr_type head = head_.load(std::memory_order_acquire);
+        return (nextlink::atomic_load(head, std::memory_order_acquire) == nullptr);
+    }
+
+    reclaimer_type& reclaimer() { return reclaimer_; }
+
+    // The current dummy node. The client disposes of this once the queue
+    // is no longer in use.
+    // Requires: no other thread is accessing the queue
+    node_ptr_type dummy_node() const
+    {
+        return head_.load(std::memory_order_acquire);
+    }
+};
+
+#endif /* INCLUDED_QWMPMCFIFOQUEUE_H */
@@ -22,6 +22,10 @@
 #ifndef INCLUDED_QWMPSCFIFOQUEUE_H
 #define INCLUDED_QWMPSCFIFOQUEUE_H
 
+#include <chrono>
+#include <cstddef> // size_t
+
+#include "QwEventCount.h"
 #include "QwLinkTraits.h"
 #include "QwMpmcPopAllLifoStack.h"
 #include "QwSTailList.h"
@@ -30,8 +34,9 @@
 /*
     QwMpscFifoQueue is a lock-free concurrent, multiple-producer single-consumer FIFO queue.
 
-    Producer(s) operations: push()
-    Consumer operations: consumer_empty(), pop().
+    Producer(s) operations: push(), push_notify()
+    Consumer operations: consumer_empty(), pop(), pop_all(), pop_up_to(),
+        pop_wait(), pop_wait_for().
 
     There may be multiple producers, but only one consumer.
 
@@ -39,6 +44,21 @@
 
     Implemented using the "Reversed IBM Freelist" technique.
     See ALGORITHMS.txt
+
+    pop_all() and pop_up_to() are batch versions of pop() for consumers
+    that drain many nodes at once. They reverse the captured LIFO chain in
+    place (one link write per node) and splice it on to the caller's list,
+    rather than pushing each node through consumerLocalReversingQueue_.
+
+    pop_wait() and pop_wait_for() block the consumer until a node is
+    available. They use a QwEventCount: the consumer announces that it is
+    about to park, re-checks the queue, then sleeps on a futex (after
+    an adaptive spin phase, see set_wait_spin_count()).
+    push_notify() pushes, then only makes a wake system call if the
+    consumer has announced that it is parking. Unlike push(n, wasEmpty),
+    this takes the consumer's local queue into account, so there are no
+    lost or redundant wakeups. Producers that use plain push() will not
+    wake a blocked consumer.
 */
 
 template<typename NodePtrT, int NEXT_LINK_INDEX>
@@ -53,6 +73,7 @@ public:
 private:
     QwMpmcPopAllLifoStack<NodePtrT, NEXT_LINK_INDEX> mpscLifo_;
     QwSTailList<NodePtrT, NEXT_LINK_INDEX> consumerLocalReversingQueue_;
+    QwEventCount consumerWaitEvent_;
 
 #if (QW_VALIDATE_NODE_LINKS == 1)
     void CLEAR_NODE_LINKS_FOR_VALIDATION(node_ptr_type n) const
@@ -63,6 +84,24 @@ private:
     void CLEAR_NODE_LINKS_FOR_VALIDATION(node_ptr_type) const {}
 #endif
 
+    // Capture all nodes from mpscLifo_ and reverse them in place into FIFO order.
+    // Returns the front (oldest) node, or nullptr if there were none. back's link is nullptr.
+    node_ptr_type capture_fifo(node_ptr_type& back, std::size_t& count)
+    {
+        node_ptr_type n = mpscLifo_.pop_all();
+        back = n; // the most recently pushed node is the back of the fifo
+        count = 0;
+        node_ptr_type front = nullptr;
+        while (n != nullptr) {
+            node_ptr_type next = nextlink::load(n);
+            nextlink::store(n, front);
+            front = n;
+            n = next;
+            ++count;
+        }
+        return front;
+    }
+
 public:
     void push(node_ptr_type n)
     {
@@ -72,6 +111,7 @@ public:
     // KNOWNBUG: push and push_multiple indicates wasEmpty
     // even if the consumer local-queue is non-empty.
     // not sure that will be fixed.
+    // To wake a blocked consumer use push_notify() with pop_wait() instead.
     void push(node_ptr_type n, bool& wasEmpty)
     {
         return mpscLifo_.push(n, wasEmpty);
@@ -83,6 +123,14 @@ public:
         return mpscLifo_.push_multiple(front, back, wasEmpty);
     }
 
+    // Push, and wake the consumer if it is blocked in pop_wait() or pop_wait_for().
+    // Only makes a system call if the consumer is parking.
+    void push_notify(node_ptr_type n)
+    {
+        mpscLifo_.push(n);
+        consumerWaitEvent_.notify_one(); // (there is only one consumer)
+    }
+
     bool consumer_empty() const
     {
         return (consumerLocalReversingQueue_.empty() && mpscLifo_.empty());
@@ -117,6 +165,86 @@ public:
             return consumerLocalReversingQueue_.pop_front();
         }
     }
+
+    // Pop, blocking until a node is available.
+    node_ptr_type pop_wait()
+    {
+        return consumerWaitEvent_.wait([this]{ return pop(); });
+    }
+
+    // Pop, blocking for at most timeout. Returns nullptr if the timeout elapsed.
+    node_ptr_type pop_wait_for(std::chrono::nanoseconds timeout)
+    {
+        return consumerWaitEvent_.wait_for([this]{ return pop(); }, timeout);
+    }
+
+    // Set the number of pop() retries before pop_wait() blocks. 0 disables spinning.
+    // Call before the consumer waits.
+    void set_wait_spin_count(int maxSpinCount)
+    {
+        consumerWaitEvent_.set_max_spin_count(maxSpinCount);
+    }
+
+    // Move all nodes to the back of result, in FIFO order.
+    void pop_all(QwSTailList<NodePtrT, NEXT_LINK_INDEX>& result)
+    {
+        result.splice_back(consumerLocalReversingQueue_); // (already in fifo order, and ahead of mpscLifo_)
+
+        if (!mpscLifo_.empty()) {
+            node_ptr_type back;
+            std::size_t count;
+            node_ptr_type front = capture_fifo(back, count);
+            if (front)
+                result.push_back_multiple(front, back);
+        }
+    }
+
+    // Move up to maxCount nodes to the back of result, in FIFO order.
+    // Returns the number of nodes moved.
+    std::size_t pop_up_to(std::size_t maxCount, QwSTailList<NodePtrT, NEXT_LINK_INDEX>& result)
+    {
+        if (maxCount == 0)
+            return 0;
+
+        std::size_t count = 0;
+        if (!consumerLocalReversingQueue_.empty()) {
+            // find the last node to take from consumerLocalReversingQueue_
+            node_ptr_type last = consumerLocalReversingQueue_.front();
+            count = 1;
+            while (count < maxCount && last != consumerLocalReversingQueue_.back()) {
+                last = nextlink::load(last);
+                ++count;
+            }
+            result.splice_back(consumerLocalReversingQueue_, last);
+            if (count == maxCount)
+                return count;
+        }
+
+        if (mpscLifo_.empty())
+            return count;
+
+        node_ptr_type back;
+        std::size_t capturedCount;
+        node_ptr_type front = capture_fifo(back, capturedCount);
+        if (!front)
+            return count;
+
+        std::size_t remaining = maxCount - count;
+        if (capturedCount <= remaining) {
+            result.push_back_multiple(front, back);
+            return count + capturedCount;
+        }
+
+        // take the first remaining nodes. keep the rest in consumerLocalReversingQueue_ (which is empty here)
+        node_ptr_type last = front;
+        for (std::size_t i=1; i < remaining; ++i)
+            last = nextlink::load(last);
+        node_ptr_type rest = nextlink::load(last);
+        nextlink::store(last, nullptr);
+        consumerLocalReversingQueue_.push_back_multiple(rest, back);
+        result.push_back_multiple(front, last);
+        return maxCount;
+    }
 };
 
 #endif /* INCLUDED_QWMPSCFIFOQUEUE_H */
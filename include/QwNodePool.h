@@ -24,10 +24,14 @@
 
 #include <atomic>
 #include <cassert>
+#include <chrono>
 #include <cstddef> // size_t
 #include <cstdint>
+#include <cstring> // memcpy
 
 #include "QwConfig.h"
+#include "QwLinkTraits.h"
+#include "QwSList.h"
 
 /*
     QwNodePool provides a thread-safe, lock-free fixed-size pool of
@@ -40,6 +44,25 @@
     QwNodePool ensures that all nodes are aligned to cache line boundaries
     to avoid false sharing.
 
+    Node stride: by default, node sizes are rounded up to a power of two,
+    so that node pointers and indices can be converted using shifts.
+    Constructing the pool with CACHE_LINE_STRIDE instead rounds node sizes
+    up to a multiple of the cache line size (e.g. a 130 byte node occupies
+    192 bytes instead of 256). Index to pointer conversion then uses a
+    multiply, and pointer to index conversion uses a multiply by a
+    precomputed modular inverse (exact, since node offsets are always
+    multiples of the node size).
+
+    Cache colouring: with a power-of-two stride, the first cache line of
+    every node maps to the same few cache sets (e.g. with 1024 byte nodes
+    and a 64-set L1, only 4 sets), so touching the headers of many nodes
+    causes conflict misses long before the cache is full. COLOURED_STRIDE
+    rounds node sizes up to an odd number of cache lines instead. Each node
+    is then offset by one more cache line (modulo the set count) than the
+    previous one, so consecutive node headers cycle through every set.
+    This costs up to one cache line per node over CACHE_LINE_STRIDE. See
+    benchmarks/QwNodePool_colouring_benchmark.cpp
+
     The implementation uses the "IBM Freelist" lock-free stack algorithm.
     See ALGORITHMS.txt
 
@@ -47,14 +70,171 @@
     portable to 64-bit systems that lack 128-bit CAS. Tagged pointers
     are packed into 64 bit words as (count, index), where index can be
     converted to a node pointer into the nodeArrayBase_ array.
-    More efficient alternative implementations may be provided later.
+    On platforms with a 128-bit CAS, define QW_NODEPOOL_USE_DWCAS=1 to
+    use (pointer, count) tagged pointers instead. See QwConfig.h.
+
+    Expandable pools: QwRawNodePool can optionally be constructed with an
+    initial node count that is smaller than maxNodes. In that case, address
+    space for maxNodes is reserved up front, but memory is only committed
+    for the initial nodes. The pool can later be expanded by calling grow(),
+    which commits the next segment of nodes and pushes them on to the
+    freelist. There is a single reservation and a single base array. The
+    committed nodes are always a contiguous prefix of the index space,
+    [1, committedNodeCount_]. A segment is segmentNodes rounded up to the
+    smallest run of nodes that fills whole pages, so segment sizes are
+    generally not powers of two. The allocate() and deallocate() fast paths
+    are unchanged: they never check which segments are committed.
+
+    This is a deliberate adaptation of a scheme with a separately allocated
+    base array per segment, selected by the high bits of the node index. A
+    single reservation keeps index-to-address conversion a single
+    multiply-add, and needs no per-segment table. The cost is that maxNodes
+    of address space is reserved up front, but not committed.
 
-    IDEA: if we wanted to support an expandable request pool,
-    the index space could be partitioned across multiple base arrays.
-    Additional arrays need only be allocated on demand.
+    Storage policies: by default, node storage is committed but not touched
+    until nodes are first used, so the first use of a node may page-fault.
+    Pools can be constructed with a combination of StoragePolicy flags to
+    request huge pages (fewer TLB misses when walking large pools),
+    eager pre-faulting, and locking pages in to physical memory. These
+    are applied when storage is committed, i.e. at construction and in
+    grow(). storage_info() reports which policies took effect.
+
+    Elimination backoff: when QW_NODEPOOL_ELIMINATION is 1 (see QwConfig.h),
+    an allocate() or deallocate() that fails its CAS on the freelist top
+    tries to exchange a node directly with a concurrent deallocate() or
+    allocate() through a small elimination array, then retries the
+    freelist. This is intended to relieve contention on top_ under bursty
+    load. Uncontended operations never touch the array. Batch operations
+    (allocate_n(), deallocate_list()) don't use it. NOTE: the throughput
+    gain has not been measured on a many-core machine, so benchmark your
+    workload before enabling it.
+
+    grow() makes system calls and must only be called from non-real-time
+    threads. allocate() never grows the pool. Instead, when an allocation
+    fails on an expandable pool it sets a flag that can be polled by a
+    non-real-time thread using growth_requested().
+
+    Concurrent grow() calls are serialized by a small spin lock (growLock_,
+    which yields while waiting). This is deliberate: segments must be
+    committed in index order, because committedNodeCount_ describes a
+    contiguous prefix of the index space. Only grow() takes the lock.
+    allocate() and deallocate() never touch it, and a new segment is
+    published to them lock-free: a release store of committedNodeCount_,
+    then a lock-free push of the new nodes. So a stalled grower can delay
+    other growers but never a real-time thread.
 */
 
+#if (QW_NODEPOOL_USE_DWCAS == 1)
+
+#if defined(_MSC_VER)
+#include <intrin.h> // _InterlockedCompareExchange128
+#endif
+
+namespace Qw {
+namespace impl {
+
+    // (pointer, count) pair for use with double-width (128-bit) CAS
+    struct alignas(16) DwcasPointer {
+        void *ptr;
+        std::uint64_t count;
+    };
+
+#if defined(_MSC_VER)
+
+    inline DwcasPointer dwcas_load(const DwcasPointer *p)
+    {
+        // Read count then ptr. The two halves may be torn, in which case a
+        // subsequent dwcas() will fail, as it would if top had changed.
+        DwcasPointer result;
+        result.count = *static_cast<const volatile std::uint64_t*>(&p->count);
+        result.ptr = *static_cast<void *const volatile*>(&p->ptr);
+        return result;
+    }
+
+    // Full fence. On failure, expected is updated with the current value
+    inline bool dwcas(DwcasPointer *p, DwcasPointer& expected, const DwcasPointer& desired)
+    {
+        return _InterlockedCompareExchange128(reinterpret_cast<volatile __int64*>(p),
+                static_cast<__int64>(desired.count), reinterpret_cast<__int64>(desired.ptr),
+                reinterpret_cast<__int64*>(&expected)) != 0;
+    }
+
+#else
+
+    inline DwcasPointer dwcas_load(const DwcasPointer *p)
+    {
+        // Read count then ptr. The two halves may be torn, in which case a
+        // subsequent dwcas() will fail, as it would if top had changed.
+        DwcasPointer result;
+        result.count = __atomic_load_n(&p->count, __ATOMIC_RELAXED);
+        result.ptr = __atomic_load_n(&p->ptr, __ATOMIC_RELAXED);
+        return result;
+    }
+
+    // Full fence. On failure, expected is updated with the current value
+    inline bool dwcas(DwcasPointer *p, DwcasPointer& expected, const DwcasPointer& desired)
+    {
+        typedef unsigned __int128 uint128_type;
+        uint128_type e, d;
+        std::memcpy(&e, &expected, sizeof(e));
+        std::memcpy(&d, &desired, sizeof(d));
+        uint128_type previous = __sync_val_compare_and_swap(reinterpret_cast<uint128_type*>(p), e, d);
+        if (previous == e)
+            return true;
+        std::memcpy(&expected, &previous, sizeof(expected));
+        return false;
+    }
+
+#endif
+
+} } // end namespace Qw::impl
+
+#endif /* QW_NODEPOOL_USE_DWCAS */
+
+#if (QW_NODEPOOL_STATS == 1) || (QW_NODEPOOL_ELIMINATION == 1)
+
+namespace Qw {
+namespace impl {
+
+    // A small integer that identifies the calling thread. Used to select
+    // statistics shards and elimination slots.
+    inline std::size_t pool_thread_index()
+    {
+        static std::atomic<std::size_t> nextIndex(0);
+        static thread_local std::size_t index = nextIndex.fetch_add(1, std::memory_order_relaxed);
+        return index;
+    }
+
+} } // end namespace Qw::impl
+
+#endif /* QW_NODEPOOL_STATS || QW_NODEPOOL_ELIMINATION */
+
 class QwRawNodePool {
+public:
+    // Node stride (the distance between adjacent nodes), selected at construction.
+    enum NodeStride {
+        POWER_OF_TWO_STRIDE, // node size is rounded up to a power of two. index<->pointer conversion uses shifts
+        CACHE_LINE_STRIDE,   // node size is rounded up to a multiple of CACHE_LINE_SIZE. conversion uses multiplication
+        COLOURED_STRIDE      // node size is rounded up to an odd multiple of CACHE_LINE_SIZE. conversion uses multiplication
+    };
+
+    // Node storage policy flags, selected at construction. May be combined using |.
+    enum StoragePolicy {
+        DEFAULT_STORAGE = 0,    // heap storage (fixed pools), or page-granularity reservation (expandable pools)
+        HUGE_PAGE_STORAGE = 1,  // storage is mapped with huge page alignment and advised to use huge pages (Linux: MADV_HUGEPAGE)
+        PREFAULT_STORAGE = 2,   // every page is touched when committed (at construction, or by grow()), not on first use
+        LOCKED_STORAGE = 4      // committed pages are locked in to physical memory (mlock). implies PREFAULT_STORAGE
+    };
+
+    // See storage_info()
+    struct StorageInfo {
+        int requestedPolicy;    // StoragePolicy flags passed to the constructor
+        int appliedPolicy;      // StoragePolicy flags in effect. e.g. LOCKED_STORAGE is cleared if any mlock() failed
+        size_t pageSize;        // storage alignment and commit granularity
+        size_t committedBytes;  // bytes of node storage currently committed
+    };
+
+private:
     using size_t = std::size_t;
     using int8_t = std::int8_t;
     using ptrdiff_t = std::ptrdiff_t;
@@ -68,26 +248,113 @@ class QwRawNodePool {
 #pragma clang diagnostic pop
 #endif
     int8_t *nodeStorage_;       // The raw memory buffer that is allocated and freed
+    size_t reservedBytes_;      // Non-zero if nodeStorage_ is reserved address space (expandable pool)
+    size_t mappedBytes_;        // Non-zero if nodeStorage_ was mapped using qw_reserve_pages(), otherwise heap allocated
+    bool ownsStorage_;          // false if nodeStorage_ was supplied by the client
+    size_t storagePageSize_;    // storage alignment and commit granularity (the huge page size for HUGE_PAGE_STORAGE)
+    int storagePolicy_;         // requested StoragePolicy flags
+    std::atomic<int> appliedStoragePolicy_; // StoragePolicy flags in effect
 
     enum { NULL_NODE_INDEX=0 };
     int8_t *nodeArrayBase_;     // base ptr indexed by the packed pointer indexes. 1-based. nodeArrayBase_[0] should not be dereferenced
-    size_t nodeSize_;           // nodes are allocated on cache-line boundaries. in this impl they also have power-of-two size
-    int8_t nodeBitShift_;       // index=(ptr-nodeArrayBase_)>>nodeBitShift_; (nodeArrayBase_+(index<<nodeBitShift_)) == ptr
+    size_t nodeSize_;           // nodes are allocated on cache-line boundaries. nodeSize_ == (oddFactor<<nodeBitShift_)
+    int8_t nodeBitShift_;       // for power-of-two sizes: index=(ptr-nodeArrayBase_)>>nodeBitShift_; (nodeArrayBase_+(index<<nodeBitShift_)) == ptr
+    size_t nodeOddFactorInverse_; // multiplicative inverse of oddFactor (mod 2^N). 1 iff nodeSize_ is a power of two
+    size_t maxNodeIndex_;       // node indices are [1, maxNodeIndex_]
+    size_t segmentNodeCount_;   // expandable pools grow by this many nodes at a time
+    std::atomic<size_t> committedNodeCount_; // nodes with index <= committedNodeCount_ are backed by memory
+    std::atomic<bool> growthRequested_;
+    std::atomic<bool> growLock_; // serializes grow(). never touched by allocate() and deallocate()
+    std::atomic<std::uint32_t> waiterCount_;   // threads blocked (or about to block) in allocate_wait()
+    std::atomic<std::uint32_t> freeSequence_;  // futex word. incremented when nodes are freed while there are waiters
 
     //////////////////////////////////////////////////////////////////////
-    // Packed pointer representation with ABA-prevention count.
+    // Tagged pointer representation with ABA-prevention count.
+    //
+    // A "link" (nodelink_type) identifies a node. Links are stored in top_
+    // and in the next field of each free node. There are two representations,
+    // selected at compile time by QW_NODEPOOL_USE_DWCAS (see QwConfig.h):
+    //
+    //  - Packed (the default, portable to any 64-bit CAS): links are node indices.
+    //    top_ is packed into 64 bits as (count, index). The number of bits
+    //    available for the ABA count shrinks as the pool grows.
+    //
+    //  - Double-width: links are node pointers. top_ is a (pointer, 64-bit count)
+    //    pair updated using a 128-bit CAS. No index<->pointer conversion is needed.
+
+    typedef size_t nodeindex_type;
 
     // important: must use uint to get correct wrap-around behavior on count,
     // because signed int overflow is undefined in C and C++
+
+#if (QW_NODEPOOL_USE_DWCAS == 1)
+
+    typedef void *nodelink_type;
+    typedef Qw::impl::DwcasPointer abapointer_type; // (node-ptr, aba-count)
+    typedef std::uint64_t abacount_type;
+
+    abacount_type countIncrement_; // always 1
+
+    static nodelink_type null_link() { return nullptr; }
+
+    nodelink_type link_of_node(void *node) const { return node; }
+    void *node_of_link(nodelink_type link) const { return link; }
+
+    // true if the node referenced by a non-null link can be safely read.
+    // used to guard against following stale links.
+    bool link_is_in_bounds(nodelink_type link) const
+    {
+        const int8_t *p = static_cast<const int8_t*>(link);
+        const int8_t *end = nodeStorage_ + committedNodeCount_.load(std::memory_order_relaxed)*nodeSize_;
+        return (p >= nodeStorage_ && p + sizeof(nodelink_type) <= end);
+    }
+
+    nodelink_type ap_link(const abapointer_type& ptr) const { return ptr.ptr; }
+    abacount_type ap_count(const abapointer_type& ptr) const { return ptr.count; }
+
+    abapointer_type make_abapointer(nodelink_type link, abacount_type count) const {
+        abapointer_type result;
+        result.ptr = link;
+        result.count = count;
+        return result;
+    }
+
+    Qw::impl::DwcasPointer top_;
+
+    abapointer_type top_load(std::memory_order) const { return Qw::impl::dwcas_load(&top_); }
+
+    void top_store_nonatomic(const abapointer_type& x) { top_ = x; } // only during construction
+
+    // always a full fence, regardless of the requested memory orders
+    bool top_compare_exchange(abapointer_type& expected, const abapointer_type& desired,
+            std::memory_order, std::memory_order)
+    {
+        return Qw::impl::dwcas(&top_, expected, desired);
+    }
+
+#else
+
     typedef uint64_t abapointer_type; // (node-index, aba-count)
-    typedef size_t nodeindex_type;
+    typedef nodeindex_type nodelink_type;
     typedef abapointer_type abacount_type;
 
     abapointer_type indexMask_;
     abapointer_type countMask_;
     abacount_type countIncrement_;
 
-    nodeindex_type ap_index(abapointer_type ptr) const {
+    static nodelink_type null_link() { return NULL_NODE_INDEX; }
+
+    nodelink_type link_of_node(void *node) const { return index_of_node(node); }
+    void *node_of_link(nodelink_type link) const { return node_at_index(link); }
+
+    // true if the node referenced by a non-null link can be safely read.
+    // used to guard against following stale links.
+    bool link_is_in_bounds(nodelink_type link) const
+    {
+        return (link <= committedNodeCount_.load(std::memory_order_relaxed));
+    }
+
+    nodelink_type ap_link(abapointer_type ptr) const {
         // index is in low bits, no shift needed
         return static_cast<nodeindex_type>(ptr & indexMask_);
     }
@@ -97,19 +364,138 @@ class QwRawNodePool {
         return static_cast<abacount_type>(ptr & countMask_);
     }
 
-    abapointer_type make_abapointer(nodeindex_type index, abacount_type count) const {
+    abapointer_type make_abapointer(nodelink_type index, abacount_type count) const {
         return static_cast<abapointer_type>(index) | (static_cast<abapointer_type>(count)&countMask_);
     }
 
-    // end packed pointer representation.
-    //////////////////////////////////////////////////////////////////////
-
     std::atomic<std::uint64_t> top_; // must be large enough to store abapointer_type
 
+    abapointer_type top_load(std::memory_order order) const { return top_.load(order); }
+
+    void top_store_nonatomic(abapointer_type x) { top_.store(x, std::memory_order_relaxed); } // only during construction
+
+    bool top_compare_exchange(abapointer_type& expected, abapointer_type desired,
+            std::memory_order success, std::memory_order failure)
+    {
+        return top_.compare_exchange_strong(expected, desired, success, failure);
+    }
+
+#endif
+
+    // end tagged pointer representation.
+    //////////////////////////////////////////////////////////////////////
+
 #if (QW_DEBUG_COUNT_NODE_ALLOCATIONS == 1)
     std::atomic<std::int32_t> allocCount_;
 #endif
 
+#if (QW_NODEPOOL_STATS == 1)
+    // Statistics counters are sharded by thread, with each shard on its own
+    // cache line, so that counting doesn't add contention.
+    enum { STATS_SHARD_COUNT = 16 };
+
+    struct StatsShard {
+        std::atomic<std::uint64_t> allocations;
+        std::atomic<std::uint64_t> deallocations;
+        std::atomic<std::uint64_t> exhaustions;
+        std::atomic<std::uint64_t> popCasFailures;
+        std::atomic<std::uint64_t> pushCasFailures;
+        std::atomic<std::uint64_t> eliminations;
+    };
+
+    int8_t *statsShardStorage_;    // STATS_SHARD_COUNT cache lines, each containing a StatsShard
+    std::atomic<std::uint64_t> *statsTouchedBits_; // one bit per node, set when the node is first allocated
+    std::atomic<size_t> statsTouchedNodeCount_;
+
+    StatsShard& stats_shard() const
+    {
+        return *reinterpret_cast<StatsShard*>(
+                statsShardStorage_ + (Qw::impl::pool_thread_index() % STATS_SHARD_COUNT) * CACHE_LINE_SIZE);
+    }
+
+    // Record that node has been allocated. Nodes are touched at most once,
+    // so after warm-up this only reads statsTouchedBits_.
+    void stats_touch(void *node)
+    {
+        size_t bit = index_of_node(node) - 1;
+        std::atomic<std::uint64_t>& word = statsTouchedBits_[bit / 64];
+        std::uint64_t mask = static_cast<std::uint64_t>(1) << (bit % 64);
+        if ((word.load(std::memory_order_relaxed) & mask) == 0) {
+            if ((word.fetch_or(mask, std::memory_order_relaxed) & mask) == 0)
+                statsTouchedNodeCount_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    void init_stats();
+    void destroy_stats();
+#endif
+
+#if (QW_NODEPOOL_ELIMINATION == 1)
+    // Elimination-backoff array. Each slot is on its own cache line, and holds
+    // either null_link() or a node offered by a deallocating thread.
+    // A deallocating thread offers at the slot selected by its thread index.
+    // An allocating thread scans all slots, so the two always meet.
+    enum { ELIMINATION_SLOT_COUNT = 8, ELIMINATION_SPIN_COUNT = 64 };
+
+    int8_t *eliminationSlotStorage_; // ELIMINATION_SLOT_COUNT cache lines, each containing a std::atomic<nodelink_type>
+
+    friend struct QwRawNodePoolEliminationTestAccess; // (exposes elimination_push() and elimination_pop() to tests)
+
+    std::atomic<nodelink_type>& elimination_slot(size_t i) const
+    {
+        return *reinterpret_cast<std::atomic<nodelink_type>*>(eliminationSlotStorage_ + i*CACHE_LINE_SIZE);
+    }
+
+    // Offer node to a concurrent allocate(), waiting a bounded time for it to be taken.
+    // Returns true if the node was taken, false if the caller still owns the node.
+    //
+    // If the node is taken, then reallocated and re-offered at the same slot before
+    // we look, we will withdraw the re-offered node and see it as not taken. That's
+    // fine: either way exactly one thread ends up owning the free node.
+    bool elimination_push(void *node)
+    {
+        nodelink_type link = link_of_node(node);
+        std::atomic<nodelink_type>& slot = elimination_slot(Qw::impl::pool_thread_index() % ELIMINATION_SLOT_COUNT);
+
+        nodelink_type expected = null_link();
+        if (!slot.compare_exchange_strong(expected, link,
+                std::memory_order_release, // (Ensure writes to the node happen before it is taken)
+                std::memory_order_relaxed))
+            return false; // slot is in use
+
+        for (int i=0; i < ELIMINATION_SPIN_COUNT; ++i) {
+            if (slot.load(std::memory_order_relaxed) != link)
+                return true;
+        }
+
+        // Timed out. Withdraw the offer, unless it is taken in the meantime.
+        expected = link;
+        return !slot.compare_exchange_strong(expected, null_link(),
+                std::memory_order_acquire, std::memory_order_relaxed);
+    }
+
+    // Take a node offered by a concurrent deallocate(). Returns nullptr if none is on offer.
+    void *elimination_pop()
+    {
+        size_t first = Qw::impl::pool_thread_index();
+        for (size_t i=0; i < ELIMINATION_SLOT_COUNT; ++i) {
+            std::atomic<nodelink_type>& slot = elimination_slot((first + i) % ELIMINATION_SLOT_COUNT);
+            nodelink_type link = slot.load(std::memory_order_relaxed);
+            if (link != null_link() && slot.compare_exchange_strong(link, null_link(),
+                    std::memory_order_acquire, std::memory_order_relaxed)) {
+#if (QW_NODEPOOL_STATS == 1)
+                stats_shard().eliminations.fetch_add(1, std::memory_order_relaxed);
+#endif
+                return node_of_link(link);
+            }
+        }
+        return nullptr;
+    }
+
+    void init_elimination();
+    void destroy_elimination();
+#endif
+
 #ifdef __clang__
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wunused-private-field"
@@ -119,91 +505,144 @@ class QwRawNodePool {
 #pragma clang diagnostic pop
 #endif
     // Node representation. Since this is a freelist, there is no node content.
-    // When stored on the stack, each node contains a next index at the start:
+    // When stored on the stack, each node contains a next link at the start:
     //
     //  Node {
-    //     nodeindex_type next;
+    //     nodelink_type next;
     //  }
 
     // node->next = x; --> node_next_lvalue(node) = x
-    nodeindex_type& node_next_lvalue(void *node) const
+    nodelink_type& node_next_lvalue(void *node) const
     {
-        return *static_cast<nodeindex_type*>(node);
+        return *static_cast<nodelink_type*>(node);
     }
 
     // x = node->next; --> x = node_next(node)
-    nodeindex_type node_next(void *node) const // when stored on the stack, each node contains a next index at the start
+    nodelink_type node_next(void *node) const // when stored on the stack, each node contains a next link at the start
     {
-        return *static_cast<nodeindex_type*>(node);
+        return *static_cast<nodelink_type*>(node);
     }
 
     // convert a node pointer to an array index
-    nodeindex_type index_of_node(void *node)
+    nodeindex_type index_of_node(void *node) const
     {
-        ptrdiff_t i = (static_cast<int8_t*>(node) - nodeArrayBase_) >> nodeBitShift_;
-        return static_cast<nodeindex_type>(i);
+        size_t offset = static_cast<size_t>(static_cast<int8_t*>(node) - nodeArrayBase_);
+        if (nodeOddFactorInverse_ == 1) // power-of-two stride
+            return static_cast<nodeindex_type>(offset >> nodeBitShift_);
+
+        // offset is an exact multiple of nodeSize_, so dividing by nodeSize_ is the same as
+        // shifting out the power-of-two factor, then multiplying by the inverse of the odd factor.
+        return static_cast<nodeindex_type>((offset >> nodeBitShift_) * nodeOddFactorInverse_);
     }
 
     // convert array index to a pointer
-    void *node_at_index(nodeindex_type index)
+    void *node_at_index(nodeindex_type index) const
     {
-        int8_t *p = nodeArrayBase_ + (static_cast<ptrdiff_t>(index) << nodeBitShift_);
-        return p;
+        if (nodeOddFactorInverse_ == 1) // power-of-two stride
+            return nodeArrayBase_ + (static_cast<ptrdiff_t>(index) << nodeBitShift_);
+
+        return nodeArrayBase_ + static_cast<ptrdiff_t>(index * nodeSize_);
     }
 
     // init, push and pop follow the pseudocode of Michael and Scott 97
     // see ALGORITHMS.txt for details
     //
-    // The implementation is slightly obscured by the indirection via indices. Here's a decoder from MS97 to our code:
+    // The implementation is slightly obscured by the indirection via links. Here's a decoder from MS97 to our code:
     //
-    //  top.ptr     --> node_pointer(ap_index(top))
-    //  top.next    --> node_next(node_pointer(ap_index(top)))
+    //  top.ptr     --> node_of_link(ap_link(top))
+    //  top.next    --> node_next(node_of_link(ap_link(top)))
     //  top.count   --> ap_count(top)
     //
     //  We directly push and pop nodes with embedded next links. We don't separately allocate nodes.
 
+    // Try to swing top from expected to desired when pushing
+    bool top_cas_push(abapointer_type& expected, const abapointer_type& desired)
+    {
+        bool result = top_compare_exchange(expected, desired,
+                /*success:*/ std::memory_order_seq_cst, // (release: ensure next links of pushed nodes are visible to consumers.
+                                                        //  seq_cst: order the push before the waiterCount_ check in wake_waiters())
+                /*failure:*/ std::memory_order_relaxed);
+#if (QW_NODEPOOL_STATS == 1)
+        if (!result)
+            stats_shard().pushCasFailures.fetch_add(1, std::memory_order_relaxed);
+#endif
+        return result;
+    }
+
+    // Try to swing top from expected to desired when popping
+    bool top_cas_pop(abapointer_type& expected, const abapointer_type& desired)
+    {
+        bool result = top_compare_exchange(expected, desired,
+                /*success:*/ std::memory_order_relaxed,
+                /*failure:*/ std::memory_order_relaxed); // it would be nice to use std::memory_order_acquire here, but C++11 says we can't.
+#if (QW_NODEPOOL_STATS == 1)
+        if (!result)
+            stats_shard().popCasFailures.fetch_add(1, std::memory_order_relaxed);
+#endif
+        return result;
+    }
+
     void stack_init()
     {
-        top_.store(make_abapointer(NULL_NODE_INDEX, 0), std::memory_order_relaxed);
+        top_store_nonatomic(make_abapointer(null_link(), 0));
     }
 
     // thread unsafe non-atomic version for construction time
     void stack_push_nonatomic(void *node)
     {
         assert(node != nullptr);
-        nodeindex_type nodeIndex = index_of_node(node);
-        node_next_lvalue(node) = ap_index(top_.load(std::memory_order_relaxed)); // Link new node to head of list (node.next <- top.ptr)
-        top_.store(make_abapointer(nodeIndex, 0), std::memory_order_relaxed); // Set top to new node. no need for ABA counter during thread-unsafe code
+        nodelink_type nodeLink = link_of_node(node);
+        node_next_lvalue(node) = ap_link(top_load(std::memory_order_relaxed)); // Link new node to head of list (node.next <- top.ptr)
+        top_store_nonatomic(make_abapointer(nodeLink, 0)); // Set top to new node. no need for ABA counter during thread-unsafe code
     }
 
     void stack_push(void *node)
     {
         assert(node != nullptr);
-        nodeindex_type nodeIndex = index_of_node(node);
+        nodelink_type nodeLink = link_of_node(node);
 
-        abapointer_type top = top_.load(std::memory_order_relaxed); // Read top.ptr and top.count together (also done by compare_exchange_strong upon failure)
+        abapointer_type top = top_load(std::memory_order_relaxed); // Read top.ptr and top.count together (also done by compare_exchange_strong upon failure)
         do {                                            // Keep trying until push is done
-            node_next_lvalue(node) = ap_index(top);     // Link new node to head of list (node.next <- top.ptr)
+            node_next_lvalue(node) = ap_link(top);      // Link new node to head of list (node.next <- top.ptr)
             // Try to swing top to the new node:
-        } while (top_.compare_exchange_strong(top, make_abapointer(nodeIndex, ap_count(top)+countIncrement_),
-                /*success:*/ std::memory_order_release, // (Ensure node.next is visible to consumers)
-                /*failure:*/ std::memory_order_relaxed) == false);
+        } while (top_cas_push(top, make_abapointer(nodeLink, ap_count(top)+countIncrement_)) == false
+#if (QW_NODEPOOL_ELIMINATION == 1)
+                && elimination_push(node) == false      // Contended. Try to hand the node directly to an allocator
+#endif
+                );
+    }
+
+    // push a chain of nodes with a single CAS. The chain must be pre-linked from front
+    // to back using node_next_lvalue(). back's next link is overwritten.
+    void stack_push_multiple(void *front, void *back)
+    {
+        assert(front != nullptr);
+        assert(back != nullptr);
+        nodelink_type frontLink = link_of_node(front);
+
+        abapointer_type top = top_load(std::memory_order_relaxed);
+        do {
+            node_next_lvalue(back) = ap_link(top);      // Link back node to head of list (back.next <- top.ptr)
+            // Try to swing top to the front node:
+        } while (top_cas_push(top, make_abapointer(frontLink, ap_count(top)+countIncrement_)) == false);
     }
 
     void *stack_pop()
     {
-        abapointer_type top = top_.load(); // Read top (explicitly fenced below)
+        abapointer_type top = top_load(std::memory_order_seq_cst); // Read top (explicitly fenced below)
         void *node;
         do {                                            // Keep trying until pop is done
             std::atomic_thread_fence(std::memory_order_acquire); // Acquire top.next, accessed by node_next(node) below.
-            nodeindex_type nodeIndex = ap_index(top);
-            if (nodeIndex==NULL_NODE_INDEX)             // Is the stack empty?
+            nodelink_type nodeLink = ap_link(top);
+            if (nodeLink==null_link())                  // Is the stack empty?
                 return nullptr;                         // The stack was empty, couldn't pop
             // Try to swing top to the next node:
-            node = node_at_index(nodeIndex);
-        } while (top_.compare_exchange_strong(top, make_abapointer(node_next(node), ap_count(top)+countIncrement_),
-                /*success:*/ std::memory_order_relaxed,
-                /*failure:*/ std::memory_order_relaxed) == false); // it would be nice to use std::memory_order_acquire here, but C++11 says we can't.
+            node = node_of_link(nodeLink);
+        } while (top_cas_pop(top, make_abapointer(node_next(node), ap_count(top)+countIncrement_)) == false
+#if (QW_NODEPOOL_ELIMINATION == 1)
+                && (node = elimination_pop()) == nullptr // Contended. Try to take a node directly from a deallocator
+#endif
+                );
         // BUG: in C++11, node->next should be an atomic field, but it is not.
         // Under the C++11 memory model, unless node.next is atomic, the read performed by node_next(node) may be a data race (triggers UB)
         // [Consider the following case:
@@ -217,27 +656,289 @@ class QwRawNodePool {
         return node;
     }
 
+    // pop a run of up to maxCount nodes with a single CAS. Returns the front node
+    // of the run and sets count. The popped nodes remain linked by their next links,
+    // except that the back node's next link is not meaningful.
+    //
+    // The run is found by walking the next links from top. As in stack_pop() the links
+    // may be concurrently overwritten by threads that have already popped them. In that
+    // case the CAS will fail (the count in top will have changed) but we must still take
+    // care not to follow a garbage link outside the node array.
+    void *stack_pop_multiple(size_t maxCount, size_t& count)
+    {
+        assert(maxCount > 0);
+        abapointer_type top = top_load(std::memory_order_seq_cst); // Read top (explicitly fenced below)
+        void *front;
+        nodelink_type nextLink;
+        do {                                            // Keep trying until pop is done
+            std::atomic_thread_fence(std::memory_order_acquire); // Acquire next links of all nodes walked below
+            nodelink_type nodeLink = ap_link(top);
+            if (nodeLink==null_link()) {                // Is the stack empty?
+                count = 0;
+                return nullptr;                         // The stack was empty, couldn't pop
+            }
+            front = node_of_link(nodeLink);
+            count = 1;
+            nextLink = node_next(front);
+            while (count < maxCount && nextLink != null_link()) {
+                if (!link_is_in_bounds(nextLink))
+                    break;                              // Stale read, the CAS below is certain to fail
+                nextLink = node_next(node_of_link(nextLink));
+                ++count;
+            }
+            // Try to swing top to the node following the run:
+        } while (top_cas_pop(top, make_abapointer(nextLink, ap_count(top)+countIncrement_)) == false);
+        // (Same BUG as stack_pop(): the next links are not atomic, see above.)
+        return front;
+    }
+
+    void init_geometry(size_t nodeSize, size_t maxNodes, NodeStride stride);
+    void init_storage_policy(int storagePolicy);
+    bool map_storage(size_t size, bool commit);
+    void apply_storage_policy(void *p, size_t size);
+    void push_nodes(size_t firstIndex, size_t count);
+
+    // Wake threads blocked in allocate_wait() after nodes have been pushed.
+    // This is a single load unless there are waiters.
+    //
+    // Lost wake-ups are prevented by the Dekker-style pairing of seq_cst
+    // operations: the pusher CASes top_ then loads waiterCount_, a waiter
+    // increments waiterCount_ then loads top_. At least one of them sees
+    // the other. (On x86 the seq_cst load is a plain load, and the CAS is
+    // the same instruction as a release CAS.)
+    void wake_waiters(bool all)
+    {
+        if (waiterCount_.load(std::memory_order_seq_cst) != 0)
+            notify_waiters(all);
+    }
+
+    void notify_waiters(bool all);
+
+    void count_allocation(void *node)
+    {
+#if (QW_DEBUG_COUNT_NODE_ALLOCATIONS == 1)
+        allocCount_.fetch_add(1, std::memory_order_relaxed);
+#endif
+#if (QW_NODEPOOL_STATS == 1)
+        stats_shard().allocations.fetch_add(1, std::memory_order_relaxed);
+        stats_touch(node);
+#endif
+        (void)node;
+    }
+
+    void *allocate_wait_slow(std::chrono::nanoseconds timeout);
+
 public:
-    QwRawNodePool(size_t nodeSize, size_t maxNodes);
+    // Fixed-size pool with storage for maxNodes nodes.
+    QwRawNodePool(size_t nodeSize, size_t maxNodes, NodeStride stride=POWER_OF_TWO_STRIDE,
+            int storagePolicy=DEFAULT_STORAGE);
+
+    // Expandable pool. Reserves address space for maxNodes, commits
+    // initialNodes (rounded up to a whole segment), and grows by
+    // segmentNodes at a time when grow() is called.
+    // With HUGE_PAGE_STORAGE, segments are rounded up to whole huge pages.
+    QwRawNodePool(size_t nodeSize, size_t maxNodes, size_t initialNodes, size_t segmentNodes,
+            NodeStride stride=POWER_OF_TWO_STRIDE, int storagePolicy=DEFAULT_STORAGE);
+
+    // Fixed-size pool using client-supplied storage. The storage must be cache line
+    // aligned and must outlive the pool. The pool holds storageBytes/node_stride_for(nodeSize, stride) nodes.
+    QwRawNodePool(void *storage, size_t storageBytes, size_t nodeSize, NodeStride stride=POWER_OF_TWO_STRIDE);
+
     ~QwRawNodePool();
 
+    // The node stride of a pool constructed with the given nodeSize and stride
+    static size_t node_stride_for(size_t nodeSize, NodeStride stride);
+
+    // Commit the next segment of nodes and add it to the freelist.
+    // Returns the number of nodes added, which is zero if the pool
+    // is fixed-size, has reached maxNodes, or memory could not be committed.
+    // Thread safe, but must only be called from non-real-time threads.
+    size_t grow();
+
+    // true if an allocation has failed on an expandable pool since the last call to grow()
+    bool growth_requested() const { return growthRequested_.load(std::memory_order_relaxed); }
+
+    size_t capacity() const { return committedNodeCount_.load(std::memory_order_relaxed); }
+    size_t max_capacity() const { return maxNodeIndex_; }
+
+    // distance in bytes between adjacent nodes. at least the requested node size
+    size_t node_stride() const { return nodeSize_; }
+
+    // true if p points in to this pool's node storage (whether or not the node is allocated)
+    bool owns(const void *p) const
+    {
+        const int8_t *q = static_cast<const int8_t*>(p);
+        return (q >= nodeStorage_ && q < nodeStorage_ + maxNodeIndex_*nodeSize_);
+    }
+
+    // Report the storage policy that was requested and the policy that is in effect.
+    // Policies are best-effort: the pool is still usable if, for example,
+    // huge pages are unavailable or mlock() exceeds RLIMIT_MEMLOCK.
+    StorageInfo storage_info() const;
+
+    // Pool statistics. Collected only when QW_NODEPOOL_STATS is 1 (see QwConfig.h),
+    // otherwise stats() returns zeros.
+    struct Stats {
+        size_t liveCount;           // nodes currently allocated
+        size_t highWaterMark;       // number of distinct nodes ever allocated (see below)
+        std::uint64_t allocations;  // successful node allocations
+        std::uint64_t deallocations;
+        std::uint64_t exhaustions;  // allocate() or allocate_n() calls that could not be satisfied in full
+        std::uint64_t popCasFailures;  // failed CAS attempts (contention) when allocating
+        std::uint64_t pushCasFailures; // failed CAS attempts (contention) when deallocating
+        std::uint64_t eliminations;    // allocations satisfied directly by a concurrent deallocation (QW_NODEPOOL_ELIMINATION)
+    };
+
+    static constexpr bool stats_enabled() { return (QW_NODEPOOL_STATS == 1); }
+
+    // Snapshot the statistics. Thread safe, and may be called concurrently
+    // with allocation and deallocation, in which case the counters are not
+    // read at a single instant in time (e.g. liveCount may be briefly off).
+    //
+    // Because the freelist is LIFO, a node that has never been allocated is
+    // only reached when every previously touched node is allocated. So the
+    // number of distinct nodes ever allocated is the maximum number of nodes
+    // allocated at once. (Except that grow() on a pool that still has free
+    // nodes puts untouched nodes on top of the freelist, which can make
+    // highWaterMark an overestimate.)
+    Stats stats() const;
+
     void *allocate()
     {
         void *result = stack_pop();
 
-#if (QW_DEBUG_COUNT_NODE_ALLOCATIONS == 1)
+        if (!result && reservedBytes_ != 0)
+            growthRequested_.store(true, std::memory_order_relaxed);
+
         if (result)
-            allocCount_.fetch_add(1, std::memory_order_relaxed);
+            count_allocation(result);
+#if (QW_NODEPOOL_STATS == 1)
+        else
+            stats_shard().exhaustions.fetch_add(1, std::memory_order_relaxed);
 #endif
         return result;
     }
 
+    // Allocate a node, waiting for up to timeout for a node to be deallocated
+    // if the pool is empty. Spins briefly, then blocks on a futex. Returns
+    // nullptr if timeout elapses first. Waiting does not grow expandable pools
+    // (but growth_requested() is set, so a non-real-time thread can grow the pool).
+    // Not real-time safe. Use allocate() on real-time threads.
+    //
+    // deallocate() wakes waiters only when there are any, so while nobody is
+    // waiting deallocation remains a single CAS plus a load.
+    void *allocate_wait(std::chrono::nanoseconds timeout)
+    {
+        void *result = allocate();
+        if (result || timeout <= std::chrono::nanoseconds::zero())
+            return result;
+        return allocate_wait_slow(timeout);
+    }
+
     void deallocate(void *node)
     {
 #if (QW_DEBUG_COUNT_NODE_ALLOCATIONS == 1)
         allocCount_.fetch_add(-1, std::memory_order_relaxed);
+#endif
+#if (QW_NODEPOOL_STATS == 1)
+        stats_shard().deallocations.fetch_add(1, std::memory_order_relaxed);
 #endif
         stack_push(node);
+        wake_waiters(false);
+    }
+
+    // Batch allocate and deallocate. Each is a single CAS on the freelist
+    // top (retried on contention, like allocate() and deallocate()).
+
+    // Allocate up to count nodes. f(node) is called for each allocated node.
+    // Returns the number of nodes allocated, which is less than count only if
+    // the pool ran out.
+    template<typename NodeFn>
+    size_t allocate_n(size_t count, NodeFn f)
+    {
+        if (count == 0)
+            return 0;
+
+        size_t result;
+        void *node = stack_pop_multiple(count, result);
+
+        if (result < count && reservedBytes_ != 0)
+            growthRequested_.store(true, std::memory_order_relaxed);
+
+        for (size_t i=0; i < result; ++i) {
+            void *next = (i+1 < result) ? node_of_link(node_next(node)) : nullptr; // read link before f() reuses the node
+#if (QW_NODEPOOL_STATS == 1)
+            stats_touch(node);
+#endif
+            f(node);
+            node = next;
+        }
+
+#if (QW_DEBUG_COUNT_NODE_ALLOCATIONS == 1)
+        allocCount_.fetch_add(static_cast<std::int32_t>(result), std::memory_order_relaxed);
+#endif
+#if (QW_NODEPOOL_STATS == 1)
+        stats_shard().allocations.fetch_add(result, std::memory_order_relaxed);
+        if (result < count)
+            stats_shard().exhaustions.fetch_add(1, std::memory_order_relaxed);
+#endif
+        return result;
+    }
+
+    // Allocate up to count nodes into nodes[].
+    size_t allocate_n(void **nodes, size_t count)
+    {
+        return allocate_n(count, [&nodes](void *node) { *nodes++ = node; });
+    }
+
+    // Deallocate the chain of nodes from front through to back (or, if back
+    // is nullptr, through to the last node). The chain is linked by the client:
+    // nextNode(node) must return the node after node, or nullptr at the end of
+    // the chain. nextNode is called exactly once for each node in the chain
+    // before the pool overwrites the node's storage.
+    template<typename NextNodeFn>
+    void deallocate_list(void *front, void *back, NextNodeFn nextNode)
+    {
+        assert(front != nullptr);
+
+        std::int32_t count = 1;
+        void *node = front;
+        void *next = nextNode(node);
+        while (node != back && next != nullptr) {
+            node_next_lvalue(node) = link_of_node(next);
+            node = next;
+            next = nextNode(node);
+            ++count;
+        }
+        assert(back == nullptr || node == back); // back must be reachable from front
+
+#if (QW_DEBUG_COUNT_NODE_ALLOCATIONS == 1)
+        allocCount_.fetch_add(-count, std::memory_order_relaxed);
+#endif
+#if (QW_NODEPOOL_STATS == 1)
+        stats_shard().deallocations.fetch_add(static_cast<std::uint64_t>(count), std::memory_order_relaxed);
+#endif
+        (void)count;
+        stack_push_multiple(front, node);
+        wake_waiters(true);
+    }
+
+    void deallocate_n(void *const *nodes, size_t count)
+    {
+        if (count == 0)
+            return;
+
+        for (size_t i=0; i < count-1; ++i)
+            node_next_lvalue(nodes[i]) = link_of_node(nodes[i+1]);
+
+#if (QW_DEBUG_COUNT_NODE_ALLOCATIONS == 1)
+        allocCount_.fetch_add(-static_cast<std::int32_t>(count), std::memory_order_relaxed);
+#endif
+#if (QW_NODEPOOL_STATS == 1)
+        stats_shard().deallocations.fetch_add(count, std::memory_order_relaxed);
+#endif
+        stack_push_multiple(nodes[0], nodes[count-1]);
+        wake_waiters(true);
     }
 };
 
@@ -249,10 +950,28 @@ public:
 
     typedef NodeT node_type;
 
-    QwNodePool(size_t maxNodes)
-        : rawPool_(sizeof(NodeT), maxNodes)
+    QwNodePool(size_t maxNodes, QwRawNodePool::NodeStride stride=QwRawNodePool::POWER_OF_TWO_STRIDE,
+            int storagePolicy=QwRawNodePool::DEFAULT_STORAGE)
+        : rawPool_(sizeof(NodeT), maxNodes, stride, storagePolicy)
     {}
 
+    // Expandable pool. See QwRawNodePool.
+    QwNodePool(size_t maxNodes, size_t initialNodes, size_t segmentNodes,
+            QwRawNodePool::NodeStride stride=QwRawNodePool::POWER_OF_TWO_STRIDE,
+            int storagePolicy=QwRawNodePool::DEFAULT_STORAGE)
+        : rawPool_(sizeof(NodeT), maxNodes, initialNodes, segmentNodes, stride, storagePolicy)
+    {}
+
+    size_t grow() { return rawPool_.grow(); }
+    bool growth_requested() const { return rawPool_.growth_requested(); }
+    size_t capacity() const { return rawPool_.capacity(); }
+    size_t max_capacity() const { return rawPool_.max_capacity(); }
+    size_t node_stride() const { return rawPool_.node_stride(); }
+    QwRawNodePool::StorageInfo storage_info() const { return rawPool_.storage_info(); }
+    QwRawNodePool::Stats stats() const { return rawPool_.stats(); }
+
+    QwRawNodePool& raw_pool() { return rawPool_; }
+
     node_type *allocate()
     {
         void *p = rawPool_.allocate();
@@ -265,11 +984,56 @@ public:
         return new (p) node_type();
     }
 
+    // See QwRawNodePool::allocate_wait()
+    node_type *allocate_wait(std::chrono::nanoseconds timeout)
+    {
+        void *p = rawPool_.allocate_wait(timeout);
+        if (!p)
+            return nullptr;
+        return new (p) node_type(); // (See BUG note in allocate())
+    }
+
     void deallocate(node_type *p)
     {
         p->~node_type();
         rawPool_.deallocate(p);
     }
+
+    // Allocate up to count nodes using a single CAS on the freelist. Each node
+    // is constructed and pushed onto the front of result (e.g. a QwSList).
+    // Returns the number of nodes allocated, which is less than count only if
+    // the pool ran out.
+    template<typename ListT>
+    size_t allocate_n(size_t count, ListT& result)
+    {
+        return rawPool_.allocate_n(count, [&result](void *p) {
+            result.push_front(new (p) node_type()); // (See BUG note in allocate())
+        });
+    }
+
+    // Deallocate a chain of nodes linked through links_[NEXT_LINK_INDEX] from
+    // front through to back (or to the end of the chain if back is nullptr),
+    // using a single CAS on the freelist.
+    // Like QwMpmcPopAllLifoStack::push_multiple(), but nodes are destroyed.
+    template<int NEXT_LINK_INDEX>
+    void deallocate_list(node_type *front, node_type *back)
+    {
+        typedef QwLinkTraits<node_type*, NEXT_LINK_INDEX> nextlink;
+        rawPool_.deallocate_list(front, back, [](void *p) -> void* {
+            node_type *n = static_cast<node_type*>(p);
+            node_type *next = nextlink::load(n);
+            n->~node_type();
+            return next;
+        });
+    }
+
+    // Deallocate all nodes in list using a single CAS. list is left empty.
+    template<int NEXT_LINK_INDEX>
+    void deallocate_list(QwSList<node_type*, NEXT_LINK_INDEX>& list)
+    {
+        if (!list.empty())
+            deallocate_list<NEXT_LINK_INDEX>(list.release(), nullptr);
+    }
 };
 
 #endif /* INCLUDED_QWNODEPOOL_H */
@@ -0,0 +1,159 @@
+/*
+    Queue World is copyright (c) 2014-2018 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#ifndef INCLUDED_QWNODEPOOLMAGAZINE_H
+#define INCLUDED_QWNODEPOOLMAGAZINE_H
+
+#include <algorithm> // copy
+#include <cassert>
+#include <cstddef> // size_t
+#include <new> // placement new
+
+#include "QwConfig.h"
+#include "QwNodePool.h"
+
+/*
+    QwRawNodePoolMagazine is a per-thread cache ("magazine") of free nodes
+    that sits in front of a QwRawNodePool.
+
+    Each magazine holds a fixed-size stash of up to CAPACITY free nodes.
+    allocate() and deallocate() operate on the stash without touching the
+    shared freelist. When the stash runs dry it is refilled with CAPACITY/2
+    nodes, and when it overflows CAPACITY/2 nodes are flushed back, in each
+    case using a single batch operation on the shared freelist. Hence
+    a balanced allocate/deallocate pattern never touches the pool's
+    top-of-stack cache line.
+
+    A magazine is not thread safe. It must only be used by the thread that
+    owns it. Typically each worker thread declares one on its stack, or as
+    a thread_local. Nodes allocated from one thread's magazine may be
+    deallocated into another thread's magazine, or directly into the pool.
+
+    Real-time use: allocate() and deallocate() are O(CAPACITY) worst case
+    and are lock-free (as are QwRawNodePool's operations). Nodes held in a
+    magazine are not available to other threads. Call flush() to return the
+    stash to the pool, e.g. when a real-time thread shuts down. The
+    destructor also calls flush().
+
+    Note that a magazine may cause allocate() to fail on one thread while
+    free nodes are stashed in another thread's magazine. Size the pool to
+    account for (thread count * CAPACITY) stashed nodes.
+
+    See:
+    Jeff Bonwick, Jonathan Adams,
+    "Magazines and Vmem: Extending the Slab Allocator to Many CPUs and Arbitrary Resources"
+    USENIX 2001 Annual Technical Conference.
+*/
+
+template<std::size_t CAPACITY>
+class QwRawNodePoolMagazine {
+    static_assert(CAPACITY >= 2, "QwRawNodePoolMagazine CAPACITY must be at least 2");
+
+    enum { BATCH_SIZE = CAPACITY / 2 };
+
+    QwRawNodePool& pool_;
+    std::size_t count_; // number of nodes in nodes_
+    void *nodes_[CAPACITY]; // stack of free nodes. nodes_[count_-1] is the most recently deallocated
+
+    QwRawNodePoolMagazine(const QwRawNodePoolMagazine&) = delete;
+    QwRawNodePoolMagazine& operator=(const QwRawNodePoolMagazine&) = delete;
+
+public:
+    explicit QwRawNodePoolMagazine(QwRawNodePool& pool)
+        : pool_(pool)
+        , count_(0)
+    {}
+
+    ~QwRawNodePoolMagazine()
+    {
+        flush();
+    }
+
+    void *allocate()
+    {
+        if (count_ == 0) {
+            count_ = pool_.allocate_n(nodes_, BATCH_SIZE);
+            if (count_ == 0)
+                return nullptr; // pool is exhausted
+        }
+
+        return nodes_[--count_];
+    }
+
+    void deallocate(void *node)
+    {
+        assert(node != nullptr);
+
+        if (count_ == CAPACITY) {
+            // Flush the least recently deallocated nodes, retain the most recent (cache hot) nodes.
+            pool_.deallocate_n(nodes_, BATCH_SIZE);
+            std::copy(nodes_ + BATCH_SIZE, nodes_ + CAPACITY, nodes_);
+            count_ -= BATCH_SIZE;
+        }
+
+        nodes_[count_++] = node;
+    }
+
+    // Return all stashed nodes to the pool.
+    void flush()
+    {
+        pool_.deallocate_n(nodes_, count_);
+        count_ = 0;
+    }
+
+    std::size_t size() const { return count_; }
+    static std::size_t capacity() { return CAPACITY; }
+};
+
+
+template<typename NodeT, std::size_t CAPACITY>
+class QwNodePoolMagazine {
+    QwRawNodePoolMagazine<CAPACITY> rawMagazine_;
+public:
+
+    typedef NodeT node_type;
+
+    explicit QwNodePoolMagazine(QwNodePool<NodeT>& pool)
+        : rawMagazine_(pool.raw_pool())
+    {}
+
+    node_type *allocate()
+    {
+        void *p = rawMagazine_.allocate();
+        if (!p)
+            return nullptr;
+        // (See note about placement new in QwNodePool::allocate())
+        return new (p) node_type();
+    }
+
+    void deallocate(node_type *p)
+    {
+        p->~node_type();
+        rawMagazine_.deallocate(p);
+    }
+
+    void flush() { rawMagazine_.flush(); }
+
+    std::size_t size() const { return rawMagazine_.size(); }
+    static std::size_t capacity() { return CAPACITY; }
+};
+
+#endif /* INCLUDED_QWNODEPOOLMAGAZINE_H */
@@ -0,0 +1,76 @@
+/*
+    Queue World is copyright (c) 2014-2018 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#ifndef INCLUDED_QWNUMATOPOLOGY_H
+#define INCLUDED_QWNUMATOPOLOGY_H
+
+#include <cstddef> // size_t
+#include <string>
+#include <vector>
+
+/*
+    QwNumaTopology describes the NUMA nodes of the machine and the CPUs
+    that belong to each node. It is used by QwShardedNodePool.
+
+    On Linux the topology is read from <sysfsRoot>/devices/system/node/node<N>/cpulist.
+    sysfsRoot defaults to "/sys", but can point to a directory containing
+    a fake topology for testing. If no NUMA information is available (e.g.
+    on other platforms) the machine is treated as a single node containing
+    all CPUs.
+
+    NUMA nodes are identified by a dense index in [0, node_count()).
+    node_id() maps an index back to the (possibly sparse) system node id.
+
+    Construction reads files and allocates memory. Do not construct
+    QwNumaTopology on real-time threads.
+*/
+
+class QwNumaTopology {
+    std::vector<int> nodeIds_;              // system node id of each node
+    std::vector< std::vector<int> > nodeCpus_; // cpus of each node
+    std::vector<size_t> cpuNodes_;          // node index of each cpu
+
+    void add_node(int nodeId, const std::vector<int>& cpus);
+    void init_single_node();
+
+public:
+    explicit QwNumaTopology(const std::string& sysfsRoot="/sys");
+
+    size_t node_count() const { return nodeIds_.size(); }
+    int node_id(size_t node) const { return nodeIds_[node]; }
+    const std::vector<int>& node_cpus(size_t node) const { return nodeCpus_[node]; }
+
+    // Node index of cpu. Returns 0 for unknown cpus.
+    size_t node_of_cpu(int cpu) const
+    {
+        return (cpu >= 0 && static_cast<size_t>(cpu) < cpuNodes_.size()) ? cpuNodes_[cpu] : 0;
+    }
+
+    // Node index of the cpu that the calling thread is currently running on.
+    // (Linux: sched_getcpu(). Otherwise 0.) The thread may migrate at any time,
+    // so the result is only a hint.
+    size_t current_node() const;
+
+    // Parse a Linux cpulist string such as "0-3,8,10-11". Returns false on a syntax error.
+    static bool parse_cpu_list(const std::string& s, std::vector<int>& result);
+};
+
+#endif /* INCLUDED_QWNUMATOPOLOGY_H */
@@ -0,0 +1,102 @@
+/*
+    Queue World is copyright (c) 2014-2018 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#ifndef INCLUDED_QWPOOLMEMORYRESOURCE_H
+#define INCLUDED_QWPOOLMEMORYRESOURCE_H
+
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+
+#include <cstddef> // size_t
+#include <memory_resource>
+
+#include "QwConfig.h"
+#include "QwSizeClassAllocator.h"
+
+/*
+    QwPoolMemoryResource is a std::pmr::memory_resource that allocates from
+    the QwRawNodePool size classes of a QwSizeClassAllocator. It lets
+    std::pmr containers allocate lock-free, without calling malloc, on
+    real-time threads. (A QwSizeClassAllocator with a single class is a
+    memory_resource backed by a single pool.)
+
+    do_allocate(bytes, alignment) returns a cache line aligned block from
+    the smallest class that fits (falling back to larger classes, see
+    QwSizeClassAllocator). Requests that are larger than the largest
+    class, need more than cache line alignment, or find all fitting
+    classes exhausted are delegated to the upstream resource. The default
+    upstream is std::pmr::null_memory_resource(), which throws
+    std::bad_alloc, so by default the resource never touches the heap.
+    Pass std::pmr::new_delete_resource() (for example) to fall back to
+    the heap instead.
+
+    do_deallocate() returns blocks to their class, or to upstream if
+    they were not allocated from the pools.
+
+    do_allocate() and do_deallocate() are thread-safe, and lock-free
+    unless they delegate to a non-lock-free upstream resource. Two
+    resources compare equal only if they are the same object.
+
+    Requires C++17. The header is empty when compiled as C++11/14.
+*/
+
+class QwPoolMemoryResource : public std::pmr::memory_resource {
+    QwSizeClassAllocator& classes_;
+    std::pmr::memory_resource *upstream_;
+
+public:
+    explicit QwPoolMemoryResource(QwSizeClassAllocator& classes,
+            std::pmr::memory_resource *upstream=std::pmr::null_memory_resource())
+        : classes_(classes)
+        , upstream_(upstream) {}
+
+    QwPoolMemoryResource(const QwPoolMemoryResource&) = delete;
+    QwPoolMemoryResource& operator=(const QwPoolMemoryResource&) = delete;
+
+    QwSizeClassAllocator& size_classes() const { return classes_; }
+    std::pmr::memory_resource *upstream_resource() const { return upstream_; }
+
+protected:
+    void *do_allocate(std::size_t bytes, std::size_t alignment) override
+    {
+        if (alignment <= CACHE_LINE_SIZE) {
+            if (void *result = classes_.allocate(bytes))
+                return result;
+        }
+        return upstream_->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void *p, std::size_t bytes, std::size_t alignment) override
+    {
+        if (classes_.owns(p))
+            classes_.deallocate(p);
+        else
+            upstream_->deallocate(p, bytes, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        return this == &other;
+    }
+};
+
+#endif /* C++17 */
+
+#endif /* INCLUDED_QWPOOLMEMORYRESOURCE_H */
@@ -225,6 +225,46 @@ public:
         back_ = n;
     }
 
+    // append the nodes front..back, which are already linked in order. back's link must be nullptr.
+    void push_back_multiple(node_ptr_type front, node_ptr_type back)
+    {
+        CHECK_NODE_IS_UNLINKED(back);
+
+        if (empty()) {
+            front_ = front;
+        } else {
+            nextlink::store(back_, front);
+        }
+
+        back_ = back;
+    }
+
+    // move all nodes from other to the back of this list. O(1)
+    void splice_back(QwSTailList& other)
+    {
+        if (!other.empty()) {
+            node_ptr_type front = other.front_;
+            node_ptr_type back = other.back_;
+            other.front_ = nullptr;
+            other.back_ = nullptr;
+            push_back_multiple(front, back);
+        }
+    }
+
+    // move the nodes from other.front() through last (a node in other) to the back of this list. O(1)
+    void splice_back(QwSTailList& other, node_ptr_type last)
+    {
+        assert(!other.empty());
+
+        node_ptr_type front = other.front_;
+        other.front_ = nextlink::load(last);
+        if (!other.front_)
+            other.back_ = nullptr;
+
+        nextlink::store(last, nullptr);
+        push_back_multiple(front, last);
+    }
+
     void insert_after(node_ptr_type before, node_ptr_type n) // insert n after node before
     {
         assert(before != nullptr);
@@ -0,0 +1,148 @@
+/*
+    Queue World is copyright (c) 2014-2018 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#ifndef INCLUDED_QWSHARDEDNODEPOOL_H
+#define INCLUDED_QWSHARDEDNODEPOOL_H
+
+#include <cassert>
+#include <cstddef> // size_t
+#include <vector>
+
+#include "QwNodePool.h"
+#include "QwNumaTopology.h"
+
+/*
+    QwShardedNodePool is a NUMA-aware node pool made of one QwRawNodePool
+    "shard" per NUMA node.
+
+    Each shard's storage is placed on its NUMA node by first touch: the
+    shard is constructed (with PREFAULT_STORAGE) on a temporary thread
+    that is pinned to the node's CPUs. Pinning is best-effort. If it
+    fails, e.g. because the topology is fake, the shard is still usable.
+
+    allocate() prefers the shard of the NUMA node that the calling thread
+    is running on. When the local shard is empty it falls back to the
+    other shards, in index order starting after the local shard.
+    deallocate() returns each node to its home shard, found by address
+    range, so nodes never migrate between shards.
+
+    Allocation and deallocation are lock-free. The cost over QwNodePool
+    is a current-CPU query in allocate(), and a scan of the shard address
+    ranges in deallocate(). Both are cheap for realistic NUMA node counts.
+*/
+
+class QwRawShardedNodePool {
+    QwNumaTopology topology_;
+    std::vector<QwRawNodePool*> shards_; // one per NUMA node
+
+    QwRawShardedNodePool(const QwRawShardedNodePool&) = delete;
+    QwRawShardedNodePool& operator=(const QwRawShardedNodePool&) = delete;
+
+public:
+    // Each of the topology's NUMA nodes gets a shard of maxNodesPerShard nodes.
+    // PREFAULT_STORAGE is always added to storagePolicy.
+    QwRawShardedNodePool(std::size_t nodeSize, std::size_t maxNodesPerShard,
+            const QwNumaTopology& topology=QwNumaTopology(), int storagePolicy=QwRawNodePool::PREFAULT_STORAGE);
+    ~QwRawShardedNodePool();
+
+    const QwNumaTopology& topology() const { return topology_; }
+
+    std::size_t shard_count() const { return shards_.size(); }
+    QwRawNodePool& shard(std::size_t i) { return *shards_[i]; }
+
+    // Index of the shard that owns node
+    std::size_t shard_of(const void *node) const
+    {
+        for (std::size_t i=0; i < shards_.size(); ++i) {
+            if (shards_[i]->owns(node))
+                return i;
+        }
+        assert(false); // node was not allocated from this pool
+        return 0;
+    }
+
+    void *allocate() { return allocate_from(topology_.current_node()); }
+
+    // Allocate from preferredShard, falling back to the other shards in
+    // index order (wrapping around) starting after preferredShard.
+    void *allocate_from(std::size_t preferredShard)
+    {
+        std::size_t count = shards_.size();
+        assert(preferredShard < count);
+        if (void *result = shards_[preferredShard]->allocate())
+            return result;
+
+        for (std::size_t i=1; i < count; ++i) {
+            std::size_t shard = preferredShard + i;
+            if (shard >= count)
+                shard -= count;
+            if (void *result = shards_[shard]->allocate())
+                return result;
+        }
+        return nullptr;
+    }
+
+    // Return node to its home shard
+    void deallocate(void *node)
+    {
+        shards_[shard_of(node)]->deallocate(node);
+    }
+};
+
+
+template<typename NodeT>
+class QwShardedNodePool{
+    QwRawShardedNodePool rawPool_;
+public:
+
+    typedef NodeT node_type;
+
+    explicit QwShardedNodePool(std::size_t maxNodesPerShard, const QwNumaTopology& topology=QwNumaTopology(),
+            int storagePolicy=QwRawNodePool::PREFAULT_STORAGE)
+        : rawPool_(sizeof(NodeT), maxNodesPerShard, topology, storagePolicy)
+    {}
+
+    const QwNumaTopology& topology() const { return rawPool_.topology(); }
+    std::size_t shard_count() const { return rawPool_.shard_count(); }
+    std::size_t shard_of(const node_type *node) const { return rawPool_.shard_of(node); }
+
+    QwRawShardedNodePool& raw_pool() { return rawPool_; }
+
+    node_type *allocate()
+    {
+        void *p = rawPool_.allocate();
+        return (p) ? new (p) node_type() : nullptr; // (See BUG note in QwNodePool::allocate())
+    }
+
+    node_type *allocate_from(std::size_t preferredShard)
+    {
+        void *p = rawPool_.allocate_from(preferredShard);
+        return (p) ? new (p) node_type() : nullptr;
+    }
+
+    void deallocate(node_type *p)
+    {
+        p->~node_type();
+        rawPool_.deallocate(p);
+    }
+};
+
+#endif /* INCLUDED_QWSHARDEDNODEPOOL_H */
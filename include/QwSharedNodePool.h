@@ -0,0 +1,226 @@
+/*
+    Queue World is copyright (c) 2014-2018 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#ifndef INCLUDED_QWSHAREDNODEPOOL_H
+#define INCLUDED_QWSHAREDNODEPOOL_H
+
+#include <atomic>
+#include <cassert>
+#include <cstddef> // size_t
+#include <cstdint>
+
+#include "QwConfig.h"
+
+/*
+    QwSharedNodePool is a lock-free pool of fixed-size nodes that lives in
+    shared memory, so that several processes can allocate and deallocate
+    nodes from the same pool. This allows zero-copy message passing between
+    processes: a producer fills a node and passes its handle to a consumer
+    in another process (through any channel), and the consumer deallocates
+    it when done.
+
+    The freelist algorithm is the same as QwRawNodePool ("IBM Freelist" with
+    (count, index) tagged pointers packed into 64 bits). The pool header,
+    including the freelist top, is stored at the start of the mapping,
+    followed by the node array. Since each process may map the pool at a
+    different address, nodes are identified by handles (1-based node
+    indices) rather than pointers. Free nodes link to each other by index,
+    so the mapping is position independent. Use node() and handle_of() to
+    convert between handles and pointers in the current process.
+
+    Node sizes are rounded up to a power of two (at least CACHE_LINE_SIZE),
+    and nodes are cache line aligned.
+
+    Creating and attaching:
+
+      - Named pools use POSIX shm_open() (or a named file mapping on
+        Windows). One process creates the pool, others attach by name.
+        The name remains until unlink() is called (POSIX), or until the
+        last process closes the pool (Windows).
+
+      - Anonymous pools (POSIX only) use memfd_create() on Linux (elsewhere,
+        a shm_open() name that is unlinked immediately). Other processes
+        attach using the file descriptor, which can be inherited by fork()
+        or passed over a Unix domain socket (SCM_RIGHTS).
+
+    Attaching validates the pool header, and fails if the pool has not
+    finished initialization. Check is_open() after construction.
+
+    Caveat: a process that exits while holding nodes leaks them. The
+    freelist itself stays consistent if a process is killed at any point,
+    since it is only modified by single CAS operations.
+
+    Construction and destruction are not real-time safe. allocate(),
+    deallocate(), node() and handle_of() are.
+*/
+
+namespace Qw {
+namespace impl {
+
+    // Layout of the start of a shared pool mapping. Must be address-free,
+    // hence no pointers, and lock-free atomics only.
+    struct SharedNodePoolHeader {
+        std::atomic<std::uint64_t> magic; // SHARED_NODE_POOL_MAGIC once the pool is initialized
+        std::uint64_t nodeStride;
+        std::uint64_t nodeCount;
+        std::uint64_t nodeArrayOffset;    // from the start of the mapping
+        std::uint64_t indexMask;
+        alignas(CACHE_LINE_SIZE) std::atomic<std::uint64_t> top; // (count, index) tagged pointer. own cache line
+        std::int8_t padding[CACHE_LINE_SIZE - sizeof(std::atomic<std::uint64_t>)];
+    };
+
+} } // end namespace Qw::impl
+
+class QwSharedNodePool {
+public:
+    typedef std::uint64_t handle_type; // 1-based node index. 0 is the null handle
+
+    static handle_type null_handle() { return 0; }
+
+private:
+    using size_t = std::size_t;
+    using int8_t = std::int8_t;
+    using ptrdiff_t = std::ptrdiff_t;
+
+    typedef std::uint64_t abapointer_type; // (node-index, aba-count)
+    typedef abapointer_type abacount_type;
+
+    static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "QwSharedNodePool requires address-free (lock-free) 64-bit atomics");
+
+    Qw::impl::SharedNodePoolHeader *header_; // start of the mapping. nullptr if !is_open()
+    size_t mappedBytes_;
+#ifdef _WIN32
+    void *mappingHandle_;
+#else
+    int fd_;
+#endif
+
+    // geometry, copied from the header when the pool is opened
+    int8_t *nodeArrayBase_;     // base ptr indexed by handles. 1-based. nodeArrayBase_[0] should not be dereferenced
+    size_t nodeSize_;
+    int8_t nodeBitShift_;       // index=(ptr-nodeArrayBase_)>>nodeBitShift_
+    size_t maxNodeIndex_;
+    abapointer_type indexMask_;
+    abapointer_type countMask_;
+    abacount_type countIncrement_;
+
+    QwSharedNodePool(const QwSharedNodePool&) = delete;
+    QwSharedNodePool& operator=(const QwSharedNodePool&) = delete;
+
+    // When stored on the freelist, each node contains the handle of the next node at the start
+    handle_type& node_next_lvalue(void *node) const { return *static_cast<handle_type*>(node); }
+    handle_type node_next(void *node) const { return *static_cast<handle_type*>(node); }
+
+    void init_closed();
+    static size_t mapping_bytes_for(size_t nodeStride, size_t nodeCount);
+    bool map(size_t bytes);
+    void create_header(size_t nodeStride, size_t nodeCount);
+    bool attach_header(size_t fileBytes);
+    void open_geometry();
+    void unmap();
+
+public:
+    // Create a named pool of maxNodes nodes. Fails if the name already exists.
+    // On POSIX, name should have the form "/name".
+    QwSharedNodePool(const char *name, size_t nodeSize, size_t maxNodes);
+
+    // Attach to an existing named pool.
+    explicit QwSharedNodePool(const char *name);
+
+#ifndef _WIN32
+    // Create an anonymous pool of maxNodes nodes. Share it using fd().
+    QwSharedNodePool(size_t nodeSize, size_t maxNodes);
+
+    // Attach to an existing pool using a file descriptor obtained from another
+    // process's fd(). The descriptor is duplicated, the caller keeps ownership of fd.
+    explicit QwSharedNodePool(int fd);
+
+    // The file descriptor of the shared memory object. -1 if !is_open()
+    int fd() const { return fd_; }
+#endif
+
+    ~QwSharedNodePool();
+
+    // Remove a pool name, so that no more processes can attach to it. Existing
+    // mappings remain valid. (On Windows the name disappears with its last user,
+    // and unlink() does nothing.)
+    static bool unlink(const char *name);
+
+    // false if creating or attaching failed
+    bool is_open() const { return header_ != nullptr; }
+
+    size_t capacity() const { return maxNodeIndex_; }
+
+    // distance in bytes between adjacent nodes. at least the requested node size
+    size_t node_stride() const { return nodeSize_; }
+
+    // The node stride of a pool created with the given nodeSize
+    static size_t node_stride_for(size_t nodeSize);
+
+    // convert a handle to a pointer in this process's mapping
+    void *node(handle_type handle) const
+    {
+        assert(handle != null_handle() && handle <= maxNodeIndex_);
+        return nodeArrayBase_ + (static_cast<ptrdiff_t>(handle) << nodeBitShift_);
+    }
+
+    // convert a pointer in this process's mapping to a handle
+    handle_type handle_of(const void *node) const
+    {
+        handle_type result = static_cast<handle_type>(
+                static_cast<size_t>(static_cast<const int8_t*>(node) - nodeArrayBase_) >> nodeBitShift_);
+        assert(result != null_handle() && result <= maxNodeIndex_); // node is not in this pool
+        return result;
+    }
+
+    // Returns null_handle() if the pool is empty
+    handle_type allocate()
+    {
+        // See QwRawNodePool::stack_pop(), including the note about non-atomic next links
+        std::atomic<std::uint64_t>& top_ = header_->top;
+        abapointer_type top = top_.load(std::memory_order_seq_cst); // Read top (explicitly fenced below)
+        handle_type handle;
+        do {
+            std::atomic_thread_fence(std::memory_order_acquire); // Acquire top.next, read below.
+            handle = static_cast<handle_type>(top & indexMask_);
+            if (handle == null_handle())
+                return null_handle();
+        } while (top_.compare_exchange_strong(top,
+                node_next(node(handle)) | (((top & countMask_) + countIncrement_) & countMask_),
+                std::memory_order_relaxed, std::memory_order_relaxed) == false);
+        return handle;
+    }
+
+    void deallocate(handle_type handle)
+    {
+        void *n = node(handle);
+        std::atomic<std::uint64_t>& top_ = header_->top;
+        abapointer_type top = top_.load(std::memory_order_relaxed);
+        do {
+            node_next_lvalue(n) = static_cast<handle_type>(top & indexMask_);
+        } while (top_.compare_exchange_strong(top,
+                handle | (((top & countMask_) + countIncrement_) & countMask_),
+                std::memory_order_release, // (Ensure next link is visible to consumers)
+                std::memory_order_relaxed) == false);
+    }
+};
+
+#endif /* INCLUDED_QWSHAREDNODEPOOL_H */
@@ -0,0 +1,121 @@
+/*
+    Queue World is copyright (c) 2014-2018 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#ifndef INCLUDED_QWSIZECLASSALLOCATOR_H
+#define INCLUDED_QWSIZECLASSALLOCATOR_H
+
+#include <cassert>
+#include <cstddef> // size_t
+#include <cstdint>
+
+#include "QwNodePool.h"
+
+/*
+    QwSizeClassAllocator is a lock-free, real-time safe allocator for
+    variable-sized blocks (e.g. messages), built from one QwRawNodePool
+    per size class (e.g. 64, 128, 256, 512, 1024 and 4096 bytes).
+
+    allocate(bytes) allocates from the smallest class that fits. If that
+    class is exhausted, it falls back to the next larger classes.
+    deallocate(p) returns p to the class it was allocated from.
+
+    All classes share a single virtual memory reservation that is divided
+    into equal, power-of-two sized arenas, one per class. Each class's
+    pool uses the start of its arena. So the class of any block is found
+    in O(1) from its address: (p - base) >> arenaShift.
+
+    Blocks are cache line aligned. Class sizes are rounded up to a multiple
+    of the cache line size (pools use QwRawNodePool::CACHE_LINE_STRIDE).
+
+    Construction and destruction are not real-time safe.
+*/
+
+class QwSizeClassAllocator {
+    using size_t = std::size_t;
+    using int8_t = std::int8_t;
+
+    enum { MAX_CLASS_COUNT = 16 };
+
+    int8_t *storage_;           // reservation containing classCount_ arenas
+    size_t reservedBytes_;
+    int arenaShift_;            // arena i is [storage_ + (i << arenaShift_), storage_ + ((i+1) << arenaShift_))
+    size_t classCount_;
+    size_t classSizes_[MAX_CLASS_COUNT];    // block size of each class
+    QwRawNodePool *pools_[MAX_CLASS_COUNT];
+
+    QwSizeClassAllocator(const QwSizeClassAllocator&) = delete;
+    QwSizeClassAllocator& operator=(const QwSizeClassAllocator&) = delete;
+
+public:
+    // classSizes must be in ascending order. Class i holds classBlockCounts[i] blocks.
+    QwSizeClassAllocator(const size_t *classSizes, const size_t *classBlockCounts, size_t classCount);
+    ~QwSizeClassAllocator();
+
+    size_t class_count() const { return classCount_; }
+
+    // Largest allocation served by class i. At least the size requested at construction.
+    size_t class_size(size_t i) const { return classSizes_[i]; }
+
+    QwRawNodePool& class_pool(size_t i) { return *pools_[i]; }
+
+    // Index of the smallest class that can hold bytes, or class_count() if bytes is too large.
+    size_t class_for_size(size_t bytes) const
+    {
+        size_t i = 0;
+        while (i < classCount_ && classSizes_[i] < bytes) // (classes are few, a linear scan is fine)
+            ++i;
+        return i;
+    }
+
+    // True if p lies within this allocator's reservation (i.e. could have been allocated from it).
+    bool owns(const void *p) const
+    {
+        std::uintptr_t offset = reinterpret_cast<std::uintptr_t>(p) - reinterpret_cast<std::uintptr_t>(storage_);
+        return offset < (static_cast<std::uintptr_t>(classCount_) << arenaShift_);
+    }
+
+    // Class that p was allocated from. O(1).
+    size_t class_of(const void *p) const
+    {
+        std::uintptr_t offset = reinterpret_cast<std::uintptr_t>(p) - reinterpret_cast<std::uintptr_t>(storage_);
+        size_t result = static_cast<size_t>(offset >> arenaShift_);
+        assert(result < classCount_); // p was not allocated from this allocator
+        return result;
+    }
+
+    // Returns nullptr if bytes is larger than the largest class, or if
+    // the fitting class and all larger classes are exhausted.
+    void *allocate(size_t bytes)
+    {
+        for (size_t i = class_for_size(bytes); i < classCount_; ++i) {
+            if (void *result = pools_[i]->allocate())
+                return result;
+        }
+        return nullptr;
+    }
+
+    void deallocate(void *p)
+    {
+        pools_[class_of(p)]->deallocate(p);
+    }
+};
+
+#endif /* INCLUDED_QWSIZECLASSALLOCATOR_H */
@@ -0,0 +1,242 @@
+/*
+    Queue World is copyright (c) 2014-2018 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#ifndef INCLUDED_QWSPSCBOUNDEDQUEUE_H
+#define INCLUDED_QWSPSCBOUNDEDQUEUE_H
+
+#include <atomic>
+#include <cassert>
+#include <cstddef> // size_t
+#include <cstdint>
+#include <utility> // move
+
+#include "QwConfig.h"
+
+/*
+    QwSpscBoundedQueue<T> is a wait-free, bounded, single-producer
+    single-consumer FIFO queue of values of type T, stored in a
+    preallocated ring buffer.
+
+    Producer operations: try_push(), push_n(), reserve_push(), commit_push()
+    Consumer operations: try_pop(), pop_n(), reserve_pop(), commit_pop()
+
+    There must be only one producer thread and one consumer thread.
+
+    Use this instead of QwMpscFifoQueue for point-to-point links with a
+    single producer (e.g. audio thread to disk writer): there is no CAS,
+    no reversal pass and no node allocation. Like QwMpmcBoundedQueue, the
+    queue is not intrusive: values are copied in and out. T must be
+    default constructible and copy (or move) assignable.
+
+    Implemented as a Lamport ring buffer: the producer owns the write
+    position and the consumer owns the read position. Each side publishes
+    its position with a release store, and reads the other side's position
+    with an acquire load. See ALGORITHMS.txt
+
+    To avoid a cache miss on every operation, each side keeps a cached
+    copy of the other side's position on its own cache line, and only
+    reloads the shared position when the cached value indicates that the
+    queue is full (producer) or empty (consumer).
+
+    Zero-copy access: reserve_push() returns a pointer to a contiguous span
+    of free slots, which the producer fills in place and then publishes
+    with commit_push(). reserve_pop() and commit_pop() do the same for the
+    consumer. Spans never wrap around the end of the ring, so a request
+    may return fewer slots than are available; reserve again after
+    committing to get the remainder.
+
+    Real-time safety: the constructor allocates the ring. All other
+    operations are wait-free and never allocate.
+
+    The capacity is rounded up to a power of two.
+*/
+
+template<typename T>
+class QwSpscBoundedQueue {
+    std::int8_t padding1_[CACHE_LINE_SIZE]; // avoid false sharing
+    T *const buffer_;
+    const std::size_t mask_;
+    std::int8_t padding2_[CACHE_LINE_SIZE]; // avoid false sharing
+
+    // producer
+    std::atomic<std::size_t> writePos_;
+    std::size_t cachedReadPos_; // producer's copy of readPos_
+    std::int8_t padding3_[CACHE_LINE_SIZE]; // avoid false sharing
+
+    // consumer
+    std::atomic<std::size_t> readPos_;
+    std::size_t cachedWritePos_; // consumer's copy of writePos_
+    std::int8_t padding4_[CACHE_LINE_SIZE]; // avoid false sharing
+
+    QwSpscBoundedQueue(const QwSpscBoundedQueue&) = delete;
+    QwSpscBoundedQueue& operator=(const QwSpscBoundedQueue&) = delete;
+
+    static std::size_t round_up_to_power_of_two(std::size_t x)
+    {
+        std::size_t result = 2;
+        while (result < x)
+            result <<= 1;
+        return result;
+    }
+
+    // Producer: number of free slots, reloading readPos_ if fewer than wanted are known to be free
+    std::size_t producer_free(std::size_t writePos, std::size_t wanted)
+    {
+        std::size_t free = capacity() - (writePos - cachedReadPos_);
+        if (free < wanted) {
+            cachedReadPos_ = readPos_.load(std::memory_order_acquire); // (acquire: the consumer has finished with the slots)
+            free = capacity() - (writePos - cachedReadPos_);
+        }
+        return free;
+    }
+
+    // Consumer: number of filled slots, reloading writePos_ if fewer than wanted are known to be filled
+    std::size_t consumer_filled(std::size_t readPos, std::size_t wanted)
+    {
+        std::size_t filled = cachedWritePos_ - readPos;
+        if (filled < wanted) {
+            cachedWritePos_ = writePos_.load(std::memory_order_acquire); // (acquire: the producer has written the slots)
+            filled = cachedWritePos_ - readPos;
+        }
+        return filled;
+    }
+
+public:
+    explicit QwSpscBoundedQueue(std::size_t capacity)
+        : buffer_(new T[round_up_to_power_of_two(capacity)])
+        , mask_(round_up_to_power_of_two(capacity) - 1)
+        , writePos_(0)
+        , cachedReadPos_(0)
+        , readPos_(0)
+        , cachedWritePos_(0)
+    {
+    }
+
+    ~QwSpscBoundedQueue()
+    {
+        delete [] buffer_;
+    }
+
+    std::size_t capacity() const { return mask_ + 1; }
+
+    // producer operations ---------------------------------------------------
+
+    // Returns false if the queue is full
+    bool try_push(const T& value)
+    {
+        std::size_t writePos = writePos_.load(std::memory_order_relaxed);
+        if (producer_free(writePos, 1) == 0)
+            return false;
+        buffer_[writePos & mask_] = value;
+        writePos_.store(writePos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Push values[0..count) in order, or as many as there is room for.
+    // Returns the number pushed.
+    std::size_t push_n(const T *values, std::size_t count)
+    {
+        std::size_t writePos = writePos_.load(std::memory_order_relaxed);
+        std::size_t free = producer_free(writePos, count);
+        std::size_t n = (count < free) ? count : free;
+        for (std::size_t i=0; i < n; ++i)
+            buffer_[(writePos + i) & mask_] = values[i];
+        writePos_.store(writePos + n, std::memory_order_release);
+        return n;
+    }
+
+    // Returns a pointer to a contiguous span of free slots, of length
+    // count, which is at most the requested count. Returns nullptr (and
+    // count == 0) if the queue is full. Fill the slots, then call commit_push().
+    T* reserve_push(std::size_t& count)
+    {
+        std::size_t writePos = writePos_.load(std::memory_order_relaxed);
+        std::size_t index = writePos & mask_;
+        std::size_t contiguous = capacity() - index;
+        std::size_t wanted = (count < contiguous) ? count : contiguous;
+        std::size_t free = producer_free(writePos, wanted);
+        count = (wanted < free) ? wanted : free;
+        return (count > 0) ? &buffer_[index] : nullptr;
+    }
+
+    // Publish the first n slots of the span returned by reserve_push()
+    void commit_push(std::size_t n)
+    {
+        std::size_t writePos = writePos_.load(std::memory_order_relaxed);
+        assert(n <= capacity() - (writePos - cachedReadPos_));
+        writePos_.store(writePos + n, std::memory_order_release);
+    }
+
+    // consumer operations ---------------------------------------------------
+
+    // Returns false if the queue is empty
+    bool try_pop(T& result)
+    {
+        std::size_t readPos = readPos_.load(std::memory_order_relaxed);
+        if (consumer_filled(readPos, 1) == 0)
+            return false;
+        result = std::move(buffer_[readPos & mask_]);
+        readPos_.store(readPos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Pop up to count values into result[0..count). Returns the number popped.
+    std::size_t pop_n(T *result, std::size_t count)
+    {
+        std::size_t readPos = readPos_.load(std::memory_order_relaxed);
+        std::size_t filled = consumer_filled(readPos, count);
+        std::size_t n = (count < filled) ? count : filled;
+        for (std::size_t i=0; i < n; ++i)
+            result[i] = std::move(buffer_[(readPos + i) & mask_]);
+        readPos_.store(readPos + n, std::memory_order_release);
+        return n;
+    }
+
+    // Returns a pointer to a contiguous span of filled slots, of length
+    // count, which is at most the requested count. Returns nullptr (and
+    // count == 0) if the queue is empty. Read the slots, then call commit_pop().
+    T* reserve_pop(std::size_t& count)
+    {
+        std::size_t readPos = readPos_.load(std::memory_order_relaxed);
+        std::size_t index = readPos & mask_;
+        std::size_t contiguous = capacity() - index;
+        std::size_t wanted = (count < contiguous) ? count : contiguous;
+        std::size_t filled = consumer_filled(readPos, wanted);
+        count = (wanted < filled) ? wanted : filled;
+        return (count > 0) ? &buffer_[index] : nullptr;
+    }
+
+    // Release the first n slots of the span returned by reserve_pop() to the producer
+    void commit_pop(std::size_t n)
+    {
+        std::size_t readPos = readPos_.load(std::memory_order_relaxed);
+        assert(n <= cachedWritePos_ - readPos);
+        readPos_.store(readPos + n, std::memory_order_release);
+    }
+
+    // Approximate unless called by the consumer
+    bool empty() const
+    {
+        return (writePos_.load(std::memory_order_acquire) == readPos_.load(std::memory_order_relaxed));
+    }
+};
+
+#endif /* INCLUDED_QWSPSCBOUNDEDQUEUE_H */
@@ -0,0 +1,180 @@
+/*
+    Queue World is copyright (c) 2014-2018 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#ifndef INCLUDED_QWSPSCORDEREDRESULTQUEUE_H
+#define INCLUDED_QWSPSCORDEREDRESULTQUEUE_H
+
+#include <atomic>
+#include <cassert>
+#include <cstddef> // size_t
+#ifdef NDEBUG
+#include <cstdlib> // abort
+#endif
+
+#include "QwLinkTraits.h"
+
+
+/*
+    QwSpscOrderedResultQueue is a lock-free concurrent, single-producer
+    single-consumer (SPSC) wait-free FIFO queue.
+
+    It has the same interface as QwSpscUnorderedResultQueue, but results
+    are popped in the order that they were pushed, so clients that need
+    completion order don't need a reordering buffer.
+
+    Used for returning results from a server to a client.
+    We usually instantiate result queues inside Nodes/messages, which is why this is a POD.
+    (So there is no stub node: the queue can't contain a node_type.)
+
+    Producer operations: push()
+    Consumer operations: pop(), expectedResultCount(), incrementExpectedResultCount()
+
+    There may be only one producer and one consumer.
+
+    All operations may be invoked concurrently.
+
+    Algorithm: a linked list with a head pointer and a tail pointer.
+    push() exchanges tail_ with the new node, then links the previous tail
+    to it (or, if the previous tail was nullptr, stores it to head_).
+    pop() follows links from head_. To remove the last node, the consumer
+    clears head_ and CASes tail_ from the node to nullptr, after which the
+    next push() will store to head_. If the CAS fails, a push() is in
+    progress, and the consumer restores head_.
+
+    Caveat: if pop() reaches the last node while a push() is between its
+    exchange and its link store, pop() returns nullptr (even though the
+    last node is complete) rather than waiting for the producer. The next
+    pop() after the push() completes returns it.
+
+    Nodes' NEXT_LINK_INDEX links must be declared as std::atomic, since
+    the producer may write the last node's link while the consumer reads it.
+*/
+
+template<typename NodePtrT, int NEXT_LINK_INDEX>
+class QwSpscOrderedResultQueue{
+    typedef QwLinkTraits<NodePtrT, NEXT_LINK_INDEX> nextlink;
+    static_assert(nextlink::is_atomic, "QwSpscOrderedResultQueue requires atomic next links");
+
+public:
+    typedef typename nextlink::node_type node_type;
+    typedef typename nextlink::node_ptr_type node_ptr_type;
+    typedef typename nextlink::const_node_ptr_type const_node_ptr_type;
+
+private:
+    std::atomic<node_ptr_type> head_; // first node. written by the consumer, and by the producer when the queue was empty
+    std::atomic<node_ptr_type> tail_; // last node. exchanged by the producer, CASed to nullptr by the consumer
+    size_t expectedResultCount_; // consumer increments this when making a request, pop() decrements it
+
+#if (QW_VALIDATE_NODE_LINKS == 1)
+    void CHECK_NODE_IS_UNLINKED(const_node_ptr_type n) const
+    {
+#ifndef NDEBUG
+        assert(nextlink::load(n) == nullptr); // (require unlinked)
+        assert(n != tail_.load(std::memory_order_relaxed));
+        // Note: we can't check that the node is not referenced by some other list
+#else
+        if (!(nextlink::load(n) == nullptr)) { std::abort(); } // (require unlinked)
+        if (!(n != tail_.load(std::memory_order_relaxed))) { std::abort(); }
+#endif
+    }
+
+    void CLEAR_NODE_LINKS_FOR_VALIDATION(node_ptr_type n) const
+    {
+        nextlink::store(n, nullptr);
+    }
+#else
+    void CHECK_NODE_IS_UNLINKED(const_node_ptr_type) const {}
+    void CLEAR_NODE_LINKS_FOR_VALIDATION(node_ptr_type) const {}
+#endif
+
+    node_ptr_type pop_result(node_ptr_type result)
+    {
+        CLEAR_NODE_LINKS_FOR_VALIDATION(result);
+        assert(expectedResultCount_ > 0);
+        --expectedResultCount_;
+        return result;
+    }
+
+public:
+    void init()
+    {
+        std::atomic_init(&head_, static_cast<node_ptr_type>(nullptr)); // NOTE: only valid because head_ and tail_ were default constructed.
+        std::atomic_init(&tail_, static_cast<node_ptr_type>(nullptr));
+        expectedResultCount_ = 0;
+    }
+
+    void push(node_ptr_type node) // called by producer
+    {
+        CHECK_NODE_IS_UNLINKED(node);
+
+        nextlink::atomic_store(node, nullptr, std::memory_order_relaxed);
+
+        // (acquire: if prev is nullptr, the consumer's clearing of head_ happens before our store to head_)
+        node_ptr_type prev = tail_.exchange(node, std::memory_order_acq_rel);
+        if (prev) {
+            nextlink::atomic_store(prev, node, std::memory_order_release); // fence for item data of node
+        } else {
+            head_.store(node, std::memory_order_release); // queue was empty. fence for item data of node
+        }
+    }
+
+    node_ptr_type pop() // called by consumer
+    {
+        node_ptr_type result = head_.load(std::memory_order_acquire);
+        if (result == nullptr)
+            return nullptr; // no items available
+
+        node_ptr_type next = nextlink::atomic_load(result, std::memory_order_acquire);
+        if (next != nullptr) {
+            head_.store(next, std::memory_order_relaxed);
+            return pop_result(result);
+        }
+
+        // result is the last linked node. Try to detach it by clearing tail_.
+        // Clear head_ first, so that it is nullptr before the next push() can store to it.
+        head_.store(nullptr, std::memory_order_relaxed);
+        node_ptr_type expected = result;
+        if (tail_.compare_exchange_strong(expected, static_cast<node_ptr_type>(nullptr),
+                /*success:*/ std::memory_order_acq_rel,
+                /*failure:*/ std::memory_order_relaxed)) {
+            return pop_result(result); // queue is now empty
+        }
+
+        // A push() exchanged tail_ after result, and will link result to its node.
+        // (The producer won't touch head_, since its previous tail was non-null.)
+        head_.store(result, std::memory_order_relaxed);
+        next = nextlink::atomic_load(result, std::memory_order_acquire);
+        if (next != nullptr) {
+            head_.store(next, std::memory_order_relaxed);
+            return pop_result(result);
+        }
+        return nullptr; // the push() hasn't linked yet. (See caveat above.)
+    }
+
+    // expectedResultCount getter and mutator to be called on consumer side only:
+
+    size_t expectedResultCount() const { return expectedResultCount_; }
+
+    void incrementExpectedResultCount() { ++expectedResultCount_; }
+    void incrementExpectedResultCount(size_t k) { expectedResultCount_ += k; }
+};
+
+#endif /* INCLUDED_QWSPSCORDEREDRESULTQUEUE_H */
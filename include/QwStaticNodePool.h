@@ -0,0 +1,223 @@
+/*
+    Queue World is copyright (c) 2014-2018 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#ifndef INCLUDED_QWSTATICNODEPOOL_H
+#define INCLUDED_QWSTATICNODEPOOL_H
+
+#include <atomic>
+#include <cassert>
+#include <cstddef> // size_t
+#include <cstdint>
+#include <new> // placement new
+
+#include "QwConfig.h"
+
+/*
+    QwStaticNodePool<NodeT, N> is a thread-safe, lock-free pool of N nodes
+    of type NodeT, with the same allocate() and deallocate() interface
+    as QwNodePool<NodeT>.
+
+    Unlike QwNodePool, the pool geometry (node size, index mask, count mask
+    and count increment) is computed at compile time from the template
+    parameters, and node storage is a member array. So declaring a
+    QwStaticNodePool with static storage duration (or as a member of such
+    an object) performs no heap allocation. The constructor links the
+    nodes on to the freelist, but never allocates.
+
+    The algorithm is the same as QwRawNodePool: an "IBM Freelist" with
+    (count, index) tagged pointers packed into 64 bits. Since the masks and
+    shifts are constants, the index<->pointer conversions fold into the
+    surrounding code. Node sizes are rounded up to a power of two, and
+    nodes are aligned on cache line boundaries.
+
+    Note: in C++11, operator new does not respect over-aligned types. Use
+    static, global or stack storage, or an allocator that respects
+    alignof(QwStaticNodePool).
+*/
+
+namespace Qw {
+namespace impl {
+
+    constexpr std::size_t static_max(std::size_t a, std::size_t b)
+    {
+        return (a > b) ? a : b;
+    }
+
+    constexpr std::size_t static_round_up_to_power_of_two(std::size_t x, std::size_t p=1)
+    {
+        return (p >= x) ? p : static_round_up_to_power_of_two(x, p << 1);
+    }
+
+    constexpr int static_log2(std::size_t x) // x must be a power of two
+    {
+        return (x <= 1) ? 0 : 1 + static_log2(x >> 1);
+    }
+
+    // Compile-time pool geometry. See QwRawNodePool::init_geometry()
+    template<std::size_t NODE_SIZE, std::size_t N>
+    struct StaticNodePoolGeometry {
+        typedef std::size_t nodeindex_type;
+        typedef std::uint64_t abapointer_type; // (node-index, aba-count)
+
+        static constexpr std::size_t nodeSize = static_round_up_to_power_of_two(
+                static_max(NODE_SIZE, static_max(sizeof(nodeindex_type), CACHE_LINE_SIZE)));
+        static constexpr int nodeBitShift = static_log2(nodeSize);
+
+        // valid node indices are [1, nodeIndexEnd). need an extra bit if N is a power of two
+        static constexpr abapointer_type nodeIndexEnd = static_round_up_to_power_of_two(N + 1);
+
+        static constexpr abapointer_type indexMask = nodeIndexEnd - 1;
+        static constexpr abapointer_type countMask = ~indexMask; // count is in the high part
+        static constexpr abapointer_type countIncrement = nodeIndexEnd;
+    };
+
+} } // end namespace Qw::impl
+
+template<typename NodeT, std::size_t N>
+class QwStaticNodePool {
+    using size_t = std::size_t;
+    using int8_t = std::int8_t;
+
+    typedef Qw::impl::StaticNodePoolGeometry<sizeof(NodeT), N> geometry;
+    typedef typename geometry::nodeindex_type nodeindex_type;
+    typedef typename geometry::abapointer_type abapointer_type;
+    typedef abapointer_type abacount_type;
+
+    static_assert(N > 0, "QwStaticNodePool must contain at least one node");
+    static_assert(N < (static_cast<abapointer_type>(1) << 48), "QwStaticNodePool: too many nodes to leave room for an ABA count");
+
+    enum { NULL_NODE_INDEX=0 };
+
+    alignas(CACHE_LINE_SIZE) std::atomic<abapointer_type> top_; // (own cache line to avoid false sharing with nodes)
+#if (QW_DEBUG_COUNT_NODE_ALLOCATIONS == 1)
+    std::atomic<std::int32_t> allocCount_;
+#endif
+
+    alignas(CACHE_LINE_SIZE) int8_t storage_[geometry::nodeSize * N];
+
+    nodeindex_type ap_index(abapointer_type ptr) const { return static_cast<nodeindex_type>(ptr & geometry::indexMask); }
+    abacount_type ap_count(abapointer_type ptr) const { return static_cast<abacount_type>(ptr & geometry::countMask); }
+
+    abapointer_type make_abapointer(nodeindex_type index, abacount_type count) const {
+        return static_cast<abapointer_type>(index) | (static_cast<abapointer_type>(count)&geometry::countMask);
+    }
+
+    // Node representation: when stored on the stack, each node contains a next index at the start
+
+    nodeindex_type& node_next_lvalue(void *node) { return *static_cast<nodeindex_type*>(node); }
+    nodeindex_type node_next(void *node) const { return *static_cast<nodeindex_type*>(node); }
+
+    // node indices are 1-based. index 0 is the null index
+    nodeindex_type index_of_node(void *node) const
+    {
+        return static_cast<nodeindex_type>((static_cast<const int8_t*>(node) - storage_) >> geometry::nodeBitShift) + 1;
+    }
+
+    void *node_at_index(nodeindex_type index)
+    {
+        return storage_ + ((index - 1) << geometry::nodeBitShift);
+    }
+
+    // The stack algorithms are the same as QwRawNodePool. See comments there.
+
+    void stack_push(void *node)
+    {
+        assert(node != nullptr);
+        nodeindex_type nodeIndex = index_of_node(node);
+
+        abapointer_type top = top_.load(std::memory_order_relaxed);
+        do {
+            node_next_lvalue(node) = ap_index(top);
+        } while (top_.compare_exchange_strong(top, make_abapointer(nodeIndex, ap_count(top)+geometry::countIncrement),
+                /*success:*/ std::memory_order_release,
+                /*failure:*/ std::memory_order_relaxed) == false);
+    }
+
+    void *stack_pop()
+    {
+        abapointer_type top = top_.load(std::memory_order_seq_cst);
+        void *node;
+        do {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            nodeindex_type nodeIndex = ap_index(top);
+            if (nodeIndex==NULL_NODE_INDEX)
+                return nullptr;
+            node = node_at_index(nodeIndex);
+        } while (top_.compare_exchange_strong(top, make_abapointer(node_next(node), ap_count(top)+geometry::countIncrement),
+                /*success:*/ std::memory_order_relaxed,
+                /*failure:*/ std::memory_order_relaxed) == false);
+        // (Same BUG as QwRawNodePool::stack_pop(): node->next is not atomic.)
+        return node;
+    }
+
+public:
+    typedef NodeT node_type;
+
+    QwStaticNodePool()
+#if (QW_DEBUG_COUNT_NODE_ALLOCATIONS == 1)
+        : allocCount_(0)
+#endif
+    {
+        // link all nodes, lowest index at the top of the stack
+        for (nodeindex_type i=1; i < N; ++i)
+            node_next_lvalue(node_at_index(i)) = i + 1;
+        node_next_lvalue(node_at_index(N)) = NULL_NODE_INDEX;
+        top_.store(make_abapointer(1, 0), std::memory_order_relaxed);
+    }
+
+    ~QwStaticNodePool()
+    {
+#if (QW_DEBUG_COUNT_NODE_ALLOCATIONS == 1)
+        assert(allocCount_.load(std::memory_order_relaxed) == 0);
+#endif
+    }
+
+    QwStaticNodePool(const QwStaticNodePool&) = delete;
+    QwStaticNodePool& operator=(const QwStaticNodePool&) = delete;
+
+    static constexpr size_t capacity() { return N; }
+    static constexpr size_t max_capacity() { return N; }
+
+    // distance in bytes between adjacent nodes
+    static constexpr size_t node_stride() { return geometry::nodeSize; }
+
+    node_type *allocate()
+    {
+        void *p = stack_pop();
+        if (!p)
+            return nullptr;
+#if (QW_DEBUG_COUNT_NODE_ALLOCATIONS == 1)
+        allocCount_.fetch_add(1, std::memory_order_relaxed);
+#endif
+        return new (p) node_type(); // (See BUG note in QwNodePool::allocate())
+    }
+
+    void deallocate(node_type *p)
+    {
+        p->~node_type();
+#if (QW_DEBUG_COUNT_NODE_ALLOCATIONS == 1)
+        allocCount_.fetch_add(-1, std::memory_order_relaxed);
+#endif
+        stack_push(p);
+    }
+};
+
+#endif /* INCLUDED_QWSTATICNODEPOOL_H */
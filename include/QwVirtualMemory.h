@@ -0,0 +1,59 @@
+/*
+    Queue World is copyright (c) 2014-2018 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#ifndef INCLUDED_QWVIRTUALMEMORY_H
+#define INCLUDED_QWVIRTUALMEMORY_H
+
+#include <cstddef> // size_t
+
+/*
+    Platform-specific memory allocation used by Queue World pools:
+    aligned heap allocation, and reserving, committing and releasing
+    virtual memory pages (VirtualAlloc on Windows, mmap elsewhere).
+
+    None of these functions are real-time safe.
+*/
+
+void *qw_aligned_malloc(std::size_t size, std::size_t alignment);
+void qw_aligned_free(void *memblock);
+
+std::size_t qw_page_size();
+
+// Reserve address space without committing memory. alignment is a power of two.
+// size should be a multiple of alignment. Returns nullptr on failure.
+void *qw_reserve_pages(std::size_t size, std::size_t alignment);
+
+// Commit (make readable and writable) pages within a reservation. p should be page aligned.
+bool qw_commit_pages(void *p, std::size_t size);
+
+// Release a whole reservation. p and size are as passed to/returned by qw_reserve_pages().
+void qw_release_pages(void *p, std::size_t size);
+
+// Advise that a reservation should be backed by huge pages. Returns false if not supported.
+bool qw_advise_huge_pages(void *p, std::size_t size);
+
+// Lock committed pages in to physical memory. Returns false on failure (e.g. RLIMIT_MEMLOCK).
+bool qw_lock_pages(void *p, std::size_t size);
+
+// Touch each committed page so that later accesses don't page-fault.
+void qw_prefault_pages(void *p, std::size_t size);
+
+#endif /* INCLUDED_QWVIRTUALMEMORY_H */
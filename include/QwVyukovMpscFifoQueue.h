@@ -0,0 +1,151 @@
+/*
+    Queue World is copyright (c) 2014-2018 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#ifndef INCLUDED_QWVYUKOVMPSCFIFOQUEUE_H
+#define INCLUDED_QWVYUKOVMPSCFIFOQUEUE_H
+
+#include <atomic>
+#include <cstdint>
+
+#include "QwConfig.h"
+#include "QwLinkTraits.h"
+
+/*
+    QwVyukovMpscFifoQueue is a concurrent, multiple-producer single-consumer
+    FIFO queue. It shares push(), pop() and consumer_empty() with
+    QwMpscFifoQueue, but is not a drop-in replacement: it has no
+    push(n, wasEmpty), push_multiple(), pop_all(), pop_up_to() or blocking
+    (push_notify(), pop_wait()) operations.
+
+    Producer(s) operations: push()
+    Consumer operations: consumer_empty(), pop().
+
+    There may be multiple producers, but only one consumer.
+
+    All operations may be invoked concurrently.
+
+    Implemented using Dmitry Vyukov's intrusive MPSC node-based queue.
+    See ALGORITHMS.txt
+
+    push() is wait-free: a single atomic exchange of the head pointer,
+    followed by a store to the previous node's link. pop() is O(1): unlike
+    QwMpscFifoQueue, there is no pass that reverses a captured LIFO chain,
+    so consumer latency doesn't spike after a burst of pushes, and each
+    node is touched only once by the consumer.
+
+    The queue embeds a stub node (hence node_type must be default
+    constructible). When the consumer has taken every node but the last,
+    it re-pushes the stub, so the last node can be popped without the
+    queue becoming empty.
+
+    Caveat: the algorithm is not lock-free for the consumer. Between a
+    producer's exchange and its link store, nodes pushed after that
+    producer's node are not reachable. If the producer is preempted in
+    this window, pop() returns nullptr (and consumer_empty() returns
+    false) until it resumes.
+
+    Nodes' NEXT_LINK_INDEX links must be declared as std::atomic, since
+    they are read and written concurrently.
+*/
+
+template<typename NodePtrT, int NEXT_LINK_INDEX>
+class QwVyukovMpscFifoQueue {
+    typedef QwLinkTraits<NodePtrT, NEXT_LINK_INDEX> nextlink;
+    static_assert(nextlink::is_atomic, "QwVyukovMpscFifoQueue requires atomic next links");
+
+public:
+    typedef typename nextlink::node_type node_type;
+    typedef typename nextlink::node_ptr_type node_ptr_type;
+    typedef typename nextlink::const_node_ptr_type const_node_ptr_type;
+
+private:
+    std::int8_t padding1_[CACHE_LINE_SIZE]; // avoid false sharing
+    std::atomic<node_ptr_type> head_; // most recently pushed node. producers exchange
+    std::int8_t padding2_[CACHE_LINE_SIZE]; // avoid false sharing
+    node_ptr_type tail_; // next node to pop, or the stub. consumer only
+    std::int8_t padding3_[CACHE_LINE_SIZE]; // avoid false sharing
+    node_type stub_; // producers link nodes behind the stub after the queue drains, so keep it off tail_'s line
+    std::int8_t padding4_[CACHE_LINE_SIZE]; // avoid false sharing
+
+    QwVyukovMpscFifoQueue(const QwVyukovMpscFifoQueue&) = delete;
+    QwVyukovMpscFifoQueue& operator=(const QwVyukovMpscFifoQueue&) = delete;
+
+public:
+    QwVyukovMpscFifoQueue()
+        : tail_(&stub_)
+    {
+        nextlink::atomic_store(&stub_, nullptr, std::memory_order_relaxed);
+        head_.store(&stub_, std::memory_order_release);
+    }
+
+    void push(node_ptr_type n)
+    {
+        nextlink::atomic_store(n, nullptr, std::memory_order_relaxed);
+        // (acq_rel: release publishes n's null link and payload; acquire
+        // ensures prev's link store below follows the producer that pushed prev)
+        node_ptr_type prev = head_.exchange(n, std::memory_order_acq_rel);
+        // Window: n is not yet reachable from prev. (See caveat above.)
+        nextlink::atomic_store(prev, n, std::memory_order_release);
+    }
+
+    bool consumer_empty() const
+    {
+        // Empty when only the stub remains.
+        return (tail_ == &stub_ && nextlink::atomic_load(&stub_, std::memory_order_acquire) == nullptr);
+    }
+
+    node_ptr_type pop()
+    {
+        node_ptr_type tail = tail_;
+        node_ptr_type next = nextlink::atomic_load(tail, std::memory_order_acquire);
+
+        if (tail == &stub_) {
+            // skip the stub
+            if (next == nullptr)
+                return nullptr; // empty
+            tail_ = next;
+            tail = next;
+            next = nextlink::atomic_load(tail, std::memory_order_acquire);
+        }
+
+        if (next != nullptr) {
+            tail_ = next;
+            return tail;
+        }
+
+        // tail is the last reachable node. It can only be popped if
+        // another node follows it, so that tail_ remains valid.
+        if (tail != head_.load(std::memory_order_acquire))
+            return nullptr; // a producer is between its exchange and its link store
+
+        push(&stub_);
+
+        next = nextlink::atomic_load(tail, std::memory_order_acquire);
+        if (next != nullptr) {
+            tail_ = next;
+            return tail;
+        }
+
+        return nullptr; // a producer pushed after tail, and before the stub, but hasn't linked yet
+    }
+};
+
+#endif /* INCLUDED_QWVYUKOVMPSCFIFOQUEUE_H */
@@ -0,0 +1,147 @@
+/*
+    Queue World is copyright (c) 2014-2018 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#include "QwFutex.h"
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h> // WaitOnAddress
+#pragma comment(lib, "Synchronization.lib")
+#elif defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h> // syscall
+#include <cerrno>
+#include <ctime> // timespec
+#else
+#include <thread> // sleep_for
+#endif
+
+#undef max
+#undef min
+
+#include <algorithm> // min
+
+static_assert(sizeof(std::atomic<std::uint32_t>) == sizeof(std::uint32_t), "futex word must be a plain 32-bit word");
+
+#if defined(_WIN32)
+
+bool qw_futex_wait_for(std::atomic<std::uint32_t> *word, std::uint32_t expected, std::chrono::nanoseconds timeout)
+{
+    if (timeout <= std::chrono::nanoseconds::zero())
+        return false;
+    // round up to whole milliseconds, so that short timeouts still wait
+    DWORD ms = static_cast<DWORD>(std::min<std::chrono::nanoseconds::rep>(
+            (timeout.count() + 999999) / 1000000, INFINITE - 1));
+    if (WaitOnAddress(reinterpret_cast<volatile VOID*>(word), &expected, sizeof(expected), ms))
+        return true;
+    return (GetLastError() != ERROR_TIMEOUT);
+}
+
+void qw_futex_wait(std::atomic<std::uint32_t> *word, std::uint32_t expected)
+{
+    WaitOnAddress(reinterpret_cast<volatile VOID*>(word), &expected, sizeof(expected), INFINITE);
+}
+
+void qw_futex_wake_one(std::atomic<std::uint32_t> *word)
+{
+    WakeByAddressSingle(reinterpret_cast<PVOID>(word));
+}
+
+void qw_futex_wake_all(std::atomic<std::uint32_t> *word)
+{
+    WakeByAddressAll(reinterpret_cast<PVOID>(word));
+}
+
+#elif defined(__linux__)
+
+namespace {
+
+    long futex(std::atomic<std::uint32_t> *word, int op, std::uint32_t val, const struct timespec *timeout)
+    {
+        return syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(word), op, val, timeout, nullptr, 0);
+    }
+
+} // end anonymous namespace
+
+bool qw_futex_wait_for(std::atomic<std::uint32_t> *word, std::uint32_t expected, std::chrono::nanoseconds timeout)
+{
+    if (timeout <= std::chrono::nanoseconds::zero())
+        return false;
+    struct timespec ts;
+    ts.tv_sec = static_cast<time_t>(timeout.count() / 1000000000);
+    ts.tv_nsec = static_cast<long>(timeout.count() % 1000000000);
+    // (FUTEX_WAIT takes a relative timeout)
+    if (futex(word, FUTEX_WAIT_PRIVATE, expected, &ts) == -1 && errno == ETIMEDOUT)
+        return false;
+    return true;
+}
+
+void qw_futex_wait(std::atomic<std::uint32_t> *word, std::uint32_t expected)
+{
+    futex(word, FUTEX_WAIT_PRIVATE, expected, nullptr);
+}
+
+void qw_futex_wake_one(std::atomic<std::uint32_t> *word)
+{
+    futex(word, FUTEX_WAKE_PRIVATE, 1, nullptr);
+}
+
+void qw_futex_wake_all(std::atomic<std::uint32_t> *word)
+{
+    futex(word, FUTEX_WAKE_PRIVATE, static_cast<std::uint32_t>(INT32_MAX), nullptr);
+}
+
+#else /* fallback: poll */
+
+namespace {
+
+    const std::chrono::nanoseconds POLL_INTERVAL = std::chrono::microseconds(100);
+
+} // end anonymous namespace
+
+bool qw_futex_wait_for(std::atomic<std::uint32_t> *word, std::uint32_t expected, std::chrono::nanoseconds timeout)
+{
+    if (timeout <= std::chrono::nanoseconds::zero())
+        return false;
+    if (word->load(std::memory_order_acquire) != expected)
+        return true;
+    std::this_thread::sleep_for(std::min(timeout, POLL_INTERVAL));
+    return (timeout > POLL_INTERVAL || word->load(std::memory_order_acquire) != expected);
+}
+
+void qw_futex_wait(std::atomic<std::uint32_t> *word, std::uint32_t expected)
+{
+    while (word->load(std::memory_order_acquire) == expected)
+        std::this_thread::sleep_for(POLL_INTERVAL);
+}
+
+void qw_futex_wake_one(std::atomic<std::uint32_t> *)
+{
+}
+
+void qw_futex_wake_all(std::atomic<std::uint32_t> *)
+{
+}
+
+#endif
@@ -21,11 +21,13 @@
 */
 #include "QwNodePool.h"
 
-#undef max
-#undef min
-
 #include <algorithm>
 #include <cassert>
+#include <new> // placement new
+#include <thread> // yield
+
+#include "QwFutex.h"
+#include "QwVirtualMemory.h"
 
 using std::size_t;
 
@@ -44,83 +46,261 @@ static size_t roundUpToNextPowerOfTwo(size_t x)
     return x;
 }
 
-#ifdef _WIN32
+// greatest common divisor
+static size_t greatestCommonDivisor(size_t a, size_t b)
+{
+    while (b != 0) {
+        size_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
 
-static void *qw_aligned_malloc(size_t size, size_t alignment)
+// multiplicative inverse of odd x modulo 2^N, where N is the number of bits in size_t.
+// Newton's method: each iteration doubles the number of correct low bits.
+static size_t oddMultiplicativeInverse(size_t x)
 {
-    return _aligned_malloc(size, alignment);
+    assert((x & 1) == 1);
+    size_t result = x; // correct to 3 bits, since x*x == 1 (mod 8) for all odd x
+    for (int i=0; i < 5; ++i) // 3 -> 6 -> 12 -> 24 -> 48 -> 96 bits
+        result *= 2 - x * result;
+    assert(x * result == 1);
+    return result;
 }
 
-static void qw_aligned_free(void *memblock)
+static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024; // x86-64 (and common AArch64) transparent huge page size
+
+
+size_t QwRawNodePool::node_stride_for(size_t nodeSize, NodeStride stride)
 {
-    _aligned_free(memblock);
+    // Align nodes on cache line boundaries to avoid false sharing
+    size_t minNodeSize = sizeof(nodelink_type); // nodes need to be large enough to embed their next ptr
+    nodeSize = std::max(nodeSize, std::max(minNodeSize, CACHE_LINE_SIZE));
+    if (stride == CACHE_LINE_STRIDE || stride == COLOURED_STRIDE) {
+        size_t lineCount = (nodeSize + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE;
+        if (stride == COLOURED_STRIDE && (lineCount & 1) == 0)
+            ++lineCount; // an odd line count is coprime with the (power of two) number of cache sets
+        return lineCount * CACHE_LINE_SIZE;
+    }
+
+    // Make node size a power of two to allow for using bit shift to convert between pointers and indices
+    return roundUpToNextPowerOfTwo(nodeSize);
 }
 
+void QwRawNodePool::init_geometry(size_t nodeSize, size_t maxNodes, NodeStride stride)
+{
+    nodeSize_ = node_stride_for(nodeSize, stride);
+
+    // Split node size into (oddFactor << nodeBitShift_)
+    nodeBitShift_ = 0;
+    size_t oddFactor = nodeSize_;
+    while ((oddFactor & 1) == 0) {
+        oddFactor = oddFactor >> 1;
+        ++nodeBitShift_;
+    }
+    nodeOddFactorInverse_ = oddMultiplicativeInverse(oddFactor); // 1 if node size is a power of two
+
+    maxNodeIndex_ = maxNodes; // since node indices are 1-based, max index is N, not N-1
+
+#if (QW_NODEPOOL_USE_DWCAS == 1)
+    countIncrement_ = 1; // count has its own 64-bit word
 #else
+    assert(sizeof(top_) >= sizeof(abapointer_type));
+
+    // index is stored in the low bits of the packed pointer.
+    // generate a bit mask for it.
+
+    size_t nodeIndexEnd = roundUpToNextPowerOfTwo(maxNodeIndex_); // valid node indices are [1, nodeIndexEnd)
+    if (nodeIndexEnd==maxNodeIndex_) // need an extra bit
+        nodeIndexEnd = nodeIndexEnd << 1;
+    indexMask_ = nodeIndexEnd-1;
+
+    countMask_ = ~indexMask_; // count is in the high part
+    countIncrement_ = nodeIndexEnd;
+#endif
+}
 
-static void *qw_aligned_malloc(size_t size, size_t alignment)
+void QwRawNodePool::init_storage_policy(int storagePolicy)
 {
-    void *result = nullptr;
+    storagePolicy_ = storagePolicy;
+    if (storagePolicy & LOCKED_STORAGE)
+        storagePolicy |= PREFAULT_STORAGE; // locking faults in every page
+    appliedStoragePolicy_.store(storagePolicy, std::memory_order_relaxed);
+
+    storagePageSize_ = qw_page_size();
+    if (storagePolicy & HUGE_PAGE_STORAGE)
+        storagePageSize_ = std::max(storagePageSize_, HUGE_PAGE_SIZE);
+}
 
-    if (posix_memalign(&result, alignment, size)!=0)
-        result = nullptr;
+// Map size bytes (a multiple of storagePageSize_) of storage, aligned to storagePageSize_.
+// If commit is false, only address space is reserved.
+bool QwRawNodePool::map_storage(size_t size, bool commit)
+{
+    nodeStorage_ = (int8_t*)qw_reserve_pages(size, storagePageSize_);
+    if (!nodeStorage_)
+        return false;
+    mappedBytes_ = size;
+
+    // Advise before any page is touched, so that faults allocate huge pages
+    if ((storagePolicy_ & HUGE_PAGE_STORAGE) && !qw_advise_huge_pages(nodeStorage_, size))
+        appliedStoragePolicy_.fetch_and(~HUGE_PAGE_STORAGE, std::memory_order_relaxed);
+
+    if (commit) {
+        if (!qw_commit_pages(nodeStorage_, size))
+            return false;
+        apply_storage_policy(nodeStorage_, size);
+    }
+    return true;
+}
 
-    return result;
+// Apply the pre-fault and lock policies to newly committed storage, before any nodes are linked in to it.
+void QwRawNodePool::apply_storage_policy(void *p, size_t size)
+{
+    if (storagePolicy_ & (PREFAULT_STORAGE | LOCKED_STORAGE))
+        qw_prefault_pages(p, size);
+
+    if ((storagePolicy_ & LOCKED_STORAGE) && !qw_lock_pages(p, size))
+        appliedStoragePolicy_.fetch_and(~LOCKED_STORAGE, std::memory_order_relaxed);
 }
 
-static void qw_aligned_free(void *memblock)
+// Atomically push nodes with indices [firstIndex, firstIndex+count) on to the freelist.
+// The node with the highest index ends up at the top of the stack.
+void QwRawNodePool::push_nodes(size_t firstIndex, size_t count)
 {
-    free(memblock);
+    assert(count > 0);
+    size_t lastIndex = firstIndex + count - 1;
+    for (size_t i=lastIndex; i > firstIndex; --i)
+        node_next_lvalue(node_at_index(i)) = link_of_node(node_at_index(i - 1));
+    stack_push_multiple(node_at_index(lastIndex), node_at_index(firstIndex));
 }
 
+QwRawNodePool::QwRawNodePool(size_t nodeSize, size_t maxNodes, NodeStride stride, int storagePolicy)
+    : reservedBytes_(0)
+    , mappedBytes_(0)
+    , ownsStorage_(true)
+    , segmentNodeCount_(0)
+    , committedNodeCount_(maxNodes)
+    , growthRequested_(false)
+    , growLock_(false)
+    , waiterCount_(0)
+    , freeSequence_(0)
+#if (QW_DEBUG_COUNT_NODE_ALLOCATIONS == 1)
+    , allocCount_(0)
+#endif
+{
+    init_geometry(nodeSize, maxNodes, stride);
+    init_storage_policy(storagePolicy);
+#if (QW_NODEPOOL_STATS == 1)
+    init_stats();
+#endif
+#if (QW_NODEPOOL_ELIMINATION == 1)
+    init_elimination();
 #endif
 
+    if (storagePolicy == DEFAULT_STORAGE) {
+        // Aligned allocation
+        // TODO: use posix_memalign on unix
+        // see also http://cottonvibes.blogspot.com.au/2011/01/dynamically-allocate-aligned-memory.html
+        // and http://stackoverflow.com/questions/17378444/stdalign-and-stdaligned-storage-for-aligned-allocation-of-memory-blocks
+
+        nodeStorage_ = (int8_t*)qw_aligned_malloc(nodeSize_*maxNodes, CACHE_LINE_SIZE);
+        assert(nodeStorage_ != nullptr);
+    } else {
+        size_t storageBytes = ((nodeSize_*maxNodes + storagePageSize_ - 1) / storagePageSize_) * storagePageSize_;
+        bool mapped = map_storage(storageBytes, true);
+        assert(mapped);
+        (void)mapped;
+    }
+
+    nodeArrayBase_ = nodeStorage_ - nodeSize_; // node index 0 is the null index, so we want nodeArrayBase_[1] --> nodeStorage_[0]
+
+    // now that everything has been set up, push all nodes onto the stack
+    stack_init();
 
+    int8_t *p = nodeStorage_;
+    for (size_t i=0; i < maxNodes; ++i) {
+        stack_push_nonatomic(p);
+        p += nodeSize_;
+    }
+}
 
-QwRawNodePool::QwRawNodePool(size_t nodeSize, size_t maxNodes)
+QwRawNodePool::QwRawNodePool(size_t nodeSize, size_t maxNodes, size_t initialNodes, size_t segmentNodes,
+        NodeStride stride, int storagePolicy)
+    : mappedBytes_(0)
+    , ownsStorage_(true)
+    , committedNodeCount_(0)
+    , growthRequested_(false)
+    , growLock_(false)
+    , waiterCount_(0)
+    , freeSequence_(0)
 #if (QW_DEBUG_COUNT_NODE_ALLOCATIONS == 1)
-    : allocCount_(0)
+    , allocCount_(0)
 #endif
 {
-    assert(sizeof(top_) >= sizeof(abapointer_type));
-
-    // Align nodes on cache line boundaries to avoid false sharing
-    size_t minNodeSize = sizeof(nodeindex_type); // nodes need to be large enough to embed their next ptr
-    // Make node size a power of two to allow for using bit shift to convert between pointers and indices
-    nodeSize_ = roundUpToNextPowerOfTwo(std::max(nodeSize, std::max(minNodeSize, CACHE_LINE_SIZE)));
+    init_geometry(nodeSize, maxNodes, stride);
+    init_storage_policy(storagePolicy);
+#if (QW_NODEPOOL_STATS == 1)
+    init_stats();
+#endif
+#if (QW_NODEPOOL_ELIMINATION == 1)
+    init_elimination();
+#endif
 
-    // Aligned allocation
-    // TODO: use posix_memalign on unix
-    // see also http://cottonvibes.blogspot.com.au/2011/01/dynamically-allocate-aligned-memory.html
-    // and http://stackoverflow.com/questions/17378444/stdalign-and-stdaligned-storage-for-aligned-allocation-of-memory-blocks
+    // Segments are committed a page at a time, so round segment size up to a whole number of pages.
+    // With non-power-of-two strides, this is the smallest run of nodes that fills whole pages.
+    size_t pageSize = storagePageSize_;
+    size_t nodesPerPageRun = pageSize / greatestCommonDivisor(pageSize, nodeSize_);
+    segmentNodeCount_ = std::max(segmentNodes, static_cast<size_t>(1));
+    segmentNodeCount_ = ((segmentNodeCount_ + nodesPerPageRun - 1) / nodesPerPageRun) * nodesPerPageRun;
 
-    nodeStorage_ = (int8_t*)qw_aligned_malloc(nodeSize_*maxNodes, CACHE_LINE_SIZE);
-    assert(nodeStorage_ != nullptr);
+    reservedBytes_ = ((nodeSize_*maxNodes + pageSize - 1) / pageSize) * pageSize;
+    bool mapped = map_storage(reservedBytes_, false); // (page aligned, hence cache-line aligned)
+    assert(mapped);
+    (void)mapped;
 
     nodeArrayBase_ = nodeStorage_ - nodeSize_; // node index 0 is the null index, so we want nodeArrayBase_[1] --> nodeStorage_[0]
 
-    nodeBitShift_ = 0;
-    size_t x = 1;
-    while (x < nodeSize_) {
-        x = x << 1;
-        ++nodeBitShift_;
-    }
-    assert(x == nodeSize_); // require node size to be a power of two
-
-    size_t maxNodeIndex = maxNodes; // since node indices are 1-based, max index is N, not N-1
+    stack_init();
 
-    // index is stored in the low bits of the packed pointer.
-    // generate a bit mask for it.
+    while (committedNodeCount_.load(std::memory_order_relaxed) < initialNodes) {
+        if (grow() == 0)
+            break;
+    }
+    growthRequested_.store(false, std::memory_order_relaxed);
+}
 
-    size_t nodeIndexEnd = roundUpToNextPowerOfTwo(maxNodeIndex); // valid node indices are [1, nodeIndexEnd)
-    if (nodeIndexEnd==maxNodeIndex) // need an extra bit
-        nodeIndexEnd = nodeIndexEnd << 1;
-    indexMask_ = nodeIndexEnd-1;
+QwRawNodePool::QwRawNodePool(void *storage, size_t storageBytes, size_t nodeSize, NodeStride stride)
+    : nodeStorage_(static_cast<int8_t*>(storage))
+    , reservedBytes_(0)
+    , mappedBytes_(0)
+    , ownsStorage_(false)
+    , segmentNodeCount_(0)
+    , committedNodeCount_(storageBytes / node_stride_for(nodeSize, stride))
+    , growthRequested_(false)
+    , growLock_(false)
+    , waiterCount_(0)
+    , freeSequence_(0)
+#if (QW_DEBUG_COUNT_NODE_ALLOCATIONS == 1)
+    , allocCount_(0)
+#endif
+{
+    assert(storage != nullptr);
+    assert(reinterpret_cast<std::uintptr_t>(storage) % CACHE_LINE_SIZE == 0);
+
+    size_t maxNodes = committedNodeCount_.load(std::memory_order_relaxed);
+    assert(maxNodes > 0);
+    init_geometry(nodeSize, maxNodes, stride);
+    init_storage_policy(DEFAULT_STORAGE);
+#if (QW_NODEPOOL_STATS == 1)
+    init_stats();
+#endif
+#if (QW_NODEPOOL_ELIMINATION == 1)
+    init_elimination();
+#endif
 
-    countMask_ = ~indexMask_; // count is in the high part
-    countIncrement_ = nodeIndexEnd;
+    nodeArrayBase_ = nodeStorage_ - nodeSize_; // node index 0 is the null index, so we want nodeArrayBase_[1] --> nodeStorage_[0]
 
-    // now that everything has been set up, push all nodes onto the stack
     stack_init();
 
     int8_t *p = nodeStorage_;
@@ -135,8 +315,179 @@ QwRawNodePool::~QwRawNodePool()
 #if (QW_DEBUG_COUNT_NODE_ALLOCATIONS == 1)
     assert(allocCount_.load(std::memory_order_relaxed) == 0);
 #endif
+#if (QW_NODEPOOL_STATS == 1)
+    destroy_stats();
+#endif
+#if (QW_NODEPOOL_ELIMINATION == 1)
+    destroy_elimination();
+#endif
+
+    if (mappedBytes_ != 0)
+        qw_release_pages(nodeStorage_, mappedBytes_);
+    else if (ownsStorage_)
+        qw_aligned_free(nodeStorage_);
+}
+
+size_t QwRawNodePool::grow()
+{
+    if (reservedBytes_ == 0)
+        return 0; // fixed-size pool
+
+    // Growers are serialized so that segments are committed in index order.
+    // This spin lock is never taken by allocate() or deallocate().
+    while (growLock_.exchange(true, std::memory_order_acquire))
+        std::this_thread::yield();
+
+    size_t result = 0;
+    size_t firstIndex = committedNodeCount_.load(std::memory_order_relaxed) + 1;
+    if (firstIndex <= maxNodeIndex_) {
+        size_t count = std::min(segmentNodeCount_, maxNodeIndex_ + 1 - firstIndex);
+
+        // The segment start is page-aligned because all previous segments are whole pages.
+        // The final segment may end part way through a page, which is still within the reservation.
+        if (qw_commit_pages(node_at_index(firstIndex), count*nodeSize_)) {
+            apply_storage_policy(node_at_index(firstIndex), count*nodeSize_);
+
+            // Publish the new segment. committedNodeCount_ is updated first so that
+            // stack_pop_multiple() will follow links in to the new segment.
+            committedNodeCount_.store(firstIndex + count - 1, std::memory_order_release);
+            push_nodes(firstIndex, count);
+            wake_waiters(true);
+            result = count;
+        }
+    }
+
+    growthRequested_.store(false, std::memory_order_relaxed);
+    growLock_.store(false, std::memory_order_release);
+    return result;
+}
+
+#if (QW_NODEPOOL_STATS == 1)
+
+void QwRawNodePool::init_stats()
+{
+    static_assert(sizeof(StatsShard) <= CACHE_LINE_SIZE, "StatsShard must fit in a cache line");
+
+    statsShardStorage_ = (int8_t*)qw_aligned_malloc(STATS_SHARD_COUNT*CACHE_LINE_SIZE, CACHE_LINE_SIZE);
+    assert(statsShardStorage_ != nullptr);
+    for (size_t i=0; i < STATS_SHARD_COUNT; ++i) {
+        StatsShard *shard = new (statsShardStorage_ + i*CACHE_LINE_SIZE) StatsShard;
+        shard->allocations.store(0, std::memory_order_relaxed);
+        shard->deallocations.store(0, std::memory_order_relaxed);
+        shard->exhaustions.store(0, std::memory_order_relaxed);
+        shard->popCasFailures.store(0, std::memory_order_relaxed);
+        shard->pushCasFailures.store(0, std::memory_order_relaxed);
+        shard->eliminations.store(0, std::memory_order_relaxed);
+    }
+
+    size_t wordCount = (maxNodeIndex_ + 63) / 64;
+    statsTouchedBits_ = new std::atomic<std::uint64_t>[wordCount];
+    for (size_t i=0; i < wordCount; ++i)
+        statsTouchedBits_[i].store(0, std::memory_order_relaxed);
+    statsTouchedNodeCount_.store(0, std::memory_order_relaxed);
+}
 
-    qw_aligned_free(nodeStorage_);
+void QwRawNodePool::destroy_stats()
+{
+    delete [] statsTouchedBits_;
+    qw_aligned_free(statsShardStorage_); // (StatsShard is trivially destructible)
+}
+
+#endif /* QW_NODEPOOL_STATS */
+
+#if (QW_NODEPOOL_ELIMINATION == 1)
+
+void QwRawNodePool::init_elimination()
+{
+    static_assert(sizeof(std::atomic<nodelink_type>) <= CACHE_LINE_SIZE, "elimination slot must fit in a cache line");
+
+    eliminationSlotStorage_ = (int8_t*)qw_aligned_malloc(ELIMINATION_SLOT_COUNT*CACHE_LINE_SIZE, CACHE_LINE_SIZE);
+    assert(eliminationSlotStorage_ != nullptr);
+    for (size_t i=0; i < ELIMINATION_SLOT_COUNT; ++i)
+        new (eliminationSlotStorage_ + i*CACHE_LINE_SIZE) std::atomic<nodelink_type>(null_link());
+}
+
+void QwRawNodePool::destroy_elimination()
+{
+    qw_aligned_free(eliminationSlotStorage_); // (slots are trivially destructible)
+}
+
+#endif /* QW_NODEPOOL_ELIMINATION */
+
+void QwRawNodePool::notify_waiters(bool all)
+{
+    freeSequence_.fetch_add(1, std::memory_order_seq_cst);
+    if (all)
+        qw_futex_wake_all(&freeSequence_);
+    else
+        qw_futex_wake_one(&freeSequence_);
+}
+
+void *QwRawNodePool::allocate_wait_slow(std::chrono::nanoseconds timeout)
+{
+    typedef std::chrono::steady_clock clock;
+    clock::time_point deadline = clock::now() + timeout;
+
+    // Spin briefly. Nodes are often freed soon after the pool runs dry
+    enum { ALLOCATE_WAIT_SPIN_COUNT = 100 };
+    for (int i=0; i < ALLOCATE_WAIT_SPIN_COUNT; ++i) {
+        if (void *result = stack_pop()) {
+            count_allocation(result);
+            return result;
+        }
+    }
+
+    // Block. See wake_waiters() for the pairing of waiterCount_ with top_
+    waiterCount_.fetch_add(1, std::memory_order_seq_cst);
+    void *result = nullptr;
+    for (;;) {
+        std::uint32_t sequence = freeSequence_.load(std::memory_order_seq_cst); // read before checking the freelist
+        std::atomic_thread_fence(std::memory_order_seq_cst); // (the DWCAS top_load() is not seq_cst)
+        result = stack_pop();
+        if (result)
+            break;
+
+        clock::time_point now = clock::now();
+        if (now >= deadline)
+            break;
+        qw_futex_wait_for(&freeSequence_, sequence, deadline - now);
+    }
+    waiterCount_.fetch_sub(1, std::memory_order_relaxed);
+
+    if (result)
+        count_allocation(result);
+    return result;
+}
+
+QwRawNodePool::Stats QwRawNodePool::stats() const
+{
+    Stats result = Stats();
+#if (QW_NODEPOOL_STATS == 1)
+    for (size_t i=0; i < STATS_SHARD_COUNT; ++i) {
+        const StatsShard *shard = reinterpret_cast<const StatsShard*>(statsShardStorage_ + i*CACHE_LINE_SIZE);
+        result.allocations += shard->allocations.load(std::memory_order_relaxed);
+        result.deallocations += shard->deallocations.load(std::memory_order_relaxed);
+        result.exhaustions += shard->exhaustions.load(std::memory_order_relaxed);
+        result.popCasFailures += shard->popCasFailures.load(std::memory_order_relaxed);
+        result.pushCasFailures += shard->pushCasFailures.load(std::memory_order_relaxed);
+        result.eliminations += shard->eliminations.load(std::memory_order_relaxed);
+    }
+    // shards are read at different times, so deallocations may briefly exceed allocations
+    result.liveCount = (result.allocations > result.deallocations)
+            ? static_cast<size_t>(result.allocations - result.deallocations) : 0;
+    result.highWaterMark = statsTouchedNodeCount_.load(std::memory_order_relaxed);
+#endif
+    return result;
+}
+
+QwRawNodePool::StorageInfo QwRawNodePool::storage_info() const
+{
+    StorageInfo result;
+    result.requestedPolicy = storagePolicy_;
+    result.appliedPolicy = appliedStoragePolicy_.load(std::memory_order_relaxed);
+    result.pageSize = storagePageSize_;
+    result.committedBytes = capacity() * nodeSize_;
+    return result;
 }
 
 /* -----------------------------------------------------------------------
@@ -145,6 +496,5 @@ Last reviewed by: Ross B.
 Status: OK
 Comments:
 - constructor is a bit baroque
-- factor aligned allocation into a separate module
 - implement runtime cache line size query
 -------------------------------------------------------------------------- */
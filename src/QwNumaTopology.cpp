@@ -0,0 +1,131 @@
+/*
+    Queue World is copyright (c) 2014-2018 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#include "QwNumaTopology.h"
+
+#ifndef _WIN32
+#include <dirent.h> // opendir
+#endif
+#ifdef __linux__
+#include <sched.h> // sched_getcpu
+#endif
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <thread> // hardware_concurrency
+
+
+QwNumaTopology::QwNumaTopology(const std::string& sysfsRoot)
+{
+#ifndef _WIN32
+    std::string nodeDirPath = sysfsRoot + "/devices/system/node";
+    DIR *nodeDir = opendir(nodeDirPath.c_str());
+    if (nodeDir) {
+        std::vector<int> ids;
+        while (struct dirent *entry = readdir(nodeDir)) {
+            const char *name = entry->d_name;
+            if (std::string(name).compare(0, 4, "node") != 0 || name[4] < '0' || name[4] > '9')
+                continue;
+            char *end;
+            long id = std::strtol(name + 4, &end, 10);
+            if (*end == '\0')
+                ids.push_back(static_cast<int>(id));
+        }
+        closedir(nodeDir);
+
+        std::sort(ids.begin(), ids.end());
+        for (size_t i=0; i < ids.size(); ++i) {
+            std::ifstream cpuListFile((nodeDirPath + "/node" + std::to_string(ids[i]) + "/cpulist").c_str());
+            std::string cpuList;
+            std::getline(cpuListFile, cpuList);
+            std::vector<int> cpus;
+            if (cpuListFile && parse_cpu_list(cpuList, cpus) && !cpus.empty()) // skip memory-only nodes
+                add_node(ids[i], cpus);
+        }
+    }
+#else
+    (void)sysfsRoot;
+#endif
+
+    if (nodeIds_.empty())
+        init_single_node();
+}
+
+void QwNumaTopology::add_node(int nodeId, const std::vector<int>& cpus)
+{
+    size_t node = nodeIds_.size();
+    nodeIds_.push_back(nodeId);
+    nodeCpus_.push_back(cpus);
+    for (size_t i=0; i < cpus.size(); ++i) {
+        size_t cpu = static_cast<size_t>(cpus[i]);
+        if (cpu >= cpuNodes_.size())
+            cpuNodes_.resize(cpu + 1, 0);
+        cpuNodes_[cpu] = node;
+    }
+}
+
+void QwNumaTopology::init_single_node()
+{
+    std::vector<int> cpus;
+    int cpuCount = std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+    for (int i=0; i < cpuCount; ++i)
+        cpus.push_back(i);
+    add_node(0, cpus);
+}
+
+size_t QwNumaTopology::current_node() const
+{
+#ifdef __linux__
+    return node_of_cpu(sched_getcpu());
+#else
+    return 0;
+#endif
+}
+
+bool QwNumaTopology::parse_cpu_list(const std::string& s, std::vector<int>& result)
+{
+    result.clear();
+    const char *p = s.c_str();
+    while (*p != '\0' && *p != '\n') {
+        char *end;
+        long first = std::strtol(p, &end, 10);
+        if (end == p || first < 0)
+            return false;
+        long last = first;
+        p = end;
+        if (*p == '-') {
+            ++p;
+            last = std::strtol(p, &end, 10);
+            if (end == p || last < first)
+                return false;
+            p = end;
+        }
+        for (long cpu = first; cpu <= last; ++cpu)
+            result.push_back(static_cast<int>(cpu));
+
+        if (*p == ',')
+            ++p;
+        else if (*p != '\0' && *p != '\n')
+            return false;
+    }
+    return true;
+}
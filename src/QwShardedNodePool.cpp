@@ -0,0 +1,72 @@
+/*
+    Queue World is copyright (c) 2014-2018 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#include "QwShardedNodePool.h"
+
+#ifdef __linux__
+#include <pthread.h> // pthread_setaffinity_np
+#include <sched.h> // cpu_set_t
+#endif
+
+#include <thread>
+
+
+// Pin the calling thread to cpus. Best effort: returns false if not supported or if it fails.
+static bool qw_pin_current_thread(const std::vector<int>& cpus)
+{
+#ifdef __linux__
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    for (std::size_t i=0; i < cpus.size(); ++i) {
+        if (cpus[i] < CPU_SETSIZE)
+            CPU_SET(cpus[i], &cpuSet);
+    }
+    return (pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet) == 0);
+#else
+    (void)cpus;
+    return false;
+#endif
+}
+
+QwRawShardedNodePool::QwRawShardedNodePool(std::size_t nodeSize, std::size_t maxNodesPerShard,
+        const QwNumaTopology& topology, int storagePolicy)
+    : topology_(topology)
+{
+    storagePolicy |= QwRawNodePool::PREFAULT_STORAGE;
+
+    for (std::size_t i=0; i < topology_.node_count(); ++i) {
+        // First-touch placement: construct (and hence pre-fault) the shard on a thread running on the shard's NUMA node
+        QwRawNodePool *shard = nullptr;
+        const std::vector<int>& cpus = topology_.node_cpus(i);
+        std::thread t([&shard, &cpus, nodeSize, maxNodesPerShard, storagePolicy]() {
+            qw_pin_current_thread(cpus);
+            shard = new QwRawNodePool(nodeSize, maxNodesPerShard, QwRawNodePool::POWER_OF_TWO_STRIDE, storagePolicy);
+        });
+        t.join();
+        shards_.push_back(shard);
+    }
+}
+
+QwRawShardedNodePool::~QwRawShardedNodePool()
+{
+    for (std::size_t i=0; i < shards_.size(); ++i)
+        delete shards_[i];
+}
@@ -0,0 +1,335 @@
+/*
+    Queue World is copyright (c) 2014-2018 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#include "QwSharedNodePool.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h> // O_* constants
+#include <sys/mman.h> // shm_open, mmap
+#include <sys/stat.h> // fstat
+#include <unistd.h> // ftruncate, close, dup
+#include <cstdio> // snprintf
+#endif
+
+#undef max
+#undef min
+
+#include <algorithm> // max
+#include <new> // placement new
+
+namespace {
+
+    const std::uint64_t SHARED_NODE_POOL_MAGIC = 0x51774E6F6465500AULL; // "QwNodeP" + layout version
+
+    std::size_t roundUpToNextPowerOfTwo(std::size_t x)
+    {
+        std::size_t result = 1;
+        while (result < x)
+            result <<= 1;
+        return result;
+    }
+
+} // end anonymous namespace
+
+using Qw::impl::SharedNodePoolHeader;
+
+
+void QwSharedNodePool::init_closed()
+{
+    header_ = nullptr;
+    mappedBytes_ = 0;
+#ifdef _WIN32
+    mappingHandle_ = nullptr;
+#else
+    fd_ = -1;
+#endif
+    nodeArrayBase_ = nullptr;
+    nodeSize_ = 0;
+    nodeBitShift_ = 0;
+    maxNodeIndex_ = 0;
+    indexMask_ = 0;
+    countMask_ = 0;
+    countIncrement_ = 0;
+}
+
+QwSharedNodePool::size_t QwSharedNodePool::node_stride_for(size_t nodeSize)
+{
+    // nodes must hold their next handle, and are cache line aligned to avoid false sharing
+    return roundUpToNextPowerOfTwo(std::max(nodeSize, std::max(sizeof(handle_type), CACHE_LINE_SIZE)));
+}
+
+QwSharedNodePool::size_t QwSharedNodePool::mapping_bytes_for(size_t nodeStride, size_t nodeCount)
+{
+    return sizeof(SharedNodePoolHeader) + nodeStride * nodeCount;
+}
+
+// Initialize the header and freelist of a newly created mapping.
+// The magic number is published last, so that attaching processes never see a partial pool.
+void QwSharedNodePool::create_header(size_t nodeStride, size_t nodeCount)
+{
+    SharedNodePoolHeader *header = new (header_) SharedNodePoolHeader;
+    header->nodeStride = nodeStride;
+    header->nodeCount = nodeCount;
+    header->nodeArrayOffset = sizeof(SharedNodePoolHeader);
+
+    // index is stored in the low bits of the packed pointer. See QwRawNodePool::init_geometry()
+    std::uint64_t nodeIndexEnd = roundUpToNextPowerOfTwo(nodeCount); // valid node indices are [1, nodeIndexEnd)
+    if (nodeIndexEnd == nodeCount) // need an extra bit
+        nodeIndexEnd = nodeIndexEnd << 1;
+    header->indexMask = nodeIndexEnd - 1;
+
+    open_geometry();
+
+    for (size_t i=1; i < nodeCount; ++i)
+        node_next_lvalue(node(i)) = i + 1;
+    node_next_lvalue(node(nodeCount)) = null_handle();
+    header->top.store(1, std::memory_order_relaxed);
+
+    header->magic.store(SHARED_NODE_POOL_MAGIC, std::memory_order_release);
+}
+
+// Validate the header of an existing mapping. Returns false if the pool is
+// not (yet) initialized, or its geometry does not fit in fileBytes.
+bool QwSharedNodePool::attach_header(size_t fileBytes)
+{
+    if (fileBytes < sizeof(SharedNodePoolHeader))
+        return false;
+    if (!map(fileBytes))
+        return false;
+
+    const SharedNodePoolHeader *header = header_;
+    if (header->magic.load(std::memory_order_acquire) != SHARED_NODE_POOL_MAGIC
+            || header->nodeStride < CACHE_LINE_SIZE
+            || (header->nodeStride & (header->nodeStride - 1)) != 0
+            || header->nodeCount == 0
+            || header->nodeArrayOffset != sizeof(SharedNodePoolHeader)
+            || header->indexMask < header->nodeCount
+            || mapping_bytes_for(header->nodeStride, header->nodeCount) > fileBytes) {
+        unmap();
+        return false;
+    }
+
+    open_geometry();
+    return true;
+}
+
+// Copy the pool geometry from the header to this process's fast-path members
+void QwSharedNodePool::open_geometry()
+{
+    nodeSize_ = static_cast<size_t>(header_->nodeStride);
+    nodeBitShift_ = 0;
+    while ((static_cast<size_t>(1) << nodeBitShift_) < nodeSize_)
+        ++nodeBitShift_;
+    maxNodeIndex_ = static_cast<size_t>(header_->nodeCount);
+    nodeArrayBase_ = reinterpret_cast<int8_t*>(header_) + header_->nodeArrayOffset - nodeSize_; // 1-based
+
+    indexMask_ = header_->indexMask;
+    countMask_ = ~indexMask_; // count is in the high part
+    countIncrement_ = indexMask_ + 1;
+}
+
+#ifdef _WIN32
+
+bool QwSharedNodePool::map(size_t bytes)
+{
+    void *p = MapViewOfFile(mappingHandle_, FILE_MAP_ALL_ACCESS, 0, 0, bytes);
+    if (!p)
+        return false;
+    header_ = static_cast<SharedNodePoolHeader*>(p);
+    mappedBytes_ = bytes;
+    return true;
+}
+
+void QwSharedNodePool::unmap()
+{
+    if (header_)
+        UnmapViewOfFile(header_);
+    header_ = nullptr;
+    mappedBytes_ = 0;
+}
+
+QwSharedNodePool::QwSharedNodePool(const char *name, size_t nodeSize, size_t maxNodes)
+{
+    init_closed();
+    assert(maxNodes > 0);
+    size_t nodeStride = node_stride_for(nodeSize);
+    std::uint64_t bytes = mapping_bytes_for(nodeStride, maxNodes);
+
+    mappingHandle_ = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+            static_cast<DWORD>(bytes >> 32), static_cast<DWORD>(bytes & 0xFFFFFFFF), name);
+    if (!mappingHandle_)
+        return;
+    if (GetLastError() == ERROR_ALREADY_EXISTS || !map(static_cast<size_t>(bytes))) {
+        CloseHandle(mappingHandle_);
+        mappingHandle_ = nullptr;
+        return;
+    }
+    create_header(nodeStride, maxNodes);
+}
+
+QwSharedNodePool::QwSharedNodePool(const char *name)
+{
+    init_closed();
+    mappingHandle_ = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, name);
+    if (!mappingHandle_)
+        return;
+
+    // The mapping size isn't directly available. Map the whole object to find it.
+    size_t fileBytes = 0;
+    if (void *p = MapViewOfFile(mappingHandle_, FILE_MAP_ALL_ACCESS, 0, 0, 0)) {
+        MEMORY_BASIC_INFORMATION info;
+        if (VirtualQuery(p, &info, sizeof(info)) == sizeof(info))
+            fileBytes = static_cast<size_t>(info.RegionSize);
+        UnmapViewOfFile(p);
+    }
+
+    if (!attach_header(fileBytes)) {
+        CloseHandle(mappingHandle_);
+        mappingHandle_ = nullptr;
+    }
+}
+
+QwSharedNodePool::~QwSharedNodePool()
+{
+    unmap();
+    if (mappingHandle_)
+        CloseHandle(mappingHandle_);
+}
+
+bool QwSharedNodePool::unlink(const char *)
+{
+    return true;
+}
+
+#else /* POSIX */
+
+bool QwSharedNodePool::map(size_t bytes)
+{
+    void *p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (p == MAP_FAILED)
+        return false;
+    header_ = static_cast<SharedNodePoolHeader*>(p);
+    mappedBytes_ = bytes;
+    return true;
+}
+
+void QwSharedNodePool::unmap()
+{
+    if (header_)
+        munmap(header_, mappedBytes_);
+    header_ = nullptr;
+    mappedBytes_ = 0;
+}
+
+QwSharedNodePool::QwSharedNodePool(const char *name, size_t nodeSize, size_t maxNodes)
+{
+    init_closed();
+    assert(maxNodes > 0);
+    size_t nodeStride = node_stride_for(nodeSize);
+    size_t bytes = mapping_bytes_for(nodeStride, maxNodes);
+
+    fd_ = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd_ == -1)
+        return;
+    if (ftruncate(fd_, static_cast<off_t>(bytes)) != 0 || !map(bytes)) {
+        close(fd_);
+        fd_ = -1;
+        shm_unlink(name);
+        return;
+    }
+    create_header(nodeStride, maxNodes);
+}
+
+QwSharedNodePool::QwSharedNodePool(const char *name)
+{
+    init_closed();
+    fd_ = shm_open(name, O_RDWR, 0);
+    if (fd_ == -1)
+        return;
+
+    struct stat st;
+    if (fstat(fd_, &st) != 0 || !attach_header(static_cast<size_t>(st.st_size))) {
+        close(fd_);
+        fd_ = -1;
+    }
+}
+
+QwSharedNodePool::QwSharedNodePool(size_t nodeSize, size_t maxNodes)
+{
+    init_closed();
+    assert(maxNodes > 0);
+    size_t nodeStride = node_stride_for(nodeSize);
+    size_t bytes = mapping_bytes_for(nodeStride, maxNodes);
+
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+    fd_ = memfd_create("QwSharedNodePool", MFD_CLOEXEC);
+#else
+    // No memfd. Use a unique name, and unlink it immediately.
+    char name[64];
+    static std::atomic<unsigned> nameCounter(0);
+    std::snprintf(name, sizeof(name), "/QwSharedNodePool.%ld.%u",
+            static_cast<long>(getpid()), nameCounter.fetch_add(1, std::memory_order_relaxed));
+    fd_ = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd_ != -1)
+        shm_unlink(name);
+#endif
+    if (fd_ == -1)
+        return;
+    if (ftruncate(fd_, static_cast<off_t>(bytes)) != 0 || !map(bytes)) {
+        close(fd_);
+        fd_ = -1;
+        return;
+    }
+    create_header(nodeStride, maxNodes);
+}
+
+QwSharedNodePool::QwSharedNodePool(int fd)
+{
+    init_closed();
+    fd_ = dup(fd);
+    if (fd_ == -1)
+        return;
+
+    struct stat st;
+    if (fstat(fd_, &st) != 0 || !attach_header(static_cast<size_t>(st.st_size))) {
+        close(fd_);
+        fd_ = -1;
+    }
+}
+
+QwSharedNodePool::~QwSharedNodePool()
+{
+    unmap();
+    if (fd_ != -1)
+        close(fd_);
+}
+
+bool QwSharedNodePool::unlink(const char *name)
+{
+    return (shm_unlink(name) == 0);
+}
+
+#endif /* POSIX */
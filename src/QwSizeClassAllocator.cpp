@@ -0,0 +1,71 @@
+/*
+    Queue World is copyright (c) 2014-2018 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#include "QwSizeClassAllocator.h"
+
+#include "QwVirtualMemory.h"
+
+
+QwSizeClassAllocator::QwSizeClassAllocator(const size_t *classSizes, const size_t *classBlockCounts, size_t classCount)
+    : classCount_(classCount)
+{
+    assert(classCount > 0 && classCount <= MAX_CLASS_COUNT);
+
+    // Each arena is a power of two number of bytes, large enough for the largest class
+    size_t pageSize = qw_page_size();
+    size_t arenaBytes = pageSize;
+    arenaShift_ = 0;
+    while ((static_cast<size_t>(1) << arenaShift_) < pageSize)
+        ++arenaShift_;
+
+    size_t classBytes[MAX_CLASS_COUNT];
+    for (size_t i=0; i < classCount; ++i) {
+        assert(i == 0 || classSizes[i] > classSizes[i-1]); // ascending
+        assert(classBlockCounts[i] > 0);
+        classSizes_[i] = QwRawNodePool::node_stride_for(classSizes[i], QwRawNodePool::CACHE_LINE_STRIDE);
+        classBytes[i] = classSizes_[i] * classBlockCounts[i];
+        while (arenaBytes < classBytes[i]) {
+            arenaBytes <<= 1;
+            ++arenaShift_;
+        }
+    }
+
+    reservedBytes_ = arenaBytes * classCount;
+    storage_ = static_cast<int8_t*>(qw_reserve_pages(reservedBytes_, pageSize));
+    assert(storage_ != nullptr);
+
+    // Commit only the part of each arena that is used by its pool
+    for (size_t i=0; i < classCount; ++i) {
+        int8_t *arena = storage_ + (i << arenaShift_);
+        size_t committedBytes = ((classBytes[i] + pageSize - 1) / pageSize) * pageSize;
+        bool committed = qw_commit_pages(arena, committedBytes);
+        assert(committed);
+        (void)committed;
+        pools_[i] = new QwRawNodePool(arena, classBytes[i], classSizes_[i], QwRawNodePool::CACHE_LINE_STRIDE);
+    }
+}
+
+QwSizeClassAllocator::~QwSizeClassAllocator()
+{
+    for (size_t i=0; i < classCount_; ++i)
+        delete pools_[i];
+    qw_release_pages(storage_, reservedBytes_);
+}
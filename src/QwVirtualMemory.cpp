@@ -0,0 +1,193 @@
+/*
+    Queue World is copyright (c) 2014-2018 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#include "QwVirtualMemory.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h> // mmap
+#include <unistd.h> // sysconf
+#endif
+
+#undef max
+#undef min
+
+#include <cstdint>
+#include <cstdlib> // posix_memalign, free
+
+using std::size_t;
+
+#ifdef _WIN32
+
+void *qw_aligned_malloc(size_t size, size_t alignment)
+{
+    return _aligned_malloc(size, alignment);
+}
+
+void qw_aligned_free(void *memblock)
+{
+    _aligned_free(memblock);
+}
+
+size_t qw_page_size()
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return static_cast<size_t>(info.dwPageSize);
+}
+
+// Reserve address space without committing memory. alignment is a power of two.
+void *qw_reserve_pages(size_t size, size_t alignment)
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    if (alignment <= static_cast<size_t>(info.dwAllocationGranularity))
+        return VirtualAlloc(nullptr, size, MEM_RESERVE, PAGE_NOACCESS);
+
+    // Find an aligned address by reserving an oversized region, then releasing it and
+    // reserving at the aligned address. Another thread may take the address in between, so retry.
+    for (int i=0; i < 8; ++i) {
+        void *p = VirtualAlloc(nullptr, size + alignment, MEM_RESERVE, PAGE_NOACCESS);
+        if (!p)
+            return nullptr;
+        VirtualFree(p, 0, MEM_RELEASE);
+        std::uintptr_t aligned = (reinterpret_cast<std::uintptr_t>(p) + alignment - 1) & ~static_cast<std::uintptr_t>(alignment - 1);
+        void *result = VirtualAlloc(reinterpret_cast<void*>(aligned), size, MEM_RESERVE, PAGE_NOACCESS);
+        if (result)
+            return result;
+    }
+    return nullptr;
+}
+
+bool qw_commit_pages(void *p, size_t size)
+{
+    return (VirtualAlloc(p, size, MEM_COMMIT, PAGE_READWRITE) != nullptr);
+}
+
+void qw_release_pages(void *p, size_t /*size*/)
+{
+    VirtualFree(p, 0, MEM_RELEASE);
+}
+
+// Not supported: Windows large pages must be committed up front with MEM_LARGE_PAGES
+// and require SeLockMemoryPrivilege.
+bool qw_advise_huge_pages(void * /*p*/, size_t /*size*/)
+{
+    return false;
+}
+
+bool qw_lock_pages(void *p, size_t size)
+{
+    return (VirtualLock(p, size) != 0);
+}
+
+#else
+
+void *qw_aligned_malloc(size_t size, size_t alignment)
+{
+    void *result = nullptr;
+
+    if (posix_memalign(&result, alignment, size)!=0)
+        result = nullptr;
+
+    return result;
+}
+
+void qw_aligned_free(void *memblock)
+{
+    free(memblock);
+}
+
+size_t qw_page_size()
+{
+    return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+// Reserve address space without committing memory. alignment is a power of two.
+// size should be a multiple of alignment.
+void *qw_reserve_pages(size_t size, size_t alignment)
+{
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_NORESERVE
+    flags |= MAP_NORESERVE;
+#endif
+    size_t pageSize = qw_page_size();
+    size_t mappedSize = (alignment > pageSize) ? size + alignment : size;
+    void *result = mmap(nullptr, mappedSize, PROT_NONE, flags, -1, 0);
+    if (result == MAP_FAILED)
+        return nullptr;
+
+    if (alignment > pageSize) {
+        // Trim the oversized mapping to an aligned region
+        std::int8_t *p = static_cast<std::int8_t*>(result);
+        std::uintptr_t aligned = (reinterpret_cast<std::uintptr_t>(p) + alignment - 1) & ~static_cast<std::uintptr_t>(alignment - 1);
+        size_t head = static_cast<size_t>(aligned - reinterpret_cast<std::uintptr_t>(p));
+        size_t tail = mappedSize - head - size;
+        if (head > 0)
+            munmap(p, head);
+        if (tail > 0)
+            munmap(p + head + size, tail);
+        result = p + head;
+    }
+    return result;
+}
+
+bool qw_commit_pages(void *p, size_t size)
+{
+    return (mprotect(p, size, PROT_READ | PROT_WRITE) == 0);
+}
+
+void qw_release_pages(void *p, size_t size)
+{
+    munmap(p, size);
+}
+
+bool qw_advise_huge_pages(void *p, size_t size)
+{
+#ifdef MADV_HUGEPAGE
+    return (madvise(p, size, MADV_HUGEPAGE) == 0);
+#else
+    (void)p;
+    (void)size;
+    return false;
+#endif
+}
+
+bool qw_lock_pages(void *p, size_t size)
+{
+    return (mlock(p, size) == 0);
+}
+
+#endif
+
+// Touch each page so that later accesses don't page-fault.
+// Fresh pages are zero-filled, so writing zero doesn't change their contents.
+void qw_prefault_pages(void *p, size_t size)
+{
+    size_t pageSize = qw_page_size();
+    volatile std::int8_t *q = static_cast<volatile std::int8_t*>(p);
+    for (size_t i=0; i < size; i += pageSize)
+        q[i] = 0;
+}
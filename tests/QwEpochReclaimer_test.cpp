@@ -0,0 +1,284 @@
+/*
+    Queue World is copyright (c) 2014-2018 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+// Simulate preemption inside enter(). See the stale enter() test below
+static void (*enterPreemptionHook_)() = nullptr;
+#define QW_EPOCHRECLAIMER_ENTER_PREEMPTION_POINT() \
+    if (enterPreemptionHook_) { void (*hook)() = enterPreemptionHook_; enterPreemptionHook_ = nullptr; hook(); }
+
+#include "QwEpochReclaimer.h"
+#include "QwNodePool.h"
+#include "QwSList.h"
+
+#include "catch.hpp"
+
+#include <atomic>
+#include <cstddef> // size_t
+#include <thread>
+
+
+namespace {
+
+    struct TestNode{
+        TestNode *links_[2];
+        enum { LINK_INDEX_1, LINK_COUNT };
+
+        int value;
+
+        TestNode()
+            : value(0)
+        {
+            for (int i=0; i < LINK_COUNT; ++i)
+                links_[i] = nullptr;
+        }
+    };
+
+    typedef QwEpochReclaimer<TestNode*, TestNode::LINK_INDEX_1> TestReclaimer;
+
+    enum { LIVE_VALUE = 0x600D, POISON_VALUE = 0xDEAD };
+
+    struct ReclaimContext {
+        QwNodePool<TestNode> *pool;
+        std::atomic<std::size_t> reclaimedCount;
+    };
+
+    // Poison reclaimed nodes, so that readers can detect premature reclamation
+    void reclaimToPool(TestReclaimer::list_type& nodes, void *context)
+    {
+        ReclaimContext *c = static_cast<ReclaimContext*>(context);
+        std::size_t count = 0;
+        for (TestReclaimer::list_type::iterator i = nodes.begin(); i != nodes.end(); ++i) {
+            (*i)->value = POISON_VALUE;
+            ++count;
+        }
+        c->reclaimedCount.fetch_add(count, std::memory_order_relaxed);
+        c->pool->deallocate_list(nodes);
+    }
+
+} // end anonymous namespace
+
+TEST_CASE("qw/epoch_reclaimer", "QwEpochReclaimer single threaded test") {
+
+    QwNodePool<TestNode> pool(100);
+    ReclaimContext context;
+    context.pool = &pool;
+    context.reclaimedCount.store(0);
+
+    {
+        const std::size_t maxThreads = 4;
+        TestReclaimer reclaimer(maxThreads, reclaimToPool, &context);
+        REQUIRE(reclaimer.max_threads() == maxThreads);
+
+        std::size_t t0 = reclaimer.register_thread();
+        std::size_t t1 = reclaimer.register_thread();
+        REQUIRE(t0 < maxThreads);
+        REQUIRE(t1 < maxThreads);
+        REQUIRE(t0 != t1);
+
+        // a thread in a critical section holds back reclamation
+        reclaimer.enter(t1);
+        std::uint64_t startEpoch = reclaimer.epoch();
+
+        reclaimer.enter(t0);
+        for (int i=0; i < 10; ++i)
+            reclaimer.retire(t0, pool.allocate());
+        reclaimer.exit(t0);
+
+        for (int i=0; i < 10; ++i) {
+            TestReclaimer::Guard guard(reclaimer, t0);
+            reclaimer.try_advance();
+        }
+        REQUIRE(reclaimer.epoch() <= startEpoch + 1);
+        REQUIRE(context.reclaimedCount.load() == 0);
+
+        // once it exits, the epoch advances and retired nodes are reclaimed
+        reclaimer.exit(t1);
+        for (int i=0; i < 4; ++i) {
+            TestReclaimer::Guard guard(reclaimer, t0);
+            REQUIRE(reclaimer.try_advance());
+        }
+        REQUIRE(reclaimer.epoch() > startEpoch + 3);
+        REQUIRE(context.reclaimedCount.load() == 10);
+
+        // retire() tries to advance the epoch every RETIRE_BATCH_SIZE retirements
+        std::uint64_t epoch = reclaimer.epoch();
+        {
+            TestReclaimer::Guard guard(reclaimer, t0);
+            for (int i=0; i < TestReclaimer::RETIRE_BATCH_SIZE; ++i)
+                reclaimer.retire(t0, pool.allocate());
+        }
+        REQUIRE(reclaimer.epoch() == epoch + 1);
+
+        // thread records are reused after unregister_thread()
+        std::size_t t2 = reclaimer.register_thread();
+        std::size_t t3 = reclaimer.register_thread();
+        REQUIRE(t2 < maxThreads);
+        REQUIRE(t3 < maxThreads);
+        REQUIRE(reclaimer.register_thread() == maxThreads); // full
+        reclaimer.unregister_thread(t1);
+        REQUIRE(reclaimer.register_thread() == t1);
+
+        // the remaining retired nodes are reclaimed by the destructor
+    }
+    REQUIRE(context.reclaimedCount.load() == 10 + TestReclaimer::RETIRE_BATCH_SIZE);
+}
+
+namespace {
+
+    static TestReclaimer *staleReclaimer_;
+    static std::size_t staleReaderThread_;
+
+    // While the retiring thread is descheduled between reading and
+    // publishing the global epoch: the epoch advances twice, and another
+    // thread enters and starts reading the node that will be retired.
+    static void advanceTwiceThenEnterReader()
+    {
+        REQUIRE(staleReclaimer_->try_advance());
+        REQUIRE(staleReclaimer_->try_advance());
+        staleReclaimer_->enter(staleReaderThread_);
+    }
+
+} // end anonymous namespace
+
+TEST_CASE("qw/epoch_reclaimer/stale_enter", "QwEpochReclaimer enter() descheduled before publishing test") {
+
+    QwNodePool<TestNode> pool(10);
+    ReclaimContext context;
+    context.pool = &pool;
+    context.reclaimedCount.store(0);
+
+    {
+        TestReclaimer reclaimer(2, reclaimToPool, &context);
+        std::size_t retirer = reclaimer.register_thread();
+        std::size_t reader = reclaimer.register_thread();
+        std::uint64_t startEpoch = reclaimer.epoch();
+
+        staleReclaimer_ = &reclaimer;
+        staleReaderThread_ = reader;
+        enterPreemptionHook_ = advanceTwiceThenEnterReader;
+
+        reclaimer.enter(retirer); // reads startEpoch, then the hook runs before publishing
+        REQUIRE(enterPreemptionHook_ == nullptr);
+        REQUIRE(reclaimer.epoch() == startEpoch + 2);
+        reclaimer.retire(retirer, pool.allocate()); // the reader may still hold this node
+        reclaimer.exit(retirer);
+
+        // the reader has observed the current epoch, so it advances once more
+        REQUIRE(reclaimer.try_advance());
+        REQUIRE(reclaimer.epoch() == startEpoch + 3);
+
+        // the node must not be reclaimed while the reader is in its critical section
+        for (int i=0; i < 4; ++i) {
+            TestReclaimer::Guard guard(reclaimer, retirer);
+            reclaimer.try_advance();
+        }
+        REQUIRE(context.reclaimedCount.load() == 0);
+
+        reclaimer.exit(reader);
+        for (int i=0; i < 4; ++i) {
+            TestReclaimer::Guard guard(reclaimer, retirer);
+            reclaimer.try_advance();
+        }
+        REQUIRE(context.reclaimedCount.load() == 1);
+
+        reclaimer.unregister_thread(retirer);
+        reclaimer.unregister_thread(reader);
+    }
+}
+
+namespace {
+
+    static const std::size_t TEST_THREAD_COUNT=4;
+    static const std::size_t THREAD_ITERATIONS=50000;
+
+    static TestReclaimer *testReclaimer_;
+    static QwNodePool<TestNode> *testPool_;
+    static std::atomic<TestNode*> sharedNode_;
+
+    // Each iteration reads the shared node, and every fourth iteration
+    // replaces it, retiring the old one.
+    static unsigned testThreadProc()
+    {
+        std::size_t t = testReclaimer_->register_thread();
+        if (t == testReclaimer_->max_threads())
+            return 1;
+
+        unsigned result = 0;
+        for (std::size_t i=0; i < THREAD_ITERATIONS && result == 0; ++i) {
+            TestReclaimer::Guard guard(*testReclaimer_, t);
+            TestNode *n = sharedNode_.load(std::memory_order_acquire);
+            if (n->value != LIVE_VALUE)
+                result = 1; // reclaimed while still reachable
+            std::this_thread::yield(); // (widen the window for premature reclamation)
+            if (n->value != LIVE_VALUE)
+                result = 1;
+
+            if ((i % 4) == 0) {
+                TestNode *replacement = testPool_->allocate();
+                if (!replacement) {
+                    result = 1;
+                    break;
+                }
+                replacement->value = LIVE_VALUE;
+                TestNode *old = sharedNode_.exchange(replacement, std::memory_order_acq_rel);
+                testReclaimer_->retire(t, old);
+            }
+        }
+
+        testReclaimer_->unregister_thread(t);
+        return result;
+    }
+}
+
+TEST_CASE("qw/epoch_reclaimer/multi-threaded", "[slow][fuzz] QwEpochReclaimer multi-threaded test") {
+
+    testPool_ = new QwNodePool<TestNode>(TEST_THREAD_COUNT * THREAD_ITERATIONS / 4 + 1);
+    ReclaimContext context;
+    context.pool = testPool_;
+    context.reclaimedCount.store(0);
+    testReclaimer_ = new TestReclaimer(TEST_THREAD_COUNT, reclaimToPool, &context);
+
+    TestNode *initial = testPool_->allocate();
+    initial->value = LIVE_VALUE;
+    sharedNode_.store(initial);
+
+    unsigned results[TEST_THREAD_COUNT];
+    std::thread* threads[TEST_THREAD_COUNT];
+
+    for (std::size_t i=0; i < TEST_THREAD_COUNT; ++i) {
+        results[i] = 1;
+        threads[i] = new std::thread([&results, i]{ results[i] = testThreadProc(); });
+    }
+
+    for (std::size_t i=0; i < TEST_THREAD_COUNT; ++i) {
+        threads[i]->join();
+        delete threads[i];
+        REQUIRE(results[i] == 0);
+    }
+
+    REQUIRE(context.reclaimedCount.load() > 0); // reclamation happened while threads were running
+
+    delete testReclaimer_;
+    REQUIRE(context.reclaimedCount.load() == TEST_THREAD_COUNT * THREAD_ITERATIONS / 4);
+
+    testPool_->deallocate(sharedNode_.load());
+    delete testPool_;
+}
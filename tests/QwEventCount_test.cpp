@@ -0,0 +1,247 @@
+/*
+    Queue World is copyright (c) 2014-2018 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#include "QwEventCount.h"
+#include "QwMpmcPopAllLifoStack.h"
+#include "QwSpscUnorderedResultQueue.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "catch.hpp"
+
+
+namespace {
+
+    struct TestNode{
+        TestNode *links_[2];
+        enum { LINK_INDEX_1, LINK_COUNT };
+
+        int value;
+
+        TestNode()
+            : value(0)
+        {
+            for (int i=0; i < LINK_COUNT; ++i)
+                links_[i] = nullptr;
+        }
+    };
+
+    typedef QwMpmcPopAllLifoStack<TestNode*, TestNode::LINK_INDEX_1> TestMpmcPopAllLifoStack;
+    typedef QwSpscUnorderedResultQueue<TestNode*, TestNode::LINK_INDEX_1> TestSpscUnorderedResultQueue;
+
+} // end anonymous namespace
+
+
+TEST_CASE("qw/event_count", "QwEventCount test") {
+
+    typedef std::chrono::steady_clock clock;
+    QwEventCount ec;
+
+    // notify_all() with no waiters does not change the key
+    QwEventCount::key_type key = ec.prepare_wait();
+    ec.cancel_wait();
+    ec.notify_all();
+    REQUIRE(ec.prepare_wait() == key);
+    ec.cancel_wait();
+
+    // notify_all() between prepare_wait() and commit_wait() is not lost
+    key = ec.prepare_wait();
+    ec.notify_all();
+    REQUIRE(ec.commit_wait_for(key, std::chrono::seconds(10)) == true);
+    REQUIRE(ec.prepare_wait() != key);
+    ec.cancel_wait();
+
+    key = ec.prepare_wait();
+    ec.notify_all();
+    ec.commit_wait(key); // returns immediately
+
+    // times out without a notification
+    key = ec.prepare_wait();
+    clock::time_point start = clock::now();
+    REQUIRE(ec.commit_wait_for(key, std::chrono::milliseconds(20)) == false);
+    REQUIRE((clock::now() - start >= std::chrono::milliseconds(20)));
+
+    // woken by another thread
+    std::atomic<int> flag(0);
+    std::thread notifier([&ec, &flag]{
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        flag.store(1, std::memory_order_relaxed);
+        ec.notify_all();
+    });
+    start = clock::now();
+    while (flag.load(std::memory_order_relaxed) == 0) {
+        key = ec.prepare_wait();
+        if (flag.load(std::memory_order_relaxed) != 0) {
+            ec.cancel_wait();
+            break;
+        }
+        ec.commit_wait_for(key, std::chrono::seconds(10));
+    }
+    REQUIRE((clock::now() - start < std::chrono::seconds(10)));
+    notifier.join();
+}
+
+TEST_CASE("qw/event_count/notify_one", "QwEventCount notify_one test") {
+
+    QwEventCount ec;
+
+    // notify_one() with no waiters does not change the key
+    QwEventCount::key_type key = ec.prepare_wait();
+    ec.cancel_wait();
+    ec.notify_one();
+    REQUIRE(ec.prepare_wait() == key);
+
+    // notify_one() between prepare_wait() and commit_wait() is not lost
+    ec.notify_one();
+    REQUIRE(ec.commit_wait_for(key, std::chrono::seconds(10)) == true);
+
+    // two blocked threads, woken one at a time
+    std::atomic<int> tokens(0);
+    std::atomic<int> wokenCount(0);
+    auto waiter = [&ec, &tokens, &wokenCount]{
+        ec.wait([&tokens]{
+            int n = tokens.load(std::memory_order_relaxed);
+            while (n > 0) {
+                if (tokens.compare_exchange_weak(n, n - 1, std::memory_order_relaxed))
+                    return true;
+            }
+            return false;
+        });
+        wokenCount.fetch_add(1, std::memory_order_relaxed);
+    };
+    std::thread a(waiter), b(waiter);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    tokens.fetch_add(1, std::memory_order_relaxed);
+    ec.notify_one();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    REQUIRE(wokenCount.load(std::memory_order_relaxed) == 1);
+    tokens.fetch_add(1, std::memory_order_relaxed);
+    ec.notify_one();
+    a.join();
+    b.join();
+    REQUIRE(wokenCount.load(std::memory_order_relaxed) == 2);
+}
+
+TEST_CASE("qw/event_count/wait", "QwEventCount wait() and wait_for() spin phase test") {
+
+    int callCount = 0;
+    auto succeedOnThirdCall = [&callCount]{ return (++callCount >= 3); };
+
+    // succeeds while spinning, without blocking
+    QwEventCount ec(10);
+    REQUIRE(ec.max_spin_count() == 10);
+    REQUIRE(ec.wait(succeedOnThirdCall) == true);
+    REQUIRE(callCount == 3);
+    callCount = 0;
+    REQUIRE(ec.wait_for(succeedOnThirdCall, std::chrono::nanoseconds::zero()) == true);
+    REQUIRE(callCount == 3);
+
+    // never succeeds: spins no more than the maximum, then times out
+    callCount = 0;
+    REQUIRE(ec.wait_for([&callCount]{ ++callCount; return false; }, std::chrono::nanoseconds::zero()) == false);
+    REQUIRE(callCount <= 1 + 10 + 1);
+
+    // no spinning: the initial try, then the re-check after prepare_wait()
+    ec.set_max_spin_count(0);
+    callCount = 0;
+    REQUIRE(ec.wait_for(succeedOnThirdCall, std::chrono::nanoseconds::zero()) == false);
+    REQUIRE(callCount == 2);
+
+    // the spin count adapts down when spinning fails
+    QwEventCount ec2(1000);
+    for (int i=0; i < 20; ++i)
+        ec2.wait_for([]{ return false; }, std::chrono::nanoseconds::zero());
+    callCount = 0;
+    ec2.wait_for([&callCount]{ ++callCount; return false; }, std::chrono::nanoseconds::zero());
+    REQUIRE(callCount <= 1 + 10 + 1);
+}
+
+namespace {
+
+    static const int ATTACH_TEST_NODE_COUNT = 20000;
+
+} // end anonymous namespace
+
+TEST_CASE("qw/event_count/attach", "[slow][fuzz] QwEventCount attached to QwMpmcPopAllLifoStack and QwSpscUnorderedResultQueue test") {
+
+    // a client sends requests to a server through a stack, and receives
+    // them back through a result queue. both sides block using event counts.
+    // neither queue knows about the event counts.
+
+    TestMpmcPopAllLifoStack requests;
+    QwEventCount requestsEvent;
+
+    TestSpscUnorderedResultQueue results;
+    results.init();
+    QwEventCount resultsEvent;
+
+    TestNode *nodes = new TestNode[ATTACH_TEST_NODE_COUNT];
+
+    std::thread server([&]{
+        int count = 0;
+        while (count < ATTACH_TEST_NODE_COUNT) {
+            TestNode *n = requestsEvent.wait_for([&requests]{ return requests.pop_all(); }, std::chrono::seconds(10));
+            if (!n)
+                break; // lost wakeup, or the client gave up
+            while (n) {
+                TestNode *next = n->links_[TestNode::LINK_INDEX_1];
+                n->links_[TestNode::LINK_INDEX_1] = nullptr;
+                n->value += 1;
+                results.push(n);
+                n = next;
+                ++count;
+            }
+            resultsEvent.notify_one();
+        }
+    });
+
+    bool ok = true;
+    for (int i=0; i < ATTACH_TEST_NODE_COUNT; ++i) {
+        nodes[i].value = i;
+        requests.push(&nodes[i]);
+        requestsEvent.notify_one();
+        results.incrementExpectedResultCount();
+
+        if (i % 1000 == 999) {
+            // wait for all outstanding results
+            while (results.expectedResultCount() > 0) {
+                TestNode *n = resultsEvent.wait_for([&results]{ return results.pop(); }, std::chrono::seconds(10));
+                if (!n) {
+                    ok = false; // lost wakeup (or a very slow machine)
+                    break;
+                }
+                if (n->value != static_cast<int>(n - nodes) + 1)
+                    ok = false;
+            }
+            if (!ok)
+                break;
+        }
+    }
+
+    server.join();
+
+    REQUIRE(ok);
+    REQUIRE(results.pop() == (TestNode*)nullptr);
+
+    delete [] nodes;
+}
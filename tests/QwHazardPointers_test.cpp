@@ -0,0 +1,205 @@
+/*
+    Queue World is copyright (c) 2014-2018 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#include "QwHazardPointers.h"
+#include "QwNodePool.h"
+#include "QwSList.h"
+
+#include "catch.hpp"
+
+#include <atomic>
+#include <cstddef> // size_t
+#include <thread>
+
+
+namespace {
+
+    struct TestNode{
+        TestNode *links_[2];
+        enum { LINK_INDEX_1, LINK_COUNT };
+
+        int value;
+
+        TestNode()
+            : value(0)
+        {
+            for (int i=0; i < LINK_COUNT; ++i)
+                links_[i] = nullptr;
+        }
+    };
+
+    typedef QwHazardPointerDomain<TestNode*, TestNode::LINK_INDEX_1> TestDomain;
+
+    enum { LIVE_VALUE = 0x600D, POISON_VALUE = 0xDEAD };
+
+    struct ReclaimContext {
+        QwNodePool<TestNode> *pool;
+        std::atomic<std::size_t> reclaimedCount;
+    };
+
+    // Poison reclaimed nodes, so that readers can detect premature reclamation
+    void reclaimToPool(TestDomain::list_type& nodes, void *context)
+    {
+        ReclaimContext *c = static_cast<ReclaimContext*>(context);
+        std::size_t count = 0;
+        for (TestDomain::list_type::iterator i = nodes.begin(); i != nodes.end(); ++i) {
+            (*i)->value = POISON_VALUE;
+            ++count;
+        }
+        c->reclaimedCount.fetch_add(count, std::memory_order_relaxed);
+        c->pool->deallocate_list(nodes);
+    }
+
+} // end anonymous namespace
+
+TEST_CASE("qw/hazard_pointers", "QwHazardPointerDomain single threaded test") {
+
+    QwNodePool<TestNode> pool(100);
+    ReclaimContext context;
+    context.pool = &pool;
+    context.reclaimedCount.store(0);
+    std::size_t scanThreshold = 0;
+
+    {
+        const std::size_t maxThreads = 2;
+        TestDomain domain(maxThreads, reclaimToPool, &context);
+        REQUIRE(domain.max_threads() == maxThreads);
+        REQUIRE(domain.scan_threshold() >= 2 * maxThreads * 2);
+        scanThreshold = domain.scan_threshold();
+
+        std::size_t t0 = domain.register_thread();
+        std::size_t t1 = domain.register_thread();
+        REQUIRE(t0 != t1);
+        REQUIRE(domain.register_thread() == maxThreads); // full
+
+        std::atomic<TestNode*> link(pool.allocate());
+        TestNode *protectedNode = domain.protect(t1, 0, link);
+        REQUIRE(protectedNode == link.load());
+
+        // a protected node survives scans, unprotected nodes are reclaimed
+        link.store(nullptr);
+        domain.retire(t0, protectedNode);
+        domain.retire(t0, pool.allocate());
+        domain.retire(t0, pool.allocate());
+        domain.scan(t0);
+        REQUIRE(context.reclaimedCount.load() == 2);
+        REQUIRE(protectedNode->value != POISON_VALUE);
+
+        domain.clear(t1, 0);
+        domain.scan(t0);
+        REQUIRE(context.reclaimedCount.load() == 3);
+
+        // retire() scans when scan_threshold() nodes are retired
+        for (std::size_t i=0; i < domain.scan_threshold() - 1; ++i)
+            domain.retire(t0, pool.allocate());
+        REQUIRE(context.reclaimedCount.load() == 3);
+        domain.retire(t0, pool.allocate());
+        REQUIRE(context.reclaimedCount.load() == 3 + domain.scan_threshold());
+
+        // thread records are reused after unregister_thread(). retired nodes stay with the record
+        domain.retire(t1, pool.allocate());
+        domain.unregister_thread(t1);
+        REQUIRE(domain.register_thread() == t1);
+
+        // the remaining retired node is reclaimed by the destructor
+    }
+    REQUIRE(context.reclaimedCount.load() == 4 + scanThreshold);
+}
+
+namespace {
+
+    static const std::size_t TEST_THREAD_COUNT=4;
+    static const std::size_t THREAD_ITERATIONS=50000;
+
+    static TestDomain *testDomain_;
+    static QwNodePool<TestNode> *testPool_;
+    static std::atomic<TestNode*> sharedNode_;
+
+    // Each iteration reads the shared node, and every fourth iteration
+    // replaces it, retiring the old one.
+    static unsigned testThreadProc()
+    {
+        std::size_t t = testDomain_->register_thread();
+        if (t == testDomain_->max_threads())
+            return 1;
+
+        unsigned result = 0;
+        for (std::size_t i=0; i < THREAD_ITERATIONS && result == 0; ++i) {
+            TestNode *n = testDomain_->protect(t, 0, sharedNode_);
+            if (n->value != LIVE_VALUE)
+                result = 1; // reclaimed while protected
+            std::this_thread::yield(); // (widen the window for premature reclamation)
+            if (n->value != LIVE_VALUE)
+                result = 1;
+            testDomain_->clear(t, 0);
+
+            if ((i % 4) == 0) {
+                TestNode *replacement = testPool_->allocate();
+                if (!replacement) {
+                    result = 1; // garbage exceeded the bound
+                    break;
+                }
+                replacement->value = LIVE_VALUE;
+                TestNode *old = sharedNode_.exchange(replacement, std::memory_order_acq_rel);
+                testDomain_->retire(t, old);
+            }
+        }
+
+        testDomain_->unregister_thread(t);
+        return result;
+    }
+}
+
+TEST_CASE("qw/hazard_pointers/multi-threaded", "[slow][fuzz] QwHazardPointerDomain multi-threaded test") {
+
+    std::size_t scanThreshold = TestDomain(TEST_THREAD_COUNT, reclaimToPool, nullptr).scan_threshold();
+
+    // garbage is bounded: the pool only has room for the shared node plus scan_threshold() retired nodes per thread
+    testPool_ = new QwNodePool<TestNode>(1 + TEST_THREAD_COUNT * scanThreshold);
+    ReclaimContext context;
+    context.pool = testPool_;
+    context.reclaimedCount.store(0);
+    testDomain_ = new TestDomain(TEST_THREAD_COUNT, reclaimToPool, &context);
+
+    TestNode *initial = testPool_->allocate();
+    initial->value = LIVE_VALUE;
+    sharedNode_.store(initial);
+
+    unsigned results[TEST_THREAD_COUNT];
+    std::thread* threads[TEST_THREAD_COUNT];
+
+    for (std::size_t i=0; i < TEST_THREAD_COUNT; ++i) {
+        results[i] = 1;
+        threads[i] = new std::thread([&results, i]{ results[i] = testThreadProc(); });
+    }
+
+    for (std::size_t i=0; i < TEST_THREAD_COUNT; ++i) {
+        threads[i]->join();
+        delete threads[i];
+        REQUIRE(results[i] == 0);
+    }
+
+    delete testDomain_;
+    REQUIRE(context.reclaimedCount.load() == TEST_THREAD_COUNT * THREAD_ITERATIONS / 4);
+
+    testPool_->deallocate(sharedNode_.load());
+    delete testPool_;
+}
@@ -0,0 +1,216 @@
+/*
+    Queue World is copyright (c) 2014-2018 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#include "QwMpmcBoundedQueue.h"
+
+#include "catch.hpp"
+
+#include <atomic>
+#include <thread>
+
+
+namespace {
+
+    struct TestEvent {
+        int producer;
+        int sequence;
+        double payload[2]; // (make the event 24 bytes, like a typical small message)
+
+        TestEvent() : producer(-1), sequence(-1) { payload[0] = payload[1] = 0; }
+        TestEvent(int p, int s) : producer(p), sequence(s) { payload[0] = payload[1] = s; }
+    };
+
+    typedef QwMpmcBoundedQueue<TestEvent> TestQueue;
+
+} // end anonymous namespace
+
+
+TEST_CASE("qw/mpmc_bounded_queue", "QwMpmcBoundedQueue single threaded test") {
+
+    // capacity is rounded up to a power of two
+    REQUIRE(TestQueue(1).capacity() == 2);
+    REQUIRE(TestQueue(5).capacity() == 8);
+    REQUIRE(TestQueue(8).capacity() == 8);
+
+    TestQueue q(8);
+    TestEvent e;
+    REQUIRE(q.try_pop(e) == false);
+
+    // fill, overflow, drain. repeat to wrap around the ring several times
+    int next = 0;
+    int expected = 0;
+    for (int lap=0; lap < 5; ++lap) {
+        for (int i=0; i < 8; ++i)
+            REQUIRE(q.try_push(TestEvent(0, next++)));
+        REQUIRE(q.try_push(TestEvent(0, -1)) == false); // full
+
+        for (int i=0; i < 8; ++i) {
+            REQUIRE(q.try_pop(e));
+            REQUIRE(e.sequence == expected++);
+            REQUIRE(e.payload[1] == e.sequence);
+        }
+        REQUIRE(q.try_pop(e) == false); // empty
+
+        // partially fill, so the next lap starts mid-ring
+        for (int i=0; i < 3; ++i)
+            REQUIRE(q.try_push(TestEvent(0, next++)));
+        for (int i=0; i < 3; ++i) {
+            REQUIRE(q.try_pop(e));
+            REQUIRE(e.sequence == expected++);
+        }
+    }
+
+    // batch operations transfer as many values as fit or are available
+    TestEvent in[12];
+    for (int i=0; i < 12; ++i)
+        in[i] = TestEvent(0, next + i);
+
+    REQUIRE(q.try_push_n(in, 5) == 5);
+    REQUIRE(q.try_push_n(in + 5, 7) == 3); // room for 3 more
+    REQUIRE(q.try_push_n(in + 8, 4) == 0); // full
+
+    TestEvent out[12];
+    REQUIRE(q.try_pop_n(out, 2) == 2);
+    REQUIRE(q.try_pop_n(out + 2, 10) == 6); // only 6 left
+    REQUIRE(q.try_pop_n(out + 8, 4) == 0); // empty
+    for (int i=0; i < 8; ++i)
+        REQUIRE(out[i].sequence == next + i);
+
+    // batch and single operations interoperate
+    REQUIRE(q.try_push_n(in, 4) == 4);
+    REQUIRE(q.try_pop(e));
+    REQUIRE(e.sequence == next);
+    REQUIRE(q.try_push(TestEvent(0, 1000)));
+    REQUIRE(q.try_pop_n(out, 12) == 4);
+    REQUIRE(out[0].sequence == next + 1);
+    REQUIRE(out[2].sequence == next + 3);
+    REQUIRE(out[3].sequence == 1000);
+}
+
+namespace {
+
+    static const int PRODUCER_COUNT=2;
+    static const int CONSUMER_COUNT=2;
+    static const int ITEMS_PER_PRODUCER=100000;
+    static const int TOTAL_ITEMS=PRODUCER_COUNT*ITEMS_PER_PRODUCER;
+    static const int BATCH_SIZE=7;
+
+    static TestQueue *testQueue_;
+    static std::atomic<int> poppedCount_;
+    static std::atomic<int> receivedCount_[TOTAL_ITEMS];
+
+    // Producer 0 uses try_push(), the others use try_push_n()
+    static unsigned producerThreadProc(int producer)
+    {
+        int i = 0;
+        while (i < ITEMS_PER_PRODUCER) {
+            if (producer == 0) {
+                if (testQueue_->try_push(TestEvent(producer, i)))
+                    ++i;
+                else
+                    std::this_thread::yield();
+            } else {
+                TestEvent batch[BATCH_SIZE];
+                int n = 0;
+                for (; n < BATCH_SIZE && i + n < ITEMS_PER_PRODUCER; ++n)
+                    batch[n] = TestEvent(producer, i + n);
+                std::size_t pushed = testQueue_->try_push_n(batch, n);
+                i += static_cast<int>(pushed);
+                if (pushed == 0)
+                    std::this_thread::yield();
+            }
+        }
+        return 0;
+    }
+
+    // Check that values are received exactly once, and in per-producer FIFO order.
+    // Consumer 0 uses try_pop(), the others use try_pop_n()
+    static unsigned consumerThreadProc(int consumer)
+    {
+        int lastSequence[PRODUCER_COUNT];
+        for (int i=0; i < PRODUCER_COUNT; ++i)
+            lastSequence[i] = -1;
+
+        while (poppedCount_.load(std::memory_order_relaxed) < TOTAL_ITEMS) {
+            TestEvent batch[BATCH_SIZE];
+            std::size_t n;
+            if (consumer == 0)
+                n = testQueue_->try_pop(batch[0]) ? 1 : 0;
+            else
+                n = testQueue_->try_pop_n(batch, BATCH_SIZE);
+
+            if (n == 0) {
+                std::this_thread::yield();
+                continue;
+            }
+
+            for (std::size_t i=0; i < n; ++i) {
+                const TestEvent& e = batch[i];
+                if (e.producer < 0 || e.producer >= PRODUCER_COUNT || e.sequence < 0 || e.sequence >= ITEMS_PER_PRODUCER)
+                    return 1; // corrupt
+                if (e.payload[0] != e.sequence || e.payload[1] != e.sequence)
+                    return 1; // torn
+                if (e.sequence <= lastSequence[e.producer])
+                    return 1; // out of order
+                lastSequence[e.producer] = e.sequence;
+                receivedCount_[e.producer * ITEMS_PER_PRODUCER + e.sequence].fetch_add(1, std::memory_order_relaxed);
+            }
+            poppedCount_.fetch_add(static_cast<int>(n), std::memory_order_relaxed);
+        }
+        return 0;
+    }
+}
+
+TEST_CASE("qw/mpmc_bounded_queue/multi-threaded", "[slow][fuzz] QwMpmcBoundedQueue multi-threaded test") {
+
+    testQueue_ = new TestQueue(64);
+    poppedCount_.store(0);
+    for (int i=0; i < TOTAL_ITEMS; ++i)
+        receivedCount_[i].store(0);
+
+    const int threadCount = PRODUCER_COUNT + CONSUMER_COUNT;
+    unsigned results[threadCount];
+    std::thread* threads[threadCount];
+
+    for (int i=0; i < threadCount; ++i) {
+        results[i] = 1;
+        if (i < PRODUCER_COUNT)
+            threads[i] = new std::thread([&results, i]{ results[i] = producerThreadProc(i); });
+        else
+            threads[i] = new std::thread([&results, i]{ results[i] = consumerThreadProc(i - PRODUCER_COUNT); });
+    }
+
+    for (int i=0; i < threadCount; ++i) {
+        threads[i]->join();
+        delete threads[i];
+        REQUIRE(results[i] == 0);
+    }
+
+    REQUIRE(poppedCount_.load() == TOTAL_ITEMS);
+    for (int i=0; i < TOTAL_ITEMS; ++i) {
+        if (receivedCount_[i].load() != 1)
+            REQUIRE(receivedCount_[i].load() == 1); // (only invoke REQUIRE on failure, it's slow)
+    }
+
+    TestEvent e;
+    REQUIRE(testQueue_->try_pop(e) == false);
+    delete testQueue_;
+}
@@ -0,0 +1,287 @@
+/*
+    Queue World is copyright (c) 2014-2018 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#include <atomic>
+#include <cstddef> // size_t
+#include <thread>
+
+// Simulate threads being descheduled inside QwEpochReclaimer::enter(),
+// between reading and publishing the global epoch, while other threads
+// advance the epoch. So the stress test exercises stale epoch reads.
+static void enterPreemptionPoint();
+#define QW_EPOCHRECLAIMER_ENTER_PREEMPTION_POINT() enterPreemptionPoint()
+
+#include "QwMpmcFifoQueue.h"
+#include "QwEpochReclaimer.h"
+#include "QwNodePool.h"
+
+#include "catch.hpp"
+
+
+namespace {
+
+    struct TestNode{
+        std::atomic<TestNode*> links_[2];
+        enum { NEXT_LINK, RECLAIM_LINK, LINK_COUNT };
+
+        int value;
+
+        TestNode()
+            : value(0)
+        {
+            for (int i=0; i < LINK_COUNT; ++i)
+                links_[i].store(nullptr, std::memory_order_relaxed);
+        }
+    };
+
+    typedef QwEpochReclaimer<TestNode*, TestNode::RECLAIM_LINK> TestReclaimer;
+    typedef QwMpmcFifoQueue<TestNode*, TestNode::NEXT_LINK, TestNode::RECLAIM_LINK> TestQueue;
+
+    enum { POISON_VALUE = -1 };
+
+    struct ReclaimContext {
+        QwNodePool<TestNode> *pool;
+        std::atomic<std::size_t> reclaimedCount;
+    };
+
+    // Poison reclaimed nodes, so that consumers can detect premature reclamation
+    void reclaimToPool(TestReclaimer::list_type& nodes, void *context)
+    {
+        ReclaimContext *c = static_cast<ReclaimContext*>(context);
+        std::size_t count = 0;
+        for (TestReclaimer::list_type::iterator i = nodes.begin(); i != nodes.end(); ++i) {
+            (*i)->value = POISON_VALUE;
+            ++count;
+        }
+        c->reclaimedCount.fetch_add(count, std::memory_order_relaxed);
+        c->pool->deallocate_list(nodes);
+    }
+
+} // end anonymous namespace
+
+TEST_CASE("qw/mpmc_fifo_queue", "QwMpmcFifoQueue single threaded test") {
+
+    QwNodePool<TestNode> pool(100);
+    ReclaimContext context;
+    context.pool = &pool;
+    context.reclaimedCount.store(0);
+
+    TestReclaimer reclaimer(2, reclaimToPool, &context);
+    std::size_t t = reclaimer.register_thread();
+
+    TestQueue *queue = new TestQueue(reclaimer, pool.allocate());
+    REQUIRE(&queue->reclaimer() == &reclaimer);
+
+    {
+        TestReclaimer::Guard guard(reclaimer, t);
+        REQUIRE(queue->empty());
+        REQUIRE(queue->pop(t) == nullptr);
+
+        for (int i=0; i < 10; ++i) {
+            TestNode *n = pool.allocate();
+            n->value = i;
+            queue->push(n);
+            REQUIRE(!queue->empty());
+        }
+
+        // FIFO order. the popped node becomes the dummy, and the previous dummy is retired
+        for (int i=0; i < 10; ++i) {
+            TestNode *n = queue->pop(t);
+            REQUIRE(n != nullptr);
+            REQUIRE(n->value == i);
+            REQUIRE(queue->dummy_node() == n);
+        }
+
+        REQUIRE(queue->empty());
+        REQUIRE(queue->pop(t) == nullptr);
+
+        // interleaved push and pop
+        for (int i=0; i < 10; ++i) {
+            TestNode *n = pool.allocate();
+            n->value = 100 + i;
+            queue->push(n);
+            if ((i % 2) == 1) {
+                REQUIRE(queue->pop(t)->value == 100 + i - 1);
+                REQUIRE(queue->pop(t)->value == 100 + i);
+            }
+        }
+        REQUIRE(queue->pop(t) == nullptr);
+    }
+
+    // retired dummies are reclaimed once the epoch advances
+    for (int i=0; i < 4; ++i) {
+        TestReclaimer::Guard guard(reclaimer, t);
+        reclaimer.try_advance();
+    }
+    REQUIRE(context.reclaimedCount.load() == 20); // initial dummy, plus all but the last popped node
+
+    TestNode *dummy = queue->dummy_node();
+    REQUIRE(dummy->value == 109);
+    delete queue;
+    pool.deallocate(dummy);
+
+    reclaimer.unregister_thread(t);
+}
+
+namespace {
+
+    static const int PRODUCER_COUNT=2;
+    static const int CONSUMER_COUNT=2;
+    static const int ITEMS_PER_PRODUCER=50000;
+    static const int TOTAL_ITEMS=PRODUCER_COUNT*ITEMS_PER_PRODUCER;
+    static const int POOL_SIZE=1000; // nodes are recycled, so premature reclamation corrupts the queue
+
+    static TestReclaimer *testReclaimer_;
+    static TestQueue *testQueue_;
+    static QwNodePool<TestNode> *testPool_;
+    static std::atomic<int> poppedCount_;
+    static std::atomic<int> receivedCount_[TOTAL_ITEMS];
+    static std::atomic<unsigned> enterCount_;
+
+} // end anonymous namespace
+
+static void enterPreemptionPoint()
+{
+    if (testReclaimer_ && (enterCount_.fetch_add(1, std::memory_order_relaxed) % 16) == 0) {
+        std::this_thread::yield();
+        testReclaimer_->try_advance();
+        testReclaimer_->try_advance();
+    }
+}
+
+namespace {
+
+    static unsigned producerThreadProc(int producer)
+    {
+        std::size_t t = testReclaimer_->register_thread();
+        if (t == testReclaimer_->max_threads())
+            return 1;
+
+        for (int i=0; i < ITEMS_PER_PRODUCER; ++i) {
+            TestNode *n = testPool_->allocate();
+            while (!n) { // wait for consumers to reclaim nodes
+                std::this_thread::yield();
+                n = testPool_->allocate();
+            }
+            n->value = producer * ITEMS_PER_PRODUCER + i;
+
+            TestReclaimer::Guard guard(*testReclaimer_, t);
+            testQueue_->push(n);
+        }
+
+        testReclaimer_->unregister_thread(t);
+        return 0;
+    }
+
+    // Check that nodes are received exactly once, in per-producer FIFO order,
+    // and are not reclaimed while the consumer can still see them.
+    static unsigned consumerThreadProc()
+    {
+        std::size_t t = testReclaimer_->register_thread();
+        if (t == testReclaimer_->max_threads())
+            return 1;
+
+        int lastSequence[PRODUCER_COUNT];
+        for (int i=0; i < PRODUCER_COUNT; ++i)
+            lastSequence[i] = -1;
+
+        unsigned result = 0;
+        while (poppedCount_.load(std::memory_order_relaxed) < TOTAL_ITEMS && result == 0) {
+            TestReclaimer::Guard guard(*testReclaimer_, t);
+            TestNode *n = testQueue_->pop(t);
+            if (!n) {
+                std::this_thread::yield();
+                continue;
+            }
+
+            int value = n->value;
+            if (value < 0 || value >= TOTAL_ITEMS) {
+                result = 1; // poisoned (reclaimed while reachable) or corrupt
+                break;
+            }
+
+            int producer = value / ITEMS_PER_PRODUCER;
+            int sequence = value % ITEMS_PER_PRODUCER;
+            if (sequence <= lastSequence[producer])
+                result = 1; // out of order
+            lastSequence[producer] = sequence;
+
+            receivedCount_[value].fetch_add(1, std::memory_order_relaxed);
+            poppedCount_.fetch_add(1, std::memory_order_relaxed);
+
+            if ((sequence % 64) == 0)
+                std::this_thread::yield(); // (widen the window for premature reclamation)
+            if (n->value != value)
+                result = 1;
+        }
+
+        testReclaimer_->unregister_thread(t);
+        return result;
+    }
+}
+
+TEST_CASE("qw/mpmc_fifo_queue/multi-threaded", "[slow][fuzz] QwMpmcFifoQueue multi-threaded test") {
+
+    testPool_ = new QwNodePool<TestNode>(POOL_SIZE);
+    ReclaimContext context;
+    context.pool = testPool_;
+    context.reclaimedCount.store(0);
+    testReclaimer_ = new TestReclaimer(PRODUCER_COUNT + CONSUMER_COUNT, reclaimToPool, &context);
+    testQueue_ = new TestQueue(*testReclaimer_, testPool_->allocate());
+
+    poppedCount_.store(0);
+    for (int i=0; i < TOTAL_ITEMS; ++i)
+        receivedCount_[i].store(0);
+
+    const int threadCount = PRODUCER_COUNT + CONSUMER_COUNT;
+    unsigned results[threadCount];
+    std::thread* threads[threadCount];
+
+    for (int i=0; i < threadCount; ++i) {
+        results[i] = 1;
+        if (i < PRODUCER_COUNT)
+            threads[i] = new std::thread([&results, i]{ results[i] = producerThreadProc(i); });
+        else
+            threads[i] = new std::thread([&results, i]{ results[i] = consumerThreadProc(); });
+    }
+
+    for (int i=0; i < threadCount; ++i) {
+        threads[i]->join();
+        delete threads[i];
+        REQUIRE(results[i] == 0);
+    }
+
+    REQUIRE(poppedCount_.load() == TOTAL_ITEMS);
+    for (int i=0; i < TOTAL_ITEMS; ++i) {
+        if (receivedCount_[i].load() != 1)
+            REQUIRE(receivedCount_[i].load() == 1); // (only invoke REQUIRE on failure, it's slow)
+    }
+
+    TestNode *dummy = testQueue_->dummy_node();
+    delete testQueue_;
+    testPool_->deallocate(dummy);
+
+    delete testReclaimer_;
+    testReclaimer_ = nullptr;
+    REQUIRE(context.reclaimedCount.load() == TOTAL_ITEMS);
+
+    delete testPool_;
+}
@@ -20,6 +20,10 @@
     SOFTWARE.
 */
 #include "QwMpscFifoQueue.h"
+#include "QwSTailList.h"
+
+#include <chrono>
+#include <thread>
 
 #include "catch.hpp"
 
@@ -41,6 +45,7 @@ namespace {
     };
 
     typedef QwMpscFifoQueue<TestNode*, TestNode::LINK_INDEX_1> TestMpscFifoQueue;
+    typedef QwSTailList<TestNode*, TestNode::LINK_INDEX_1> TestSTailList;
 
     TestNode*& next_(TestNode*n) { return n->links_[TestNode::LINK_INDEX_1]; }
 
@@ -117,3 +122,188 @@ TEST_CASE("qw/mpsc_fifo_queue", "QwMpscFifoQueue single threaded test") {
     REQUIRE(q.pop() == c);
     REQUIRE(q.pop() == d);
 }
+
+TEST_CASE("qw/mpsc_fifo_queue/pop_all", "QwMpscFifoQueue pop_all() and pop_up_to() test") {
+
+    const int NODE_COUNT = 10;
+    TestNode nodes[NODE_COUNT];
+    for (int i=0; i < NODE_COUNT; ++i)
+        nodes[i].value = i;
+
+    TestMpscFifoQueue q;
+    TestSTailList result;
+
+    // empty queue
+    q.pop_all(result);
+    REQUIRE(result.empty());
+    REQUIRE(q.pop_up_to(5, result) == 0);
+    REQUIRE(result.empty());
+
+    // pop_all() appends in fifo order
+    for (int i=0; i < 4; ++i)
+        q.push(&nodes[i]);
+    q.pop_all(result);
+    REQUIRE(q.consumer_empty() == true);
+    REQUIRE(result.front() == &nodes[0]);
+    REQUIRE(result.back() == &nodes[3]);
+
+    for (int i=4; i < 6; ++i)
+        q.push(&nodes[i]);
+    q.pop_all(result); // appends to the existing nodes in result
+    REQUIRE(result.back() == &nodes[5]);
+    {
+        int expected = 0;
+        for (TestSTailList::iterator i=result.begin(); i != result.end(); ++i)
+            REQUIRE((*i)->value == expected++);
+        REQUIRE(expected == 6);
+    }
+    while (!result.empty())
+        result.pop_front();
+
+    // pop_up_to() leaves the remainder in the queue, in order
+    for (int i=0; i < NODE_COUNT; ++i)
+        q.push(&nodes[i]);
+    REQUIRE(q.pop_up_to(0, result) == 0);
+    REQUIRE(q.pop_up_to(3, result) == 3);
+    REQUIRE(result.back() == &nodes[2]);
+    REQUIRE(q.pop() == &nodes[3]); // pop() continues from where pop_up_to() stopped
+    REQUIRE(q.pop_up_to(2, result) == 2); // (from the consumer-local queue)
+    REQUIRE(result.back() == &nodes[5]);
+
+    // take the rest of the consumer-local queue, then newly pushed nodes
+    q.push(&nodes[3]);
+    REQUIRE(q.pop_up_to(5, result) == 5); // 6..9, then 3
+    REQUIRE(result.back() == &nodes[3]);
+    REQUIRE(q.consumer_empty() == true);
+    REQUIRE(q.pop_up_to(5, result) == 0);
+
+    {
+        const int expected[] = { 0, 1, 2, 4, 5, 6, 7, 8, 9, 3 };
+        int k = 0;
+        while (!result.empty())
+            REQUIRE(result.pop_front()->value == expected[k++]);
+        REQUIRE(k == NODE_COUNT);
+    }
+
+    // mix with pop() and pop_all()
+    for (int i=0; i < 5; ++i)
+        q.push(&nodes[i]);
+    REQUIRE(q.pop() == &nodes[0]); // 1..4 now in the consumer-local queue
+    q.push(&nodes[5]);
+    q.push(&nodes[6]);
+    REQUIRE(q.pop_up_to(6, result) == 6); // 1..4 from the local queue, then 5, 6
+    REQUIRE(result.back() == &nodes[6]);
+    q.push(&nodes[7]);
+    q.push(&nodes[8]);
+    q.push(&nodes[9]);
+    REQUIRE(q.pop_up_to(1, result) == 1); // 7. 8, 9 move to the local queue
+    q.push(&nodes[0]);
+    q.pop_all(result); // 8, 9, then 0
+    REQUIRE(q.consumer_empty() == true);
+
+    {
+        const int expected[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 0 };
+        int k = 0;
+        while (!result.empty())
+            REQUIRE(result.pop_front()->value == expected[k++]);
+        REQUIRE(k == NODE_COUNT);
+    }
+}
+
+TEST_CASE("qw/mpsc_fifo_queue/pop_wait", "QwMpscFifoQueue pop_wait() and pop_wait_for() test") {
+
+    typedef std::chrono::steady_clock clock;
+    TestNode nodes[3];
+    for (int i=0; i < 3; ++i)
+        nodes[i].value = i;
+
+    TestMpscFifoQueue q;
+
+    // available nodes are returned without waiting, including from the consumer-local queue
+    q.push(&nodes[0]);
+    q.push(&nodes[1]);
+    REQUIRE(q.pop_wait_for(std::chrono::nanoseconds::zero()) == &nodes[0]);
+    REQUIRE(q.pop_wait() == &nodes[1]);
+
+    // times out when nothing is pushed
+    REQUIRE(q.pop_wait_for(std::chrono::nanoseconds::zero()) == (TestNode*)nullptr);
+    clock::time_point start = clock::now();
+    REQUIRE(q.pop_wait_for(std::chrono::milliseconds(20)) == (TestNode*)nullptr);
+    REQUIRE((clock::now() - start >= std::chrono::milliseconds(20)));
+
+    // woken by push_notify()
+    std::thread producer([&q, &nodes]{
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        q.push_notify(&nodes[2]);
+    });
+    start = clock::now();
+    REQUIRE(q.pop_wait_for(std::chrono::seconds(10)) == &nodes[2]);
+    REQUIRE((clock::now() - start < std::chrono::seconds(10)));
+    producer.join();
+
+    producer = std::thread([&q, &nodes]{
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        q.push_notify(&nodes[0]);
+    });
+    REQUIRE(q.pop_wait() == &nodes[0]);
+    producer.join();
+
+    REQUIRE(q.consumer_empty() == true);
+}
+
+namespace {
+
+    static const int WAIT_TEST_PRODUCER_COUNT = 4;
+    static const int WAIT_TEST_NODES_PER_PRODUCER = 20000;
+
+} // end anonymous namespace
+
+TEST_CASE("qw/mpsc_fifo_queue/pop_wait/multi-threaded", "[slow][fuzz] QwMpscFifoQueue multi-threaded blocking consumer test") {
+
+    // producers push in bursts separated by sleeps, so the consumer
+    // repeatedly drains the queue and parks. every node must be delivered,
+    // in order per producer, without the consumer ever missing a wakeup.
+
+    TestMpscFifoQueue q;
+    TestNode *nodes = new TestNode[WAIT_TEST_PRODUCER_COUNT * WAIT_TEST_NODES_PER_PRODUCER];
+
+    std::thread* threads[WAIT_TEST_PRODUCER_COUNT];
+    for (int i=0; i < WAIT_TEST_PRODUCER_COUNT; ++i) {
+        threads[i] = new std::thread([&q, nodes, i]{
+            TestNode *producerNodes = nodes + i * WAIT_TEST_NODES_PER_PRODUCER;
+            for (int j=0; j < WAIT_TEST_NODES_PER_PRODUCER; ++j) {
+                producerNodes[j].value = j;
+                q.push_notify(&producerNodes[j]);
+                if (j % 1000 == 999)
+                    std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+        });
+    }
+
+    int nextExpected[WAIT_TEST_PRODUCER_COUNT];
+    for (int i=0; i < WAIT_TEST_PRODUCER_COUNT; ++i)
+        nextExpected[i] = 0;
+
+    bool ok = true;
+    for (int k=0; k < WAIT_TEST_PRODUCER_COUNT * WAIT_TEST_NODES_PER_PRODUCER; ++k) {
+        TestNode *n = q.pop_wait_for(std::chrono::seconds(10));
+        if (!n) {
+            ok = false; // lost wakeup (or a very slow machine)
+            break;
+        }
+        int producer = static_cast<int>((n - nodes) / WAIT_TEST_NODES_PER_PRODUCER);
+        if (n->value != nextExpected[producer])
+            ok = false;
+        nextExpected[producer] = n->value + 1;
+    }
+
+    for (int i=0; i < WAIT_TEST_PRODUCER_COUNT; ++i) {
+        threads[i]->join();
+        delete threads[i];
+    }
+
+    REQUIRE(ok);
+    REQUIRE(q.consumer_empty() == true);
+
+    delete [] nodes;
+}
@@ -0,0 +1,193 @@
+/*
+    Queue World is copyright (c) 2014-2018 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#include "QwNodePoolMagazine.h"
+#include "QwNodePool.h"
+#include "QwSList.h"
+
+#include "catch.hpp"
+
+#include <cstddef> // size_t
+#include <thread>
+
+
+namespace {
+
+    struct TestNode{
+        TestNode *links_[2];
+        enum { LINK_INDEX_1, LINK_COUNT };
+
+        int value;
+
+        TestNode()
+            : value(0)
+        {
+            for (int i=0; i < LINK_COUNT; ++i)
+                links_[i] = nullptr;
+        }
+    };
+
+    typedef QwSList<TestNode*, TestNode::LINK_INDEX_1> TestSList;
+
+    typedef QwNodePoolMagazine<TestNode, 8> TestMagazine;
+
+} // end anonymous namespace
+
+TEST_CASE("qw/node_pool_magazine", "QwNodePoolMagazine single threaded test") {
+
+    size_t maxNodes = 21;
+
+    QwNodePool<TestNode> pool(maxNodes);
+
+    {
+        TestMagazine magazine(pool);
+        REQUIRE(magazine.size() == 0);
+
+        // first allocation refills the magazine with a batch of capacity/2 nodes
+        TestNode *a = magazine.allocate();
+        REQUIRE(a != (TestNode*)nullptr);
+        REQUIRE(magazine.size() == TestMagazine::capacity()/2 - 1);
+
+        // deallocate then allocate returns the same node without touching the pool
+        magazine.deallocate(a);
+        REQUIRE(magazine.size() == TestMagazine::capacity()/2);
+        REQUIRE(magazine.allocate() == a);
+        magazine.deallocate(a);
+
+        // all nodes can be allocated through the magazine
+        TestSList allocatedNodes;
+        for (size_t i=0; i < maxNodes; ++i) {
+            TestNode *n = magazine.allocate();
+            REQUIRE(n != (TestNode*)nullptr);
+            allocatedNodes.push_front(n);
+        }
+
+        REQUIRE(magazine.allocate() == (TestNode*)nullptr);
+        REQUIRE(pool.allocate() == (TestNode*)nullptr);
+
+        // deallocating more than capacity nodes flushes batches to the pool
+        while (!allocatedNodes.empty()) {
+            magazine.deallocate(allocatedNodes.pop_front());
+            REQUIRE(magazine.size() <= TestMagazine::capacity());
+        }
+        REQUIRE(magazine.size() > 0);
+
+        // flush returns all stashed nodes to the pool
+        magazine.flush();
+        REQUIRE(magazine.size() == 0);
+    }
+
+    // pool holds all nodes again
+    TestSList allocatedNodes;
+    for (size_t i=0; i < maxNodes; ++i) {
+        TestNode *n = pool.allocate();
+        REQUIRE(n != (TestNode*)nullptr);
+        allocatedNodes.push_front(n);
+    }
+
+    REQUIRE(pool.allocate() == (TestNode*)nullptr);
+
+    {
+        // the magazine destructor flushes
+        TestMagazine magazine(pool);
+        while (!allocatedNodes.empty())
+            magazine.deallocate(allocatedNodes.pop_front());
+    }
+
+    for (size_t i=0; i < maxNodes; ++i) {
+        TestNode *n = pool.allocate();
+        REQUIRE(n != (TestNode*)nullptr);
+        allocatedNodes.push_front(n);
+    }
+
+    while (!allocatedNodes.empty())
+        pool.deallocate(allocatedNodes.pop_front());
+}
+
+
+namespace {
+
+    static const std::size_t TEST_THREAD_COUNT=8;
+    static const std::size_t TEST_NODES_PER_THREAD=20;
+    static const std::size_t THREAD_ITERATIONS=100000;
+
+    static QwNodePool<TestNode> *testPool_;
+
+    static unsigned testThreadProc()
+    {
+        TestMagazine magazine(*testPool_);
+        TestSList allocatedNodes;
+
+        for (std::size_t i=0; i < THREAD_ITERATIONS; ++i) {
+            std::size_t n = (i % TEST_NODES_PER_THREAD) + 1;
+
+            // allocate a varying number of nodes, then free them all.
+            // every thread allocates at most TEST_NODES_PER_THREAD, the pool is
+            // sized to cover that plus a full magazine per thread.
+            for (std::size_t j=0; j < n; ++j) {
+                TestNode *node = magazine.allocate();
+                if (!node)
+                    return 1;
+                node->value = static_cast<int>(j);
+                allocatedNodes.push_front(node);
+            }
+
+            while (!allocatedNodes.empty())
+                magazine.deallocate(allocatedNodes.pop_front());
+        }
+
+        return 0;
+    }
+}
+
+TEST_CASE("qw/node_pool_magazine/multi-threaded", "[slow][fuzz] QwNodePoolMagazine multi-threaded sanity test") {
+
+    size_t maxNodes = TEST_THREAD_COUNT * (TEST_NODES_PER_THREAD + TestMagazine::capacity());
+    testPool_ = new QwNodePool<TestNode>(maxNodes);
+
+    unsigned results[TEST_THREAD_COUNT];
+    std::thread* threads[TEST_THREAD_COUNT];
+
+    for (std::size_t i=0; i < TEST_THREAD_COUNT; ++i) {
+        results[i] = 1;
+        threads[i] = new std::thread([&results, i]{ results[i] = testThreadProc(); });
+    }
+
+    for (std::size_t i=0; i < TEST_THREAD_COUNT; ++i) {
+        threads[i]->join();
+        delete threads[i];
+        REQUIRE(results[i] == 0);
+    }
+
+    // magazines have been flushed by their destructors. all nodes are available.
+    TestSList allocatedNodes;
+    for (size_t i=0; i < maxNodes; ++i) {
+        TestNode *n = testPool_->allocate();
+        REQUIRE(n != (TestNode*)nullptr);
+        allocatedNodes.push_front(n);
+    }
+    REQUIRE(testPool_->allocate() == (TestNode*)nullptr);
+
+    while (!allocatedNodes.empty())
+        testPool_->deallocate(allocatedNodes.pop_front());
+
+    delete testPool_;
+}
@@ -24,6 +24,13 @@
 
 #include "catch.hpp"
 
+#include <atomic>
+#include <chrono>
+#include <cstddef> // size_t
+#include <cstdint>
+#include <thread>
+#include <vector>
+
 
 namespace {
 
@@ -65,6 +72,712 @@ TEST_CASE("qw/node_pool", "QwNodePool single threaded test") {
         pool.deallocate(allocatedNodes.pop_front());
 }
 
+TEST_CASE("qw/node_pool/batch", "QwNodePool batch allocate_n and deallocate_list test") {
+
+    size_t maxNodes = 21;
+
+    QwNodePool<TestNode> pool(maxNodes);
+
+    TestSList allocatedNodes;
+
+    // allocate_n pushes allocated nodes onto the list
+    REQUIRE(pool.allocate_n(0, allocatedNodes) == 0);
+    REQUIRE(allocatedNodes.empty());
+    REQUIRE(pool.allocate_n(5, allocatedNodes) == 5);
+    REQUIRE(pool.allocate_n(10, allocatedNodes) == 10);
+
+    // a request that exceeds the available nodes returns the remainder
+    REQUIRE(pool.allocate_n(10, allocatedNodes) == maxNodes - 15);
+    REQUIRE(pool.allocate_n(10, allocatedNodes) == 0);
+    REQUIRE(pool.allocate() == (TestNode*)nullptr);
+
+    size_t count = 0;
+    for (TestSList::iterator i = allocatedNodes.begin(); i != allocatedNodes.end(); ++i)
+        ++count;
+    REQUIRE(count == maxNodes);
+
+    // deallocate_list(front, back) returns part of a chain
+    TestNode *front = allocatedNodes.front();
+    TestNode *back = front;
+    for (int i=0; i < 3; ++i)
+        back = TestSList::next(back);
+    TestSList remainder(TestSList::next(back));
+    back->links_[TestNode::LINK_INDEX_1] = nullptr;
+    allocatedNodes.release();
+
+    pool.deallocate_list<TestNode::LINK_INDEX_1>(front, back);
+
+    for (int i=0; i < 4; ++i) {
+        TestNode *n = pool.allocate();
+        REQUIRE(n != (TestNode*)nullptr);
+        allocatedNodes.push_front(n);
+    }
+    REQUIRE(pool.allocate() == (TestNode*)nullptr);
+
+    // deallocate_list(list) returns a whole list
+    pool.deallocate_list(allocatedNodes);
+    REQUIRE(allocatedNodes.empty());
+    pool.deallocate_list(remainder);
+    REQUIRE(remainder.empty());
+
+    REQUIRE(pool.allocate_n(maxNodes + 1, allocatedNodes) == maxNodes);
+    pool.deallocate_list(allocatedNodes);
+}
+
+TEST_CASE("qw/raw_node_pool/batch", "QwRawNodePool batch allocate_n and deallocate_n test") {
+
+    const size_t maxNodes = 13;
+
+    QwRawNodePool pool(sizeof(TestNode), maxNodes);
+
+    void *nodes[maxNodes + 1];
+    REQUIRE(pool.allocate_n(nodes, maxNodes + 1) == maxNodes);
+    for (size_t i=0; i < maxNodes; ++i) {
+        REQUIRE(nodes[i] != nullptr);
+        for (size_t j=0; j < i; ++j)
+            REQUIRE(nodes[i] != nodes[j]);
+    }
+    REQUIRE(pool.allocate() == nullptr);
+
+    // nodes come back in the order that they were deallocated
+    pool.deallocate_n(nodes, 3);
+    void *x[3];
+    REQUIRE(pool.allocate_n(x, 3) == 3);
+    REQUIRE(x[0] == nodes[0]);
+    REQUIRE(x[1] == nodes[1]);
+    REQUIRE(x[2] == nodes[2]);
+
+    pool.deallocate_n(nodes, maxNodes);
+}
+
+TEST_CASE("qw/node_pool/expandable", "QwNodePool expandable pool test") {
+
+    size_t maxNodes = 1000;
+
+    // fixed-size pools don't grow
+    {
+        QwNodePool<TestNode> pool(10);
+        REQUIRE(pool.capacity() == 10);
+        REQUIRE(pool.max_capacity() == 10);
+        REQUIRE(pool.grow() == 0);
+    }
+
+    QwNodePool<TestNode> pool(maxNodes, 1, 50);
+
+    // initial capacity and segment size are rounded up to whole pages
+    size_t segmentSize = pool.capacity();
+    REQUIRE(segmentSize >= 50);
+    REQUIRE(segmentSize < maxNodes);
+    REQUIRE(pool.max_capacity() == maxNodes);
+    REQUIRE(pool.growth_requested() == false);
+
+    TestSList allocatedNodes;
+    REQUIRE(pool.allocate_n(maxNodes, allocatedNodes) == segmentSize);
+    REQUIRE(pool.allocate() == (TestNode*)nullptr);
+    REQUIRE(pool.growth_requested() == true);
+
+    // each grow() adds a segment, up to max_capacity()
+    size_t allocatedCount = segmentSize;
+    while (pool.capacity() < pool.max_capacity()) {
+        size_t added = pool.grow();
+        REQUIRE(added > 0);
+        REQUIRE(added <= segmentSize);
+        REQUIRE(pool.growth_requested() == false);
+
+        for (size_t i=0; i < added; ++i) {
+            TestNode *n = pool.allocate();
+            REQUIRE(n != (TestNode*)nullptr);
+            n->value = static_cast<int>(i); // memory is writable
+            allocatedNodes.push_front(n);
+        }
+        allocatedCount += added;
+        REQUIRE(pool.allocate() == (TestNode*)nullptr);
+    }
+    REQUIRE(allocatedCount == maxNodes);
+    REQUIRE(pool.grow() == 0);
+
+    pool.deallocate_list(allocatedNodes);
+    REQUIRE(pool.allocate_n(maxNodes + 1, allocatedNodes) == maxNodes);
+    pool.deallocate_list(allocatedNodes);
+}
+
+namespace {
+
+    struct LargeTestNode{
+        LargeTestNode *links_[1];
+        enum { LINK_INDEX_1, LINK_COUNT };
+
+        int value;
+        char payload[130];
+
+        LargeTestNode()
+            : value(0)
+        {
+            links_[LINK_INDEX_1] = nullptr;
+        }
+    };
+
+    typedef QwSList<LargeTestNode*, LargeTestNode::LINK_INDEX_1> LargeTestSList;
+
+} // end anonymous namespace
+
+TEST_CASE("qw/node_pool/stride", "QwNodePool cache line multiple node stride test") {
+
+    size_t maxNodes = 300;
+
+    REQUIRE(QwNodePool<TestNode>(maxNodes).node_stride() == CACHE_LINE_SIZE);
+    REQUIRE(QwNodePool<TestNode>(maxNodes, QwRawNodePool::CACHE_LINE_STRIDE).node_stride() == CACHE_LINE_SIZE);
+    REQUIRE(QwNodePool<LargeTestNode>(maxNodes).node_stride() == 256);
+
+    // fixed and expandable pools with a 192 byte stride
+    QwNodePool<LargeTestNode> fixedPool(maxNodes, QwRawNodePool::CACHE_LINE_STRIDE);
+    QwNodePool<LargeTestNode> expandablePool(maxNodes, 1, 1, QwRawNodePool::CACHE_LINE_STRIDE);
+    QwNodePool<LargeTestNode> *pools[2] = { &fixedPool, &expandablePool };
+
+    for (int p=0; p < 2; ++p) {
+        QwNodePool<LargeTestNode>& pool = *pools[p];
+        REQUIRE(pool.node_stride() == 192);
+
+        while (pool.grow() > 0)
+            ;
+        REQUIRE(pool.capacity() == maxNodes);
+
+        // every node is distinct, cache line aligned, and on a stride boundary
+        LargeTestSList allocatedNodes;
+        LargeTestNode *lowest = nullptr;
+        for (size_t i=0; i < maxNodes; ++i) {
+            LargeTestNode *n = pool.allocate();
+            REQUIRE(n != (LargeTestNode*)nullptr);
+            REQUIRE((reinterpret_cast<std::uintptr_t>(n) % CACHE_LINE_SIZE) == 0);
+            n->value = static_cast<int>(i);
+            n->payload[sizeof(n->payload)-1] = 1; // memory is writable
+            if (!lowest || n < lowest)
+                lowest = n;
+            allocatedNodes.push_front(n);
+        }
+        REQUIRE(pool.allocate() == (LargeTestNode*)nullptr);
+
+        std::vector<bool> seen(maxNodes, false);
+        for (LargeTestSList::iterator i = allocatedNodes.begin(); i != allocatedNodes.end(); ++i) {
+            std::ptrdiff_t offset = reinterpret_cast<char*>(*i) - reinterpret_cast<char*>(lowest);
+            REQUIRE((offset % 192) == 0);
+            size_t index = static_cast<size_t>(offset / 192);
+            REQUIRE(index < maxNodes);
+            REQUIRE(seen[index] == false);
+            seen[index] = true;
+        }
+
+        // exercise index<->pointer conversion through the freelist
+        pool.deallocate_list(allocatedNodes);
+        REQUIRE(pool.allocate_n(maxNodes + 1, allocatedNodes) == maxNodes);
+        pool.deallocate_list(allocatedNodes);
+    }
+}
+
+TEST_CASE("qw/node_pool/coloured_stride", "QwNodePool cache coloured node stride test") {
+
+    REQUIRE(QwRawNodePool::node_stride_for(1, QwRawNodePool::COLOURED_STRIDE) == CACHE_LINE_SIZE);
+    REQUIRE(QwRawNodePool::node_stride_for(100, QwRawNodePool::COLOURED_STRIDE) == 3 * CACHE_LINE_SIZE);
+    REQUIRE(QwRawNodePool::node_stride_for(3 * CACHE_LINE_SIZE, QwRawNodePool::COLOURED_STRIDE) == 3 * CACHE_LINE_SIZE);
+    REQUIRE(QwRawNodePool::node_stride_for(1024, QwRawNodePool::COLOURED_STRIDE) == 1024 + CACHE_LINE_SIZE);
+
+    const size_t setCount = 64; // a typical L1 set count
+    size_t maxNodes = setCount;
+    QwRawNodePool fixedPool(1024, maxNodes, QwRawNodePool::COLOURED_STRIDE);
+    QwRawNodePool expandablePool(1024, maxNodes, 1, 1, QwRawNodePool::COLOURED_STRIDE);
+    QwRawNodePool *pools[2] = { &fixedPool, &expandablePool };
+
+    for (int p=0; p < 2; ++p) {
+        QwRawNodePool& pool = *pools[p];
+        while (pool.grow() > 0)
+            ;
+        REQUIRE(pool.capacity() == maxNodes);
+
+        // the first cache line of each node maps to a different set
+        std::vector<void*> nodes;
+        std::vector<bool> setUsed(setCount, false);
+        for (size_t i=0; i < maxNodes; ++i) {
+            void *n = pool.allocate();
+            REQUIRE(n != nullptr);
+            REQUIRE((reinterpret_cast<std::uintptr_t>(n) % CACHE_LINE_SIZE) == 0);
+            size_t set = (reinterpret_cast<std::uintptr_t>(n) / CACHE_LINE_SIZE) % setCount;
+            REQUIRE(setUsed[set] == false);
+            setUsed[set] = true;
+            nodes.push_back(n);
+        }
+        REQUIRE(pool.allocate() == nullptr);
+
+        for (size_t i=0; i < nodes.size(); ++i)
+            pool.deallocate(nodes[i]);
+    }
+}
+
+TEST_CASE("qw/node_pool/storage_policy", "QwNodePool storage policy test") {
+
+    size_t maxNodes = 100;
+
+    {
+        QwNodePool<TestNode> pool(maxNodes);
+        QwRawNodePool::StorageInfo info = pool.storage_info();
+        REQUIRE(info.requestedPolicy == QwRawNodePool::DEFAULT_STORAGE);
+        REQUIRE(info.appliedPolicy == QwRawNodePool::DEFAULT_STORAGE);
+        REQUIRE(info.committedBytes == maxNodes * pool.node_stride());
+    }
+
+    int policies[] = {
+        QwRawNodePool::PREFAULT_STORAGE,
+        QwRawNodePool::HUGE_PAGE_STORAGE,
+        QwRawNodePool::HUGE_PAGE_STORAGE | QwRawNodePool::PREFAULT_STORAGE,
+        QwRawNodePool::LOCKED_STORAGE,
+        QwRawNodePool::HUGE_PAGE_STORAGE | QwRawNodePool::LOCKED_STORAGE
+    };
+
+    for (size_t i=0; i < sizeof(policies) / sizeof(policies[0]); ++i) {
+        int policy = policies[i];
+
+        QwNodePool<TestNode> fixedPool(maxNodes, QwRawNodePool::POWER_OF_TWO_STRIDE, policy);
+        QwNodePool<TestNode> expandablePool(maxNodes, 1, 1, QwRawNodePool::POWER_OF_TWO_STRIDE, policy);
+        QwNodePool<TestNode> *pools[2] = { &fixedPool, &expandablePool };
+
+        for (int p=0; p < 2; ++p) {
+            QwNodePool<TestNode>& pool = *pools[p];
+            QwRawNodePool::StorageInfo info = pool.storage_info();
+            REQUIRE(info.requestedPolicy == policy);
+
+            // best effort: policies may be dropped (e.g. no huge page support, RLIMIT_MEMLOCK), but never added,
+            // except that locking implies pre-faulting
+            int allowed = policy;
+            if (policy & QwRawNodePool::LOCKED_STORAGE)
+                allowed |= QwRawNodePool::PREFAULT_STORAGE;
+            REQUIRE((info.appliedPolicy & ~allowed) == 0);
+            REQUIRE((info.appliedPolicy & QwRawNodePool::PREFAULT_STORAGE) == (allowed & QwRawNodePool::PREFAULT_STORAGE));
+
+            if (policy & QwRawNodePool::HUGE_PAGE_STORAGE)
+                REQUIRE(info.pageSize >= 2 * 1024 * 1024);
+
+            while (pool.grow() > 0)
+                ;
+            REQUIRE(pool.capacity() == maxNodes);
+            REQUIRE(pool.storage_info().committedBytes == maxNodes * pool.node_stride());
+
+            // storage is aligned to the reported page size
+            TestSList allocatedNodes;
+            REQUIRE(pool.allocate_n(maxNodes, allocatedNodes) == maxNodes);
+            TestNode *lowest = allocatedNodes.front();
+            for (TestSList::iterator j = allocatedNodes.begin(); j != allocatedNodes.end(); ++j) {
+                (*j)->value = 1; // memory is writable
+                if (*j < lowest)
+                    lowest = *j;
+            }
+            REQUIRE((reinterpret_cast<std::uintptr_t>(lowest) % info.pageSize) == 0);
+            pool.deallocate_list(allocatedNodes);
+        }
+    }
+}
+
+TEST_CASE("qw/node_pool/stats", "QwNodePool statistics test") {
+
+    size_t maxNodes = 21;
+
+    QwNodePool<TestNode> pool(maxNodes);
+
+    QwRawNodePool::Stats stats = pool.stats();
+    REQUIRE(stats.liveCount == 0);
+    REQUIRE(stats.highWaterMark == 0);
+    REQUIRE(stats.allocations == 0);
+
+    TestSList allocatedNodes;
+    for (size_t i=0; i < 5; ++i)
+        allocatedNodes.push_front(pool.allocate());
+    while (!allocatedNodes.empty()) // recycled nodes don't raise the high-water mark
+        pool.deallocate(allocatedNodes.pop_front());
+    for (size_t i=0; i < 3; ++i)
+        allocatedNodes.push_front(pool.allocate());
+    REQUIRE(pool.allocate_n(maxNodes, allocatedNodes) == maxNodes - 3);
+    REQUIRE(pool.allocate() == (TestNode*)nullptr);
+
+    stats = pool.stats();
+    if (QwRawNodePool::stats_enabled()) {
+        REQUIRE(stats.liveCount == maxNodes);
+        REQUIRE(stats.highWaterMark == maxNodes);
+        REQUIRE(stats.allocations == 5 + maxNodes);
+        REQUIRE(stats.deallocations == 5);
+        REQUIRE(stats.exhaustions == 2); // short allocate_n() and failed allocate()
+        REQUIRE(stats.popCasFailures == 0); // no contention
+        REQUIRE(stats.pushCasFailures == 0);
+        REQUIRE(stats.eliminations == 0);
+    } else {
+        REQUIRE(stats.liveCount == 0);
+        REQUIRE(stats.highWaterMark == 0);
+        REQUIRE(stats.allocations == 0);
+        REQUIRE(stats.exhaustions == 0);
+    }
+
+    pool.deallocate_list(allocatedNodes);
+
+    stats = pool.stats();
+    REQUIRE(stats.liveCount == 0);
+    if (QwRawNodePool::stats_enabled()) {
+        REQUIRE(stats.highWaterMark == maxNodes);
+        REQUIRE(stats.deallocations == 5 + maxNodes);
+    }
+
+    // the high-water mark is the peak live count
+    QwNodePool<TestNode> pool2(maxNodes);
+    for (int i=0; i < 3; ++i) {
+        for (size_t j=0; j < 7; ++j)
+            allocatedNodes.push_front(pool2.allocate());
+        pool2.deallocate_list(allocatedNodes);
+    }
+    if (QwRawNodePool::stats_enabled())
+        REQUIRE(pool2.stats().highWaterMark == 7);
+}
+
+TEST_CASE("qw/node_pool/allocate_wait", "QwNodePool allocate_wait test") {
+
+    typedef std::chrono::steady_clock clock;
+    QwNodePool<TestNode> pool(2);
+
+    // available nodes are returned without waiting
+    TestNode *a = pool.allocate_wait(std::chrono::seconds(10));
+    TestNode *b = pool.allocate_wait(std::chrono::nanoseconds::zero());
+    REQUIRE(a != (TestNode*)nullptr);
+    REQUIRE(b != (TestNode*)nullptr);
+
+    // times out when nothing is deallocated
+    REQUIRE(pool.allocate_wait(std::chrono::nanoseconds::zero()) == (TestNode*)nullptr);
+    clock::time_point start = clock::now();
+    REQUIRE(pool.allocate_wait(std::chrono::milliseconds(20)) == (TestNode*)nullptr);
+    REQUIRE((clock::now() - start >= std::chrono::milliseconds(20)));
+
+    // woken by deallocate()
+    std::thread deallocator([&pool, a]{
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        pool.deallocate(a);
+    });
+    start = clock::now();
+    TestNode *c = pool.allocate_wait(std::chrono::seconds(10));
+    REQUIRE(c == a);
+    REQUIRE((clock::now() - start < std::chrono::seconds(10)));
+    deallocator.join();
+
+    pool.deallocate(b);
+    pool.deallocate(c);
+}
+
+namespace {
+
+    static const std::size_t WAIT_TEST_THREAD_COUNT=8;
+    static const std::size_t WAIT_THREAD_ITERATIONS=2000;
+
+    static unsigned testWaitThreadProc(QwNodePool<TestNode> *pool, int seed)
+    {
+        for (std::size_t i=0; i < WAIT_THREAD_ITERATIONS; ++i) {
+            // there are fewer nodes than threads, so threads regularly wait
+            TestNode *node = pool->allocate_wait(std::chrono::seconds(30));
+            if (!node)
+                return 1;
+            node->value = seed;
+            std::this_thread::yield();
+            if (node->value != seed)
+                return 1; // node is shared with another thread
+
+            if (i & 1) {
+                TestSList list;
+                list.push_front(node);
+                pool->deallocate_list(list);
+            } else {
+                pool->deallocate(node);
+            }
+        }
+
+        return 0;
+    }
+}
+
+TEST_CASE("qw/node_pool/allocate_wait/multi-threaded", "[slow][fuzz] QwNodePool multi-threaded allocate_wait test") {
+
+    size_t maxNodes = WAIT_TEST_THREAD_COUNT / 2;
+    QwNodePool<TestNode> pool(maxNodes);
+
+    unsigned results[WAIT_TEST_THREAD_COUNT];
+    std::thread* threads[WAIT_TEST_THREAD_COUNT];
+
+    for (std::size_t i=0; i < WAIT_TEST_THREAD_COUNT; ++i) {
+        results[i] = 1;
+        threads[i] = new std::thread([&results, &pool, i]{ results[i] = testWaitThreadProc(&pool, static_cast<int>(i)); });
+    }
+
+    for (std::size_t i=0; i < WAIT_TEST_THREAD_COUNT; ++i) {
+        threads[i]->join();
+        delete threads[i];
+        REQUIRE(results[i] == 0);
+    }
+
+    TestSList allocatedNodes;
+    REQUIRE(pool.allocate_n(maxNodes + 1, allocatedNodes) == maxNodes);
+    pool.deallocate_list(allocatedNodes);
+}
+
+namespace {
+
+    static const std::size_t TEST_THREAD_COUNT=8;
+    static const std::size_t TEST_NODES_PER_THREAD=32;
+    static const std::size_t THREAD_ITERATIONS=20000;
+
+    static QwNodePool<TestNode> *testPool_;
+
+    static unsigned testThreadProc(int seed)
+    {
+        TestSList allocatedNodes;
+
+        for (std::size_t i=0; i < THREAD_ITERATIONS; ++i) {
+            // mix single and batch operations. each thread holds at most
+            // TEST_NODES_PER_THREAD nodes so allocation never fails.
+            std::size_t n = ((i * 7 + static_cast<std::size_t>(seed)) % TEST_NODES_PER_THREAD) + 1;
+            if (i & 1) {
+                if (testPool_->allocate_n(n, allocatedNodes) != n)
+                    return 1;
+            } else {
+                for (std::size_t j=0; j < n; ++j) {
+                    TestNode *node = testPool_->allocate();
+                    if (!node)
+                        return 1;
+                    allocatedNodes.push_front(node);
+                }
+            }
+
+            for (TestSList::iterator j = allocatedNodes.begin(); j != allocatedNodes.end(); ++j)
+                (*j)->value = seed;
+
+            if (i & 2) {
+                testPool_->deallocate_list(allocatedNodes);
+            } else {
+                while (!allocatedNodes.empty())
+                    testPool_->deallocate(allocatedNodes.pop_front());
+            }
+        }
+
+        return 0;
+    }
+}
+
+TEST_CASE("qw/node_pool/multi-threaded", "[slow][fuzz] QwNodePool multi-threaded single and batch operation test") {
+
+    size_t maxNodes = TEST_THREAD_COUNT * TEST_NODES_PER_THREAD;
+    testPool_ = new QwNodePool<TestNode>(maxNodes);
+
+    unsigned results[TEST_THREAD_COUNT];
+    std::thread* threads[TEST_THREAD_COUNT];
+
+    for (std::size_t i=0; i < TEST_THREAD_COUNT; ++i) {
+        results[i] = 1;
+        threads[i] = new std::thread([&results, i]{ results[i] = testThreadProc(static_cast<int>(i)); });
+    }
+
+    for (std::size_t i=0; i < TEST_THREAD_COUNT; ++i) {
+        threads[i]->join();
+        delete threads[i];
+        REQUIRE(results[i] == 0);
+    }
+
+    TestSList allocatedNodes;
+    REQUIRE(testPool_->allocate_n(maxNodes + 1, allocatedNodes) == maxNodes);
+    testPool_->deallocate_list(allocatedNodes);
+
+    delete testPool_;
+}
+
+namespace {
+
+    static std::atomic<bool> testThreadsDone_;
+
+    static unsigned testExpandableThreadProc(int seed)
+    {
+        TestSList allocatedNodes;
+
+        for (std::size_t i=0; i < THREAD_ITERATIONS; ) {
+            std::size_t n = ((i * 7 + static_cast<std::size_t>(seed)) % TEST_NODES_PER_THREAD) + 1;
+            // allocation may fail until the pool has grown. just try again later.
+            if (testPool_->allocate_n(n, allocatedNodes) == 0) {
+                std::this_thread::yield();
+                continue;
+            }
+            testPool_->deallocate_list(allocatedNodes);
+            ++i;
+        }
+
+        return 0;
+    }
+}
+
+TEST_CASE("qw/node_pool/expandable/multi-threaded", "[slow][fuzz] QwNodePool multi-threaded grow test") {
+
+    size_t maxNodes = TEST_THREAD_COUNT * TEST_NODES_PER_THREAD * 4;
+    testPool_ = new QwNodePool<TestNode>(maxNodes, 0, 1);
+    testThreadsDone_.store(false);
+
+    std::thread grower([]{ // non-real-time thread grows the pool on request
+        while (!testThreadsDone_.load()) {
+            if (testPool_->growth_requested())
+                testPool_->grow();
+            std::this_thread::yield();
+        }
+    });
+
+    std::thread* threads[TEST_THREAD_COUNT];
+
+    for (std::size_t i=0; i < TEST_THREAD_COUNT; ++i)
+        threads[i] = new std::thread([i]{ testExpandableThreadProc(static_cast<int>(i)); });
+
+    for (std::size_t i=0; i < TEST_THREAD_COUNT; ++i) {
+        threads[i]->join();
+        delete threads[i];
+    }
+
+    testThreadsDone_.store(true);
+    grower.join();
+
+    size_t capacity = testPool_->capacity();
+    REQUIRE(capacity > 0);
+    REQUIRE(capacity <= maxNodes);
+
+    TestSList allocatedNodes;
+    REQUIRE(testPool_->allocate_n(maxNodes, allocatedNodes) == capacity);
+    testPool_->deallocate_list(allocatedNodes);
+
+    delete testPool_;
+}
+
+#if (QW_NODEPOOL_ELIMINATION == 1)
+struct QwRawNodePoolEliminationTestAccess {
+    static bool elimination_push(QwRawNodePool& pool, void *node) { return pool.elimination_push(node); }
+    static void *elimination_pop(QwRawNodePool& pool) { return pool.elimination_pop(); }
+
+    // Offer node at the calling thread's slot, as elimination_push() does, without waiting for it to be taken
+    static void offer(QwRawNodePool& pool, void *node)
+    {
+        pool.elimination_slot(Qw::impl::pool_thread_index() % QwRawNodePool::ELIMINATION_SLOT_COUNT)
+                .store(pool.link_of_node(node), std::memory_order_release);
+    }
+};
+
+namespace {
+
+    // The pool overwrites the first word of a free node with its freelist
+    // link, so the owner field comes after it.
+    struct OwnedNode {
+        void *freelistLink_;
+        std::atomic<int> owner; // 0 when free, otherwise the owning thread's id
+    };
+
+    static const std::size_t ELIMINATION_TEST_THREAD_COUNT=8;
+    static const std::size_t ELIMINATION_TEST_NODE_COUNT=4; // fewer nodes than threads, to contend on the freelist top
+    static const std::size_t ELIMINATION_THREAD_ITERATIONS=200000;
+
+    // Check that every allocated node has exactly one owner
+    static unsigned eliminationThreadProc(QwNodePool<OwnedNode> *pool, int id)
+    {
+        for (std::size_t i=0; i < ELIMINATION_THREAD_ITERATIONS; ++i) {
+            OwnedNode *node = pool->allocate();
+            if (!node)
+                continue; // all nodes are in use
+
+            int expected = 0;
+            if (!node->owner.compare_exchange_strong(expected, id, std::memory_order_relaxed))
+                return 1; // already owned by another thread
+            if (node->owner.load(std::memory_order_relaxed) != id)
+                return 1;
+            node->owner.store(0, std::memory_order_relaxed);
+
+            pool->deallocate(node);
+        }
+
+        return 0;
+    }
+}
+
+TEST_CASE("qw/node_pool/elimination", "QwNodePool elimination array test") {
+
+    typedef QwRawNodePoolEliminationTestAccess access;
+    QwNodePool<OwnedNode> pool(ELIMINATION_TEST_NODE_COUNT);
+    QwRawNodePool& rawPool = pool.raw_pool();
+
+    OwnedNode *node = pool.allocate();
+    REQUIRE(node != (OwnedNode*)nullptr);
+
+    // nothing on offer
+    REQUIRE(access::elimination_pop(rawPool) == (void*)nullptr);
+
+    // an offer that isn't taken is withdrawn, and the caller still owns the node
+    REQUIRE(access::elimination_push(rawPool, node) == false);
+    REQUIRE(access::elimination_pop(rawPool) == (void*)nullptr);
+
+    // a pending offer is taken by an allocating thread
+    access::offer(rawPool, node);
+    REQUIRE(access::elimination_pop(rawPool) == (void*)node);
+    REQUIRE(access::elimination_pop(rawPool) == (void*)nullptr);
+
+    // while the slot holds an offer, another offer from the same slot fails immediately
+    OwnedNode *other = pool.allocate();
+    access::offer(rawPool, node);
+    REQUIRE(access::elimination_push(rawPool, other) == false);
+    REQUIRE(access::elimination_pop(rawPool) == (void*)node);
+    pool.deallocate(other);
+
+    if (QwRawNodePool::stats_enabled())
+        REQUIRE(pool.stats().eliminations == 2);
+
+    pool.deallocate(node);
+}
+
+TEST_CASE("qw/node_pool/elimination/multi-threaded", "[slow][fuzz] QwNodePool contended allocate/deallocate with elimination backoff test") {
+
+    QwNodePool<OwnedNode> pool(ELIMINATION_TEST_NODE_COUNT);
+    {
+        std::vector<OwnedNode*> nodes;
+        while (OwnedNode *node = pool.allocate()) {
+            node->owner.store(0, std::memory_order_relaxed);
+            nodes.push_back(node);
+        }
+        REQUIRE(nodes.size() == ELIMINATION_TEST_NODE_COUNT);
+        for (std::size_t i=0; i < nodes.size(); ++i)
+            pool.deallocate(nodes[i]);
+    }
+
+    unsigned results[ELIMINATION_TEST_THREAD_COUNT];
+    std::thread* threads[ELIMINATION_TEST_THREAD_COUNT];
+
+    for (std::size_t i=0; i < ELIMINATION_TEST_THREAD_COUNT; ++i) {
+        results[i] = 1;
+        threads[i] = new std::thread([&results, &pool, i]{ results[i] = eliminationThreadProc(&pool, static_cast<int>(i) + 1); });
+    }
+
+    for (std::size_t i=0; i < ELIMINATION_TEST_THREAD_COUNT; ++i) {
+        threads[i]->join();
+        delete threads[i];
+        REQUIRE(results[i] == 0);
+    }
+
+    // every node is back in the pool, exactly once
+    std::vector<OwnedNode*> nodes;
+    while (OwnedNode *node = pool.allocate()) {
+        REQUIRE(node->owner.load(std::memory_order_relaxed) == 0);
+        nodes.push_back(node);
+    }
+    REQUIRE(nodes.size() == ELIMINATION_TEST_NODE_COUNT);
+    for (std::size_t i=0; i < nodes.size(); ++i)
+        pool.deallocate(nodes[i]);
+
+    if (QwRawNodePool::stats_enabled()) {
+        QwRawNodePool::Stats stats = pool.stats();
+        REQUIRE((stats.pushCasFailures + stats.popCasFailures > 0)); // the test contended
+        if (std::thread::hardware_concurrency() > 1)
+            REQUIRE(stats.eliminations > 0); // (on one CPU, offers are rarely pending when an allocation contends)
+    }
+}
+#endif /* QW_NODEPOOL_ELIMINATION */
+
 /* -----------------------------------------------------------------------
 Last reviewed: April 22, 2014
 Last reviewed by: Ross B.
@@ -0,0 +1,197 @@
+/*
+    Queue World is copyright (c) 2014-2018 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#include "QwPoolMemoryResource.h"
+
+#include "catch.hpp"
+
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+
+#include <cstddef> // size_t
+#include <cstdint>
+#include <memory_resource>
+#include <new> // bad_alloc
+#include <thread>
+#include <vector>
+
+
+namespace {
+
+    const std::size_t CLASS_COUNT = 3;
+    const std::size_t classSizes_[CLASS_COUNT] = { 64, 256, 1024 };
+    const std::size_t classBlockCounts_[CLASS_COUNT] = { 16, 8, 4 };
+
+    // counts upstream traffic, so tests can tell which requests were delegated
+    class CountingResource : public std::pmr::memory_resource {
+    public:
+        std::size_t allocations = 0;
+        std::size_t deallocations = 0;
+
+    protected:
+        void *do_allocate(std::size_t bytes, std::size_t alignment) override
+        {
+            ++allocations;
+            return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+        }
+
+        void do_deallocate(void *p, std::size_t bytes, std::size_t alignment) override
+        {
+            ++deallocations;
+            std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+        }
+
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+        {
+            return this == &other;
+        }
+    };
+
+} // end anonymous namespace
+
+TEST_CASE("qw/pool_memory_resource", "QwPoolMemoryResource single threaded test") {
+
+    QwSizeClassAllocator classes(classSizes_, classBlockCounts_, CLASS_COUNT);
+    QwPoolMemoryResource resource(classes);
+
+    REQUIRE(resource.upstream_resource() == std::pmr::null_memory_resource());
+    REQUIRE(resource.is_equal(resource));
+    REQUIRE(!resource.is_equal(*std::pmr::new_delete_resource()));
+
+    // requests that fit are served from the pools, cache line aligned
+    void *p = resource.allocate(100, 8);
+    REQUIRE(classes.owns(p));
+    REQUIRE(classes.class_of(p) == 1);
+    REQUIRE((reinterpret_cast<std::uintptr_t>(p) % CACHE_LINE_SIZE) == 0);
+    resource.deallocate(p, 100, 8);
+
+    // with the default upstream, requests that don't fit fail
+    REQUIRE_THROWS_AS((void)resource.allocate(2048), const std::bad_alloc&);
+    REQUIRE_THROWS_AS((void)resource.allocate(64, CACHE_LINE_SIZE * 2), const std::bad_alloc&);
+
+    std::vector<void*> blocks;
+    for (std::size_t i=0; i < classBlockCounts_[2]; ++i)
+        blocks.push_back(resource.allocate(1024));
+    REQUIRE_THROWS_AS((void)resource.allocate(1024), const std::bad_alloc&);
+    for (std::size_t i=0; i < blocks.size(); ++i)
+        resource.deallocate(blocks[i], 1024);
+    blocks.clear();
+}
+
+TEST_CASE("qw/pool_memory_resource/upstream", "QwPoolMemoryResource delegates to upstream") {
+
+    QwSizeClassAllocator classes(classSizes_, classBlockCounts_, CLASS_COUNT);
+    CountingResource upstream;
+    QwPoolMemoryResource resource(classes, &upstream);
+
+    void *small = resource.allocate(64);
+    REQUIRE(classes.owns(small));
+    REQUIRE(upstream.allocations == 0);
+
+    void *large = resource.allocate(4096);
+    REQUIRE(!classes.owns(large));
+    REQUIRE(upstream.allocations == 1);
+
+    void *overAligned = resource.allocate(64, CACHE_LINE_SIZE * 2);
+    REQUIRE(!classes.owns(overAligned));
+    REQUIRE((reinterpret_cast<std::uintptr_t>(overAligned) % (CACHE_LINE_SIZE * 2)) == 0);
+    REQUIRE(upstream.allocations == 2);
+
+    // deallocation routes each block back to where it came from
+    resource.deallocate(small, 64);
+    resource.deallocate(large, 4096);
+    resource.deallocate(overAligned, 64, CACHE_LINE_SIZE * 2);
+    REQUIRE(upstream.deallocations == 2);
+}
+
+TEST_CASE("qw/pool_memory_resource/containers", "QwPoolMemoryResource with std::pmr containers") {
+
+    QwSizeClassAllocator classes(classSizes_, classBlockCounts_, CLASS_COUNT);
+    QwPoolMemoryResource resource(classes);
+
+    std::pmr::vector<int> v(&resource);
+    v.reserve(200); // 800 bytes, served by the 1024 byte class
+    for (int i=0; i < 200; ++i)
+        v.push_back(i);
+    REQUIRE(classes.owns(v.data()));
+    REQUIRE(v[199] == 199);
+
+    std::pmr::vector<std::pmr::vector<int>> vv(&resource); // elements inherit the resource
+    vv.reserve(4);
+    for (int i=0; i < 4; ++i) {
+        vv.emplace_back();
+        vv.back().push_back(i);
+        REQUIRE(classes.owns(vv.back().data()));
+    }
+    REQUIRE(vv.get_allocator().resource() == &resource);
+}
+
+namespace {
+
+    static const std::size_t TEST_THREAD_COUNT=8;
+    static const std::size_t THREAD_ITERATIONS=20000;
+
+    static QwPoolMemoryResource *testResource_;
+
+    static unsigned testThreadProc(int seed)
+    {
+        try {
+            for (std::size_t i=0; i < THREAD_ITERATIONS; ++i) {
+                std::pmr::vector<int> v(testResource_);
+                std::size_t n = ((i * 31 + static_cast<std::size_t>(seed)) % 200) + 1;
+                v.reserve(n);
+                for (std::size_t j=0; j < n; ++j)
+                    v.push_back(seed);
+                if (v.front() != seed || v.back() != seed)
+                    return 1; // block is shared with another thread
+            }
+        } catch (const std::bad_alloc&) {
+            return 1;
+        }
+
+        return 0;
+    }
+}
+
+TEST_CASE("qw/pool_memory_resource/multi-threaded", "[slow][fuzz] QwPoolMemoryResource multi-threaded test") {
+
+    // the 1024 byte class alone can satisfy every thread, so allocation never fails
+    const std::size_t blockCounts[CLASS_COUNT] = { 4, 4, TEST_THREAD_COUNT };
+    QwSizeClassAllocator classes(classSizes_, blockCounts, CLASS_COUNT);
+    testResource_ = new QwPoolMemoryResource(classes);
+
+    unsigned results[TEST_THREAD_COUNT];
+    std::thread* threads[TEST_THREAD_COUNT];
+
+    for (std::size_t i=0; i < TEST_THREAD_COUNT; ++i) {
+        results[i] = 1;
+        threads[i] = new std::thread([&results, i]{ results[i] = testThreadProc(static_cast<int>(i)); });
+    }
+
+    for (std::size_t i=0; i < TEST_THREAD_COUNT; ++i) {
+        threads[i]->join();
+        delete threads[i];
+        REQUIRE(results[i] == 0);
+    }
+
+    delete testResource_;
+}
+
+#endif /* C++17 */
@@ -33,6 +33,7 @@ compared to QwSList, QwSTailList adds:
     - a back_ member
     - a push_back() method
     - a back() accessor method
+    - push_back_multiple() and splice_back() methods
 
 Therefore test back() and push_back()
 
@@ -134,6 +135,75 @@ TEST_CASE("qw/staillist/back-and-push_back", "QwSTailList test back() and push_b
     backAndPushBackListTest(a, b, &node1, &node2, &node3);
 }
 
+TEST_CASE("qw/staillist/push_back_multiple-and-splice_back", "QwSTailList test push_back_multiple() and splice_back()") {
+
+    const int NODE_COUNT = 6;
+    TestNode nodes[NODE_COUNT];
+    for (int i=0; i < NODE_COUNT; ++i)
+        nodes[i].value = i;
+
+    TestSTailList a;
+
+    // push_back_multiple onto an empty list, then a non-empty list
+    nodes[0].links_[TestNode::LINK_INDEX_1] = &nodes[1];
+    nodes[1].links_[TestNode::LINK_INDEX_1] = nullptr;
+    a.push_back_multiple(&nodes[0], &nodes[1]);
+    REQUIRE(a.front() == &nodes[0]);
+    REQUIRE(a.back() == &nodes[1]);
+
+    nodes[2].links_[TestNode::LINK_INDEX_1] = nullptr;
+    a.push_back_multiple(&nodes[2], &nodes[2]);
+    REQUIRE(a.front() == &nodes[0]);
+    REQUIRE(a.back() == &nodes[2]);
+    REQUIRE(TestSTailList::next(&nodes[1]) == &nodes[2]);
+
+    // splice_back(other) moves the whole list, and leaves other empty
+    TestSTailList b;
+    b.splice_back(a);
+    REQUIRE(a.empty());
+    REQUIRE(b.front() == &nodes[0]);
+    REQUIRE(b.back() == &nodes[2]);
+
+    b.splice_back(a); // splicing an empty list is a no-op
+    REQUIRE(b.front() == &nodes[0]);
+    REQUIRE(b.back() == &nodes[2]);
+
+    a.push_back(&nodes[3]);
+    a.push_back(&nodes[4]);
+    a.push_back(&nodes[5]);
+    b.splice_back(a);
+    REQUIRE(a.empty());
+    REQUIRE(a.back() == (TestNode*)nullptr);
+    REQUIRE(b.back() == &nodes[5]);
+
+    int expected = 0;
+    for (TestSTailList::iterator i=b.begin(); i != b.end(); ++i)
+        REQUIRE((*i)->value == expected++);
+    REQUIRE(expected == NODE_COUNT);
+
+    // splice_back(other, last) moves a prefix of other
+    a.splice_back(b, &nodes[1]);
+    REQUIRE(a.front() == &nodes[0]);
+    REQUIRE(a.back() == &nodes[1]);
+    REQUIRE(TestSTailList::next(&nodes[1]) == (TestNode*)nullptr);
+    REQUIRE(b.front() == &nodes[2]);
+    REQUIRE(b.back() == &nodes[5]);
+
+    a.splice_back(b, &nodes[2]);
+    REQUIRE(a.back() == &nodes[2]);
+    REQUIRE(b.front() == &nodes[3]);
+
+    a.splice_back(b, b.back()); // the whole of b
+    REQUIRE(b.empty());
+    REQUIRE(b.back() == (TestNode*)nullptr);
+    REQUIRE(a.back() == &nodes[5]);
+
+    expected = 0;
+    while (!a.empty())
+        REQUIRE(a.pop_front()->value == expected++);
+    REQUIRE(expected == NODE_COUNT);
+}
+
 TEST_CASE("qw/staillist/many", "QwSTailList list operations with many nodes/elements") {
 
     const int NODE_COUNT = 5;
@@ -0,0 +1,261 @@
+/*
+    Queue World is copyright (c) 2014-2018 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#include "QwShardedNodePool.h"
+#include "QwSList.h"
+
+#include "catch.hpp"
+
+#ifndef _WIN32
+#include <sys/stat.h> // mkdir
+#include <unistd.h> // rmdir, unlink
+#endif
+
+#include <cstddef> // size_t
+#include <cstdlib> // mkdtemp
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace {
+
+    struct TestNode{
+        TestNode *links_[2];
+        enum { LINK_INDEX_1, LINK_COUNT };
+
+        int value;
+
+        TestNode()
+            : value(0)
+        {
+            for (int i=0; i < LINK_COUNT; ++i)
+                links_[i] = nullptr;
+        }
+    };
+
+    typedef QwSList<TestNode*, TestNode::LINK_INDEX_1> TestSList;
+
+#ifndef _WIN32
+    // A fake sysfs tree: <root>/devices/system/node/node<id>/cpulist
+    class FakeSysfs {
+        std::string root_;
+        std::vector<std::string> files_;
+        std::vector<std::string> dirs_;
+
+        void make_dir(const std::string& path)
+        {
+            mkdir(path.c_str(), 0700);
+            dirs_.push_back(path);
+        }
+
+    public:
+        FakeSysfs()
+        {
+            char path[] = "/tmp/qwsysfsXXXXXX";
+            root_ = mkdtemp(path);
+            make_dir(root_ + "/devices");
+            make_dir(root_ + "/devices/system");
+            make_dir(root_ + "/devices/system/node");
+        }
+
+        ~FakeSysfs()
+        {
+            for (std::size_t i=0; i < files_.size(); ++i)
+                unlink(files_[i].c_str());
+            for (std::size_t i=dirs_.size(); i > 0; --i)
+                rmdir(dirs_[i-1].c_str());
+            rmdir(root_.c_str());
+        }
+
+        void add_node(int id, const char *cpuList)
+        {
+            std::string nodeDir = root_ + "/devices/system/node/node" + std::to_string(id);
+            make_dir(nodeDir);
+            std::string cpuListPath = nodeDir + "/cpulist";
+            std::ofstream(cpuListPath.c_str()) << cpuList << "\n";
+            files_.push_back(cpuListPath);
+        }
+
+        const std::string& root() const { return root_; }
+    };
+#endif
+
+} // end anonymous namespace
+
+TEST_CASE("qw/numa_topology/parse_cpu_list", "QwNumaTopology cpulist parsing test") {
+
+    std::vector<int> cpus;
+    REQUIRE(QwNumaTopology::parse_cpu_list("0-3,8,10-11\n", cpus));
+    int expected[] = { 0, 1, 2, 3, 8, 10, 11 };
+    REQUIRE(cpus == std::vector<int>(expected, expected + 7));
+
+    REQUIRE(QwNumaTopology::parse_cpu_list("", cpus));
+    REQUIRE(cpus.empty());
+
+    REQUIRE(QwNumaTopology::parse_cpu_list("3-1", cpus) == false);
+    REQUIRE(QwNumaTopology::parse_cpu_list("x", cpus) == false);
+}
+
+TEST_CASE("qw/numa_topology", "QwNumaTopology system and missing topology test") {
+
+    QwNumaTopology system; // whatever this machine has
+    REQUIRE(system.node_count() >= 1);
+    REQUIRE(system.current_node() < system.node_count());
+
+    // no topology information: a single node with all cpus
+    QwNumaTopology missing("/nonexistent");
+    REQUIRE(missing.node_count() == 1);
+    REQUIRE(missing.node_id(0) == 0);
+    REQUIRE(missing.node_cpus(0).size() >= 1);
+    REQUIRE(missing.current_node() == 0);
+}
+
+#ifndef _WIN32
+TEST_CASE("qw/numa_topology/fake", "QwNumaTopology fake sysfs topology test") {
+
+    FakeSysfs sysfs;
+    sysfs.add_node(0, "0-1,4");
+    sysfs.add_node(2, "2-3"); // node ids may be sparse
+    sysfs.add_node(3, "");  // memory-only nodes are ignored
+
+    QwNumaTopology topology(sysfs.root());
+    REQUIRE(topology.node_count() == 2);
+    REQUIRE(topology.node_id(0) == 0);
+    REQUIRE(topology.node_id(1) == 2);
+    REQUIRE(topology.node_cpus(0).size() == 3);
+    REQUIRE(topology.node_of_cpu(0) == 0);
+    REQUIRE(topology.node_of_cpu(3) == 1);
+    REQUIRE(topology.node_of_cpu(4) == 0);
+    REQUIRE(topology.node_of_cpu(100) == 0); // unknown
+}
+
+TEST_CASE("qw/sharded_node_pool", "QwShardedNodePool local-first allocation test with fake topology") {
+
+    // three fake NUMA nodes, all containing cpu 0, so shard placement works on any machine
+    FakeSysfs sysfs;
+    sysfs.add_node(0, "0");
+    sysfs.add_node(1, "0");
+    sysfs.add_node(2, "0");
+    QwNumaTopology topology(sysfs.root());
+    REQUIRE(topology.node_count() == 3);
+
+    const std::size_t nodesPerShard = 10;
+    QwShardedNodePool<TestNode> pool(nodesPerShard, topology);
+    REQUIRE(pool.shard_count() == 3);
+
+    // allocation prefers the requested shard...
+    TestSList allocatedNodes;
+    for (std::size_t i=0; i < nodesPerShard; ++i) {
+        TestNode *n = pool.allocate_from(1);
+        REQUIRE(n != (TestNode*)nullptr);
+        REQUIRE(pool.shard_of(n) == 1);
+        allocatedNodes.push_front(n);
+    }
+
+    // ...and falls back to the next shards when it is empty
+    for (std::size_t i=0; i < nodesPerShard; ++i) {
+        TestNode *n = pool.allocate_from(1);
+        REQUIRE(n != (TestNode*)nullptr);
+        REQUIRE(pool.shard_of(n) == 2);
+        allocatedNodes.push_front(n);
+    }
+    for (std::size_t i=0; i < nodesPerShard; ++i) {
+        TestNode *n = pool.allocate();
+        REQUIRE(n != (TestNode*)nullptr);
+        REQUIRE(pool.shard_of(n) == 0);
+        allocatedNodes.push_front(n);
+    }
+    REQUIRE(pool.allocate() == (TestNode*)nullptr);
+
+    // deallocation returns nodes to their home shard
+    while (!allocatedNodes.empty())
+        pool.deallocate(allocatedNodes.pop_front());
+
+    for (std::size_t shard=0; shard < 3; ++shard) {
+        for (std::size_t i=0; i < nodesPerShard; ++i) {
+            TestNode *n = pool.allocate_from(shard);
+            REQUIRE(pool.shard_of(n) == shard);
+            allocatedNodes.push_front(n);
+        }
+    }
+    while (!allocatedNodes.empty())
+        pool.deallocate(allocatedNodes.pop_front());
+}
+#endif
+
+namespace {
+
+    static const std::size_t TEST_THREAD_COUNT=8;
+    static const std::size_t TEST_NODES_PER_THREAD=8;
+    static const std::size_t THREAD_ITERATIONS=20000;
+
+    static QwShardedNodePool<TestNode> *testPool_;
+
+    static unsigned testThreadProc(int seed)
+    {
+        TestSList allocatedNodes;
+
+        for (std::size_t i=0; i < THREAD_ITERATIONS; ++i) {
+            std::size_t n = ((i * 7 + static_cast<std::size_t>(seed)) % TEST_NODES_PER_THREAD) + 1;
+            for (std::size_t j=0; j < n; ++j) {
+                TestNode *node = testPool_->allocate();
+                if (!node)
+                    return 1;
+                node->value = seed;
+                allocatedNodes.push_front(node);
+            }
+
+            for (TestSList::iterator j = allocatedNodes.begin(); j != allocatedNodes.end(); ++j) {
+                if ((*j)->value != seed)
+                    return 1; // node is shared with another thread
+            }
+
+            while (!allocatedNodes.empty())
+                testPool_->deallocate(allocatedNodes.pop_front());
+        }
+
+        return 0;
+    }
+}
+
+TEST_CASE("qw/sharded_node_pool/multi-threaded", "[slow][fuzz] QwShardedNodePool multi-threaded test") {
+
+    // the shards of the system topology together hold enough nodes for all threads
+    testPool_ = new QwShardedNodePool<TestNode>(TEST_THREAD_COUNT * TEST_NODES_PER_THREAD);
+
+    unsigned results[TEST_THREAD_COUNT];
+    std::thread* threads[TEST_THREAD_COUNT];
+
+    for (std::size_t i=0; i < TEST_THREAD_COUNT; ++i) {
+        results[i] = 1;
+        threads[i] = new std::thread([&results, i]{ results[i] = testThreadProc(static_cast<int>(i)); });
+    }
+
+    for (std::size_t i=0; i < TEST_THREAD_COUNT; ++i) {
+        threads[i]->join();
+        delete threads[i];
+        REQUIRE(results[i] == 0);
+    }
+
+    delete testPool_;
+}
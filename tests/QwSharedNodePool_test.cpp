@@ -0,0 +1,210 @@
+/*
+    Queue World is copyright (c) 2014-2018 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#include "QwSharedNodePool.h"
+
+#include "catch.hpp"
+
+#include <cstddef> // size_t
+#include <cstdint>
+#include <cstdio> // snprintf
+#include <cstring> // memset
+#include <set>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/wait.h> // waitpid
+#include <unistd.h> // fork, getpid, _exit
+#endif
+
+
+namespace {
+
+    struct TestNode {
+        std::uint64_t value;
+        char payload[100];
+    };
+
+    static const std::size_t POOL_SIZE = 50;
+
+    void makeUniquePoolName(char *name, std::size_t size)
+    {
+        static int counter = 0;
+#ifdef _WIN32
+        std::snprintf(name, size, "Local\\QwSharedNodePool_test.%d", counter++);
+#else
+        std::snprintf(name, size, "/QwSharedNodePool_test.%ld.%d", static_cast<long>(getpid()), counter++);
+#endif
+    }
+
+    // allocate all nodes, check that handles are distinct and valid, then free them
+    void requirePoolIsFull(QwSharedNodePool& pool)
+    {
+        std::vector<QwSharedNodePool::handle_type> handles;
+        std::set<QwSharedNodePool::handle_type> distinct;
+        for (std::size_t i=0; i < pool.capacity(); ++i) {
+            QwSharedNodePool::handle_type h = pool.allocate();
+            REQUIRE(h != QwSharedNodePool::null_handle());
+            REQUIRE(h <= pool.capacity());
+            handles.push_back(h);
+            distinct.insert(h);
+        }
+        REQUIRE(pool.allocate() == QwSharedNodePool::null_handle());
+        REQUIRE(distinct.size() == pool.capacity());
+        for (std::size_t i=0; i < handles.size(); ++i)
+            pool.deallocate(handles[i]);
+    }
+
+} // end anonymous namespace
+
+TEST_CASE("qw/shared_node_pool/named", "QwSharedNodePool named create, attach and unlink") {
+
+    char name[128];
+    makeUniquePoolName(name, sizeof(name));
+
+    QwSharedNodePool::unlink(name); // (in case a previous run crashed)
+    QwSharedNodePool pool(name, sizeof(TestNode), POOL_SIZE);
+    REQUIRE(pool.is_open());
+    REQUIRE(pool.capacity() == POOL_SIZE);
+    REQUIRE(pool.node_stride() == 128);
+    REQUIRE(QwSharedNodePool::node_stride_for(sizeof(TestNode)) == pool.node_stride());
+    REQUIRE(QwSharedNodePool::node_stride_for(1) == CACHE_LINE_SIZE);
+
+    QwSharedNodePool duplicate(name, sizeof(TestNode), POOL_SIZE); // name is in use
+    REQUIRE(!duplicate.is_open());
+
+    QwSharedNodePool attached(name);
+    REQUIRE(attached.is_open());
+    REQUIRE(attached.capacity() == POOL_SIZE);
+    REQUIRE(attached.node_stride() == pool.node_stride());
+
+    // a node allocated and written through one mapping is visible through the other
+    QwSharedNodePool::handle_type h = pool.allocate();
+    REQUIRE(h != QwSharedNodePool::null_handle());
+    static_cast<TestNode*>(pool.node(h))->value = 0x1234;
+    REQUIRE(static_cast<TestNode*>(attached.node(h))->value == 0x1234);
+    attached.deallocate(h);
+
+    requirePoolIsFull(attached);
+    requirePoolIsFull(pool);
+
+#ifndef _WIN32
+    REQUIRE(QwSharedNodePool::unlink(name));
+    QwSharedNodePool afterUnlink(name);
+    REQUIRE(!afterUnlink.is_open());
+    requirePoolIsFull(attached); // existing mappings remain valid
+#else
+    QwSharedNodePool::unlink(name);
+#endif
+
+    QwSharedNodePool missing("/QwSharedNodePool_test.does-not-exist");
+    REQUIRE(!missing.is_open());
+}
+
+#ifndef _WIN32
+
+TEST_CASE("qw/shared_node_pool/anonymous", "QwSharedNodePool anonymous pool attached by fd") {
+
+    QwSharedNodePool pool(sizeof(TestNode), POOL_SIZE);
+    REQUIRE(pool.is_open());
+    REQUIRE(pool.fd() != -1);
+
+    QwSharedNodePool attached(pool.fd());
+    REQUIRE(attached.is_open());
+    REQUIRE(attached.fd() != pool.fd());
+
+    // the two mappings are at different addresses. handles are position independent
+    QwSharedNodePool::handle_type h = attached.allocate();
+    REQUIRE(pool.node(h) != attached.node(h));
+    REQUIRE((reinterpret_cast<std::uintptr_t>(pool.node(h)) % CACHE_LINE_SIZE) == 0);
+    REQUIRE(pool.handle_of(pool.node(h)) == h);
+    REQUIRE(attached.handle_of(attached.node(h)) == h);
+    std::memset(attached.node(h), 0x5A, sizeof(TestNode));
+    REQUIRE(static_cast<TestNode*>(pool.node(h))->payload[99] == 0x5A);
+    pool.deallocate(h);
+
+    requirePoolIsFull(pool);
+
+    // attaching to something that isn't a pool fails
+    QwSharedNodePool other(sizeof(TestNode), POOL_SIZE);
+    REQUIRE(ftruncate(other.fd(), 64) == 0); // truncated below the header
+    QwSharedNodePool truncated(other.fd());
+    REQUIRE(!truncated.is_open());
+    QwSharedNodePool badFd(-1);
+    REQUIRE(!badFd.is_open());
+}
+
+namespace {
+
+    static const std::size_t TEST_PROCESS_COUNT=4;
+    static const std::size_t TEST_NODES_PER_PROCESS=10;
+    static const std::size_t PROCESS_ITERATIONS=50000;
+
+    // Runs in a child process. Returns 0 on success
+    static int testProcessProc(int fd, int seed)
+    {
+        QwSharedNodePool pool(fd);
+        if (!pool.is_open())
+            return 1;
+
+        QwSharedNodePool::handle_type handles[TEST_NODES_PER_PROCESS];
+        for (std::size_t i=0; i < PROCESS_ITERATIONS; ++i) {
+            std::size_t count = (i % TEST_NODES_PER_PROCESS) + 1;
+            for (std::size_t j=0; j < count; ++j) {
+                handles[j] = pool.allocate();
+                if (handles[j] == QwSharedNodePool::null_handle())
+                    return 1;
+                static_cast<TestNode*>(pool.node(handles[j]))->value = static_cast<std::uint64_t>(seed);
+            }
+            for (std::size_t j=0; j < count; ++j) {
+                if (static_cast<TestNode*>(pool.node(handles[j]))->value != static_cast<std::uint64_t>(seed))
+                    return 1; // node is shared with another process
+                pool.deallocate(handles[j]);
+            }
+        }
+        return 0;
+    }
+}
+
+TEST_CASE("qw/shared_node_pool/multi-process", "[slow][fuzz] QwSharedNodePool multi-process test") {
+
+    QwSharedNodePool pool(sizeof(TestNode), TEST_PROCESS_COUNT * TEST_NODES_PER_PROCESS);
+    REQUIRE(pool.is_open());
+
+    pid_t children[TEST_PROCESS_COUNT];
+    for (std::size_t i=0; i < TEST_PROCESS_COUNT; ++i) {
+        children[i] = fork();
+        REQUIRE(children[i] != -1);
+        if (children[i] == 0)
+            _exit(testProcessProc(pool.fd(), static_cast<int>(i) + 1));
+    }
+
+    for (std::size_t i=0; i < TEST_PROCESS_COUNT; ++i) {
+        int status = -1;
+        REQUIRE(waitpid(children[i], &status, 0) == children[i]);
+        REQUIRE(WIFEXITED(status));
+        REQUIRE(WEXITSTATUS(status) == 0);
+    }
+
+    requirePoolIsFull(pool);
+}
+
+#endif /* _WIN32 */
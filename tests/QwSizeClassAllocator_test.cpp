@@ -0,0 +1,158 @@
+/*
+    Queue World is copyright (c) 2014-2018 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#include "QwSizeClassAllocator.h"
+
+#include "catch.hpp"
+
+#include <cstddef> // size_t
+#include <cstdint>
+#include <cstring> // memset
+#include <thread>
+#include <vector>
+
+
+namespace {
+
+    const std::size_t CLASS_COUNT = 6;
+    const std::size_t classSizes_[CLASS_COUNT] = { 64, 128, 256, 512, 1024, 4096 };
+    const std::size_t classBlockCounts_[CLASS_COUNT] = { 16, 8, 8, 4, 4, 2 };
+
+} // end anonymous namespace
+
+TEST_CASE("qw/size_class_allocator", "QwSizeClassAllocator single threaded test") {
+
+    QwSizeClassAllocator allocator(classSizes_, classBlockCounts_, CLASS_COUNT);
+
+    REQUIRE(allocator.class_count() == CLASS_COUNT);
+    for (std::size_t i=0; i < CLASS_COUNT; ++i) {
+        REQUIRE(allocator.class_size(i) == classSizes_[i]);
+        REQUIRE(allocator.class_pool(i).max_capacity() == classBlockCounts_[i]);
+    }
+
+    REQUIRE(allocator.class_for_size(0) == 0);
+    REQUIRE(allocator.class_for_size(64) == 0);
+    REQUIRE(allocator.class_for_size(65) == 1);
+    REQUIRE(allocator.class_for_size(4096) == 5);
+    REQUIRE(allocator.class_for_size(4097) == CLASS_COUNT);
+    REQUIRE(allocator.allocate(4097) == nullptr);
+
+    // each block comes from the smallest class that fits, and is usable for its full size
+    std::size_t requestSizes[] = { 1, 64, 100, 200, 300, 700, 2000 };
+    std::size_t expectedClasses[] = { 0, 0, 1, 2, 3, 4, 5 };
+    std::vector<void*> blocks;
+    for (std::size_t i=0; i < sizeof(requestSizes) / sizeof(requestSizes[0]); ++i) {
+        void *p = allocator.allocate(requestSizes[i]);
+        REQUIRE(p != nullptr);
+        REQUIRE((reinterpret_cast<std::uintptr_t>(p) % CACHE_LINE_SIZE) == 0);
+        REQUIRE(allocator.class_of(p) == expectedClasses[i]);
+        std::memset(p, 0xAB, allocator.class_size(expectedClasses[i]));
+        blocks.push_back(p);
+    }
+    for (std::size_t i=0; i < blocks.size(); ++i)
+        allocator.deallocate(blocks[i]);
+    blocks.clear();
+
+    // an exhausted class falls back to larger classes
+    std::size_t expectedFallbackCount = 0;
+    for (std::size_t i=3; i < CLASS_COUNT; ++i)
+        expectedFallbackCount += classBlockCounts_[i];
+    for (std::size_t i=0; i < expectedFallbackCount; ++i) {
+        void *p = allocator.allocate(500);
+        REQUIRE(p != nullptr);
+        REQUIRE(allocator.class_of(p) >= 3);
+        blocks.push_back(p);
+    }
+    REQUIRE(allocator.allocate(500) == nullptr);
+    void *small = allocator.allocate(64); // smaller classes are unaffected
+    REQUIRE(small != nullptr);
+    REQUIRE(allocator.class_of(small) == 0);
+    allocator.deallocate(small);
+
+    // deallocated blocks return to their own class
+    for (std::size_t i=0; i < blocks.size(); ++i)
+        allocator.deallocate(blocks[i]);
+    blocks.clear();
+    for (std::size_t i=0; i < classBlockCounts_[3]; ++i) {
+        void *p = allocator.allocate(500);
+        REQUIRE(allocator.class_of(p) == 3);
+        blocks.push_back(p);
+    }
+    for (std::size_t i=0; i < blocks.size(); ++i)
+        allocator.deallocate(blocks[i]);
+}
+
+namespace {
+
+    static const std::size_t TEST_THREAD_COUNT=8;
+    static const std::size_t TEST_BLOCKS_PER_THREAD=4;
+    static const std::size_t THREAD_ITERATIONS=20000;
+
+    static QwSizeClassAllocator *testAllocator_;
+
+    static unsigned testThreadProc(int seed)
+    {
+        void *blocks[TEST_BLOCKS_PER_THREAD];
+        std::size_t sizes[TEST_BLOCKS_PER_THREAD];
+
+        for (std::size_t i=0; i < THREAD_ITERATIONS; ++i) {
+            for (std::size_t j=0; j < TEST_BLOCKS_PER_THREAD; ++j) {
+                sizes[j] = ((i * 31 + j * 7 + static_cast<std::size_t>(seed)) % 1024) + 1;
+                blocks[j] = testAllocator_->allocate(sizes[j]);
+                if (!blocks[j])
+                    return 1;
+                std::memset(blocks[j], seed, sizes[j]);
+            }
+
+            for (std::size_t j=0; j < TEST_BLOCKS_PER_THREAD; ++j) {
+                const unsigned char *p = static_cast<const unsigned char*>(blocks[j]);
+                if (p[0] != static_cast<unsigned char>(seed) || p[sizes[j]-1] != static_cast<unsigned char>(seed))
+                    return 1; // block is shared with another thread
+                testAllocator_->deallocate(blocks[j]);
+            }
+        }
+
+        return 0;
+    }
+}
+
+TEST_CASE("qw/size_class_allocator/multi-threaded", "[slow][fuzz] QwSizeClassAllocator multi-threaded test") {
+
+    // the 1024 byte class alone can satisfy every thread, so allocation never fails
+    const std::size_t blockCounts[CLASS_COUNT] = { 8, 8, 8, 8, TEST_THREAD_COUNT * TEST_BLOCKS_PER_THREAD, 1 };
+    testAllocator_ = new QwSizeClassAllocator(classSizes_, blockCounts, CLASS_COUNT);
+
+    unsigned results[TEST_THREAD_COUNT];
+    std::thread* threads[TEST_THREAD_COUNT];
+
+    for (std::size_t i=0; i < TEST_THREAD_COUNT; ++i) {
+        results[i] = 1;
+        threads[i] = new std::thread([&results, i]{ results[i] = testThreadProc(static_cast<int>(i)); });
+    }
+
+    for (std::size_t i=0; i < TEST_THREAD_COUNT; ++i) {
+        threads[i]->join();
+        delete threads[i];
+        REQUIRE(results[i] == 0);
+    }
+
+    delete testAllocator_;
+}
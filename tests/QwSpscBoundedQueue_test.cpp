@@ -0,0 +1,264 @@
+/*
+    Queue World is copyright (c) 2014-2018 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#include "QwSpscBoundedQueue.h"
+
+#include "catch.hpp"
+
+#include <cstddef> // size_t
+#include <thread>
+
+
+namespace {
+
+    typedef QwSpscBoundedQueue<int> TestQueue;
+
+} // end anonymous namespace
+
+
+TEST_CASE("qw/spsc_bounded_queue", "QwSpscBoundedQueue single threaded test") {
+
+    // capacity is rounded up to a power of two
+    REQUIRE(TestQueue(1).capacity() == 2);
+    REQUIRE(TestQueue(5).capacity() == 8);
+    REQUIRE(TestQueue(8).capacity() == 8);
+
+    TestQueue q(8);
+    int x = -1;
+    REQUIRE(q.empty());
+    REQUIRE(q.try_pop(x) == false);
+
+    // fill, overflow, drain. repeat to wrap around the ring several times
+    int next = 0;
+    int expected = 0;
+    for (int lap=0; lap < 5; ++lap) {
+        for (int i=0; i < 8; ++i)
+            REQUIRE(q.try_push(next++));
+        REQUIRE(q.try_push(-1) == false); // full
+        REQUIRE(!q.empty());
+
+        for (int i=0; i < 8; ++i) {
+            REQUIRE(q.try_pop(x));
+            REQUIRE(x == expected++);
+        }
+        REQUIRE(q.try_pop(x) == false); // empty
+
+        // partially fill, so the next lap starts mid-ring
+        for (int i=0; i < 3; ++i)
+            REQUIRE(q.try_push(next++));
+        for (int i=0; i < 3; ++i) {
+            REQUIRE(q.try_pop(x));
+            REQUIRE(x == expected++);
+        }
+    }
+    // (next is equal to the read and write positions)
+
+    // batch operations transfer as many values as fit or are available
+    int in[12];
+    for (int i=0; i < 12; ++i)
+        in[i] = next + i;
+
+    REQUIRE(q.push_n(in, 5) == 5);
+    REQUIRE(q.push_n(in + 5, 7) == 3); // room for 3 more
+    REQUIRE(q.push_n(in + 8, 4) == 0); // full
+
+    int out[12];
+    REQUIRE(q.pop_n(out, 2) == 2);
+    REQUIRE(q.pop_n(out + 2, 10) == 6); // only 6 left
+    REQUIRE(q.pop_n(out + 8, 4) == 0); // empty
+    for (int i=0; i < 8; ++i)
+        REQUIRE(out[i] == next + i);
+    next += 8;
+
+    // reserve/commit spans don't wrap around the end of the ring
+    while ((next % 8) != 3) { // move the positions to index 3
+        REQUIRE(q.try_push(next++));
+        REQUIRE(q.try_pop(x));
+    }
+
+    std::size_t count = 100;
+    int *span = q.reserve_push(count);
+    REQUIRE(span != nullptr);
+    REQUIRE(count == 5); // up to the end of the ring
+    for (std::size_t i=0; i < count; ++i)
+        span[i] = next++;
+    REQUIRE(q.try_pop(x) == false); // not yet committed
+    q.commit_push(count);
+
+    count = 100;
+    span = q.reserve_push(count);
+    REQUIRE(span != nullptr);
+    REQUIRE(count == 3); // wrapped: the remaining free slots at the start of the ring
+    span[0] = next++;
+    span[1] = next++;
+    q.commit_push(2); // commit part of the span
+
+    count = 4;
+    span = q.reserve_push(count);
+    REQUIRE(count == 1);
+    span[0] = next++;
+    q.commit_push(1);
+
+    count = 1;
+    REQUIRE(q.reserve_push(count) == nullptr); // full
+    REQUIRE(count == 0);
+
+    expected = next - 8;
+    count = 100;
+    span = q.reserve_pop(count);
+    REQUIRE(span != nullptr);
+    REQUIRE(count == 5); // up to the end of the ring
+    for (std::size_t i=0; i < count; ++i)
+        REQUIRE(span[i] == expected + static_cast<int>(i));
+    q.commit_pop(2); // release part of the span
+
+    count = 100;
+    span = q.reserve_pop(count);
+    REQUIRE(count == 3);
+    REQUIRE(span[0] == expected + 2);
+    q.commit_pop(3);
+
+    REQUIRE(q.pop_n(out, 12) == 3);
+    REQUIRE(out[0] == expected + 5);
+    REQUIRE(out[2] == expected + 7);
+
+    count = 1;
+    REQUIRE(q.reserve_pop(count) == nullptr); // empty
+    REQUIRE(count == 0);
+    REQUIRE(q.empty());
+}
+
+namespace {
+
+    static const int ITEM_COUNT=500000;
+    static const std::size_t BATCH_SIZE=13;
+
+    static TestQueue *testQueue_;
+
+    // Cycles through try_push(), push_n() and reserve_push()/commit_push()
+    static unsigned producerThreadProc()
+    {
+        int next = 0;
+        int op = 0;
+        while (next < ITEM_COUNT) {
+            std::size_t remaining = static_cast<std::size_t>(ITEM_COUNT - next);
+            std::size_t wanted = (remaining < BATCH_SIZE) ? remaining : BATCH_SIZE;
+            std::size_t pushed = 0;
+
+            switch (op++ % 3) {
+            case 0:
+                pushed = testQueue_->try_push(next) ? 1 : 0;
+                break;
+            case 1:
+                {
+                    int values[BATCH_SIZE];
+                    for (std::size_t i=0; i < wanted; ++i)
+                        values[i] = next + static_cast<int>(i);
+                    pushed = testQueue_->push_n(values, wanted);
+                }
+                break;
+            case 2:
+                {
+                    std::size_t count = wanted;
+                    int *span = testQueue_->reserve_push(count);
+                    for (std::size_t i=0; i < count; ++i)
+                        span[i] = next + static_cast<int>(i);
+                    testQueue_->commit_push(count);
+                    pushed = count;
+                }
+                break;
+            }
+
+            next += static_cast<int>(pushed);
+            if (pushed == 0)
+                std::this_thread::yield();
+        }
+        return 0;
+    }
+
+    // Cycles through try_pop(), pop_n() and reserve_pop()/commit_pop(),
+    // and checks that values arrive exactly once, in order.
+    static unsigned consumerThreadProc()
+    {
+        int expected = 0;
+        int op = 0;
+        while (expected < ITEM_COUNT) {
+            std::size_t popped = 0;
+            switch (op++ % 3) {
+            case 0:
+                {
+                    int x;
+                    if (testQueue_->try_pop(x)) {
+                        if (x != expected)
+                            return 1;
+                        popped = 1;
+                    }
+                }
+                break;
+            case 1:
+                {
+                    int values[BATCH_SIZE];
+                    popped = testQueue_->pop_n(values, BATCH_SIZE);
+                    for (std::size_t i=0; i < popped; ++i) {
+                        if (values[i] != expected + static_cast<int>(i))
+                            return 1;
+                    }
+                }
+                break;
+            case 2:
+                {
+                    std::size_t count = BATCH_SIZE;
+                    const int *span = testQueue_->reserve_pop(count);
+                    for (std::size_t i=0; i < count; ++i) {
+                        if (span[i] != expected + static_cast<int>(i))
+                            return 1;
+                    }
+                    testQueue_->commit_pop(count);
+                    popped = count;
+                }
+                break;
+            }
+
+            expected += static_cast<int>(popped);
+            if (popped == 0)
+                std::this_thread::yield();
+        }
+
+        int x;
+        return testQueue_->try_pop(x) ? 1 : 0;
+    }
+}
+
+TEST_CASE("qw/spsc_bounded_queue/multi-threaded", "[slow][fuzz] QwSpscBoundedQueue multi-threaded test") {
+
+    testQueue_ = new TestQueue(64);
+
+    unsigned producerResult = 1, consumerResult = 1;
+    std::thread producer([&producerResult]{ producerResult = producerThreadProc(); });
+    std::thread consumer([&consumerResult]{ consumerResult = consumerThreadProc(); });
+    producer.join();
+    consumer.join();
+
+    REQUIRE(producerResult == 0);
+    REQUIRE(consumerResult == 0);
+
+    delete testQueue_;
+}
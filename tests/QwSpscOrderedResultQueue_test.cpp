@@ -0,0 +1,178 @@
+/*
+    Queue World is copyright (c) 2014-2018 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#include "QwSpscOrderedResultQueue.h"
+
+#include "catch.hpp"
+
+#include <atomic>
+#include <thread>
+
+
+namespace {
+
+    struct TestNode{
+        std::atomic<TestNode*> links_[2];
+        enum { LINK_INDEX_1, LINK_COUNT };
+
+        int value;
+
+        TestNode()
+            : value(0)
+        {
+            for (int i=0; i < LINK_COUNT; ++i)
+                links_[i].store(nullptr, std::memory_order_relaxed);
+        }
+    };
+
+    typedef QwSpscOrderedResultQueue<TestNode*, TestNode::LINK_INDEX_1> TestSpscOrderedResultQueue;
+
+} // end anonymous namespace
+
+
+TEST_CASE("qw/spsc_ordered_result_queue", "QwSpscOrderedResultQueue single threaded test") {
+
+    TestNode nodes[4];
+    TestNode *a = &nodes[0];
+    TestNode *b = &nodes[1];
+    TestNode *c = &nodes[2];
+    TestNode *d = &nodes[3];
+
+    TestSpscOrderedResultQueue q;
+    q.init();
+
+    REQUIRE(q.expectedResultCount() == 0);
+    REQUIRE(q.pop() == (TestNode*)nullptr);
+
+    q.incrementExpectedResultCount();
+    q.push(a);
+    REQUIRE(q.expectedResultCount() == 1);
+    REQUIRE(q.pop() == a);
+    REQUIRE(q.expectedResultCount() == 0);
+    REQUIRE(q.pop() == (TestNode*)nullptr);
+
+    // results are popped in the order that they were pushed
+    q.incrementExpectedResultCount(3);
+    q.push(a);
+    q.push(b);
+    q.push(c);
+
+    REQUIRE(q.expectedResultCount() == 3);
+    REQUIRE(q.pop() == a);
+    REQUIRE(q.expectedResultCount() == 2);
+    REQUIRE(q.pop() == b);
+    REQUIRE(q.expectedResultCount() == 1);
+    REQUIRE(q.pop() == c);
+    REQUIRE(q.expectedResultCount() == 0);
+    REQUIRE(q.pop() == (TestNode*)nullptr);
+
+    // interleaved push and pop, including pushing after the queue drains
+    q.incrementExpectedResultCount(6);
+    q.push(a);
+    q.push(b);
+    REQUIRE(q.pop() == a);
+    q.push(c);
+    REQUIRE(q.pop() == b);
+    REQUIRE(q.pop() == c);
+    REQUIRE(q.pop() == (TestNode*)nullptr);
+    q.push(d);
+    q.push(a);
+    REQUIRE(q.pop() == d);
+    q.push(b);
+    REQUIRE(q.pop() == a);
+    REQUIRE(q.pop() == b);
+    REQUIRE(q.pop() == (TestNode*)nullptr);
+    REQUIRE(q.expectedResultCount() == 0);
+}
+
+namespace {
+
+    // A producer sends numbered nodes to a consumer on one queue, and the
+    // consumer returns them on another. With few nodes, both queues are
+    // frequently drained, which exercises the empty <-> non-empty transitions.
+
+    static const int NODE_COUNT=8;
+    static const int ITEM_COUNT=500000;
+
+    static TestSpscOrderedResultQueue forwardQueue_;
+    static TestSpscOrderedResultQueue returnQueue_;
+
+    static unsigned producerThreadProc()
+    {
+        returnQueue_.incrementExpectedResultCount(NODE_COUNT + ITEM_COUNT);
+
+        int next = 0;
+        while (next < ITEM_COUNT) {
+            TestNode *n = returnQueue_.pop();
+            if (!n) {
+                std::this_thread::yield();
+                continue;
+            }
+            n->value = next++;
+            forwardQueue_.push(n);
+        }
+        return 0;
+    }
+
+    // Check that nodes arrive exactly once, in order
+    static unsigned consumerThreadProc()
+    {
+        forwardQueue_.incrementExpectedResultCount(ITEM_COUNT);
+
+        int expected = 0;
+        while (expected < ITEM_COUNT) {
+            TestNode *n = forwardQueue_.pop();
+            if (!n) {
+                std::this_thread::yield();
+                continue;
+            }
+            if (n->value != expected)
+                return 1;
+            ++expected;
+            returnQueue_.push(n);
+        }
+        return (forwardQueue_.pop() == nullptr) ? 0 : 1;
+    }
+}
+
+TEST_CASE("qw/spsc_ordered_result_queue/multi-threaded", "[slow][fuzz] QwSpscOrderedResultQueue multi-threaded test") {
+
+    TestNode nodes[NODE_COUNT];
+    forwardQueue_.init();
+    returnQueue_.init();
+    for (int i=0; i < NODE_COUNT; ++i)
+        returnQueue_.push(&nodes[i]);
+
+    unsigned producerResult = 1, consumerResult = 1;
+    std::thread producer([&producerResult]{ producerResult = producerThreadProc(); });
+    std::thread consumer([&consumerResult]{ consumerResult = consumerThreadProc(); });
+    producer.join();
+    consumer.join();
+
+    REQUIRE(producerResult == 0);
+    REQUIRE(consumerResult == 0);
+
+    // all nodes are returned
+    int returned = 0;
+    while (returnQueue_.pop())
+        ++returned;
+    REQUIRE(returned == NODE_COUNT);
+}
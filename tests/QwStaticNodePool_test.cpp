@@ -0,0 +1,145 @@
+/*
+    Queue World is copyright (c) 2014-2018 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#include "QwStaticNodePool.h"
+#include "QwSList.h"
+
+#include "catch.hpp"
+
+#include <cstddef> // size_t
+#include <cstdint>
+#include <thread>
+
+
+namespace {
+
+    struct TestNode{
+        TestNode *links_[2];
+        enum { LINK_INDEX_1, LINK_COUNT };
+
+        int value;
+
+        TestNode()
+            : value(0)
+        {
+            for (int i=0; i < LINK_COUNT; ++i)
+                links_[i] = nullptr;
+        }
+    };
+
+    typedef QwSList<TestNode*, TestNode::LINK_INDEX_1> TestSList;
+
+    // geometry is known at compile time
+    static_assert(QwStaticNodePool<TestNode, 21>::node_stride() == CACHE_LINE_SIZE, "unexpected node stride");
+    static_assert(QwStaticNodePool<TestNode, 21>::capacity() == 21, "unexpected capacity");
+
+    static QwStaticNodePool<TestNode, 64> staticPool_; // no heap allocation
+
+} // end anonymous namespace
+
+TEST_CASE("qw/static_node_pool", "QwStaticNodePool single threaded test") {
+
+    const size_t maxNodes = 21;
+
+    QwStaticNodePool<TestNode, maxNodes> pool;
+
+    TestSList allocatedNodes;
+
+    for (size_t i=0; i < maxNodes; ++i) {
+        TestNode *n = pool.allocate();
+        REQUIRE(n != (TestNode*)nullptr);
+        REQUIRE((reinterpret_cast<std::uintptr_t>(n) % CACHE_LINE_SIZE) == 0);
+        REQUIRE(n->value == 0); // node is constructed
+        n->value = static_cast<int>(i);
+        allocatedNodes.push_front(n);
+    }
+
+    REQUIRE(pool.allocate() == (TestNode*)nullptr);
+
+    while (!allocatedNodes.empty())
+        pool.deallocate(allocatedNodes.pop_front());
+
+    // power-of-two capacity needs an extra index bit
+    QwStaticNodePool<TestNode, 16> pool16;
+    for (size_t i=0; i < 16; ++i) {
+        TestNode *n = pool16.allocate();
+        REQUIRE(n != (TestNode*)nullptr);
+        allocatedNodes.push_front(n);
+    }
+    REQUIRE(pool16.allocate() == (TestNode*)nullptr);
+
+    while (!allocatedNodes.empty())
+        pool16.deallocate(allocatedNodes.pop_front());
+}
+
+namespace {
+
+    static const std::size_t TEST_THREAD_COUNT=8;
+    static const std::size_t TEST_NODES_PER_THREAD=8;
+    static const std::size_t THREAD_ITERATIONS=20000;
+
+    static_assert(TEST_THREAD_COUNT * TEST_NODES_PER_THREAD <= 64, "staticPool_ is too small");
+
+    static unsigned testThreadProc(int seed)
+    {
+        TestSList allocatedNodes;
+
+        for (std::size_t i=0; i < THREAD_ITERATIONS; ++i) {
+            // each thread holds at most TEST_NODES_PER_THREAD nodes so allocation never fails.
+            std::size_t n = ((i * 7 + static_cast<std::size_t>(seed)) % TEST_NODES_PER_THREAD) + 1;
+            for (std::size_t j=0; j < n; ++j) {
+                TestNode *node = staticPool_.allocate();
+                if (!node)
+                    return 1;
+                allocatedNodes.push_front(node);
+            }
+
+            for (TestSList::iterator j = allocatedNodes.begin(); j != allocatedNodes.end(); ++j)
+                (*j)->value = seed;
+            for (TestSList::iterator j = allocatedNodes.begin(); j != allocatedNodes.end(); ++j) {
+                if ((*j)->value != seed)
+                    return 1; // node is shared with another thread
+            }
+
+            while (!allocatedNodes.empty())
+                staticPool_.deallocate(allocatedNodes.pop_front());
+        }
+
+        return 0;
+    }
+}
+
+TEST_CASE("qw/static_node_pool/multi-threaded", "[slow][fuzz] QwStaticNodePool multi-threaded test") {
+
+    unsigned results[TEST_THREAD_COUNT];
+    std::thread* threads[TEST_THREAD_COUNT];
+
+    for (std::size_t i=0; i < TEST_THREAD_COUNT; ++i) {
+        results[i] = 1;
+        threads[i] = new std::thread([&results, i]{ results[i] = testThreadProc(static_cast<int>(i)); });
+    }
+
+    for (std::size_t i=0; i < TEST_THREAD_COUNT; ++i) {
+        threads[i]->join();
+        delete threads[i];
+        REQUIRE(results[i] == 0);
+    }
+}
@@ -0,0 +1,177 @@
+/*
+    Queue World is copyright (c) 2014-2018 Ross Bencina
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+#include "QwVyukovMpscFifoQueue.h"
+
+#include "catch.hpp"
+
+#include <atomic>
+#include <thread>
+
+
+namespace {
+
+    struct TestNode{
+        std::atomic<TestNode*> links_[2];
+        enum { LINK_INDEX_1, LINK_COUNT };
+
+        int value;
+
+        TestNode()
+            : value(0)
+        {
+            for (int i=0; i < LINK_COUNT; ++i)
+                links_[i].store(nullptr, std::memory_order_relaxed);
+        }
+    };
+
+    typedef QwVyukovMpscFifoQueue<TestNode*, TestNode::LINK_INDEX_1> TestVyukovMpscFifoQueue;
+
+} // end anonymous namespace
+
+
+TEST_CASE("qw/vyukov_mpsc_fifo_queue", "QwVyukovMpscFifoQueue single threaded test") {
+
+    TestNode nodes[4];
+    TestNode *a = &nodes[0];
+    TestNode *b = &nodes[1];
+    TestNode *c = &nodes[2];
+    TestNode *d = &nodes[3];
+
+    TestVyukovMpscFifoQueue q;
+
+    REQUIRE(q.consumer_empty() == true);
+    REQUIRE(q.pop() == (TestNode*)nullptr);
+
+    // single node (pop re-pushes the stub behind it)
+    q.push(a);
+    REQUIRE(q.consumer_empty() == false);
+    REQUIRE(q.pop() == a);
+    REQUIRE(q.consumer_empty() == true);
+    REQUIRE(q.pop() == (TestNode*)nullptr);
+
+    q.push(a);
+    q.push(b);
+    q.push(c);
+
+    REQUIRE(q.consumer_empty() == false);
+    REQUIRE(q.pop() == a);
+    REQUIRE(q.pop() == b);
+    REQUIRE(q.pop() == c);
+    REQUIRE(q.consumer_empty() == true);
+    REQUIRE(q.pop() == (TestNode*)nullptr);
+
+    // interleaved push and pop
+    q.push(a);
+    q.push(b);
+    REQUIRE(q.pop() == a);
+    q.push(c);
+    REQUIRE(q.pop() == b);
+    q.push(d);
+    REQUIRE(q.pop() == c);
+    REQUIRE(q.pop() == d);
+    REQUIRE(q.consumer_empty() == true);
+
+    // popped nodes can be pushed again immediately
+    q.push(d);
+    q.push(c);
+    REQUIRE(q.pop() == d);
+    q.push(d);
+    REQUIRE(q.pop() == c);
+    REQUIRE(q.pop() == d);
+    REQUIRE(q.pop() == (TestNode*)nullptr);
+    REQUIRE(q.consumer_empty() == true);
+}
+
+namespace {
+
+    static const int PRODUCER_COUNT=3;
+    static const int ITEMS_PER_PRODUCER=50000;
+    static const int TOTAL_ITEMS=PRODUCER_COUNT*ITEMS_PER_PRODUCER;
+
+    static TestVyukovMpscFifoQueue *testQueue_;
+    static TestNode *testNodes_;
+
+    static unsigned producerThreadProc(int producer)
+    {
+        for (int i=0; i < ITEMS_PER_PRODUCER; ++i) {
+            TestNode *n = &testNodes_[producer * ITEMS_PER_PRODUCER + i];
+            n->value = producer * ITEMS_PER_PRODUCER + i;
+            testQueue_->push(n);
+        }
+        return 0;
+    }
+
+    // Check that every node is received exactly once, in per-producer FIFO order
+    static unsigned consumerThreadProc()
+    {
+        int lastSequence[PRODUCER_COUNT];
+        for (int i=0; i < PRODUCER_COUNT; ++i)
+            lastSequence[i] = -1;
+
+        int received = 0;
+        while (received < TOTAL_ITEMS) {
+            TestNode *n = testQueue_->pop();
+            if (!n) {
+                std::this_thread::yield();
+                continue;
+            }
+
+            if (n != &testNodes_[n->value])
+                return 1; // corrupt
+            int producer = n->value / ITEMS_PER_PRODUCER;
+            int sequence = n->value % ITEMS_PER_PRODUCER;
+            if (sequence != lastSequence[producer] + 1)
+                return 1; // lost, duplicated or out of order
+            lastSequence[producer] = sequence;
+            ++received;
+        }
+
+        return (testQueue_->consumer_empty() && testQueue_->pop() == nullptr) ? 0 : 1;
+    }
+}
+
+TEST_CASE("qw/vyukov_mpsc_fifo_queue/multi-threaded", "[slow][fuzz] QwVyukovMpscFifoQueue multi-threaded test") {
+
+    testNodes_ = new TestNode[TOTAL_ITEMS];
+    testQueue_ = new TestVyukovMpscFifoQueue;
+
+    const int threadCount = PRODUCER_COUNT + 1;
+    unsigned results[threadCount];
+    std::thread* threads[threadCount];
+
+    for (int i=0; i < threadCount; ++i) {
+        results[i] = 1;
+        if (i < PRODUCER_COUNT)
+            threads[i] = new std::thread([&results, i]{ results[i] = producerThreadProc(i); });
+        else
+            threads[i] = new std::thread([&results, i]{ results[i] = consumerThreadProc(); });
+    }
+
+    for (int i=0; i < threadCount; ++i) {
+        threads[i]->join();
+        delete threads[i];
+        REQUIRE(results[i] == 0);
+    }
+
+    delete testQueue_;
+    delete [] testNodes_;
+}